@@ -0,0 +1,143 @@
+#pragma once
+#include "adpcm-ffmpeg/adpcm.h"
+
+namespace adpcm_ffmpeg {
+
+/**
+ * @brief Classifies the blocks of IMA_WAV (4 bit) and MS streams as silent
+ * or active without decoding them: the quantizer step size of the codec
+ * (the IMA step or the MS idelta) follows the level of the prediction
+ * residual. BlockHeader just reads the step from the block header, which
+ * describes the start of the block. StateScan runs the step adaptation over
+ * all nibbles of the block, but not the predictor, and provides the mean
+ * step. The level is the maximum of the channels. The default thresholds
+ * were calibrated with tests/activity against the decoded RMS at -40 dBFS
+ * and validated there with original.wav, which was not used to calibrate
+ * them.
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+class ADPCMActivityDetector {
+ public:
+  enum Method { BlockHeader, StateScan };
+
+  /// Sets up the detector for the stream: returns false if the codec is not
+  /// supported. The threshold is set to the default of the codec.
+  bool begin(AVCodecID id, int channels, int blockAlign,
+             Method method = StateScan) {
+    if ((id != AV_CODEC_ID_ADPCM_IMA_WAV && id != AV_CODEC_ID_ADPCM_MS) ||
+        channels < 1 || channels > 2 || blockAlign < header(id, channels)) {
+      av_log(NULL, AV_LOG_ERROR, "activity detection not supported\n");
+      return false;
+    }
+    codec_id = id;
+    channel_count = channels;
+    this->method = method;
+    threshold = id == AV_CODEC_ID_ADPCM_MS ? ADPCM_ACTIVITY_MS_THRESHOLD
+                                           : ADPCM_ACTIVITY_IMA_THRESHOLD;
+    return true;
+  }
+
+  /// Defines the level from which a block is active
+  void setThreshold(int level) { threshold = level; }
+
+  int getThreshold() { return threshold; }
+
+  /// Provides the estimated level of the block in quantizer steps (0 if the
+  /// block is too short)
+  int level(const uint8_t *block, int size) {
+    if (block == nullptr || size < header(codec_id, channel_count)) return 0;
+    if (codec_id == AV_CODEC_ID_ADPCM_MS)
+      return method == StateScan ? scanMS(block, size) : headerMS(block);
+    return method == StateScan ? scanIMA(block, size) : headerIMA(block);
+  }
+
+  bool isActive(const uint8_t *block, int size) {
+    return level(block, size) >= threshold;
+  }
+
+ protected:
+  AVCodecID codec_id = AV_CODEC_ID_NONE;
+  int channel_count = 0;
+  Method method = StateScan;
+  int threshold = 0;
+
+  static int header(AVCodecID id, int channels) {
+    return (id == AV_CODEC_ID_ADPCM_MS ? 7 : 4) * channels;
+  }
+
+  // the IMA header of a channel: predictor (16 bit), step index, reserved
+  int headerIMA(const uint8_t *block) {
+    int result = 0;
+    for (int ch = 0; ch < channel_count; ch++) {
+      int index = av_clip(block[4 * ch + 2], 0, 88);
+      result = FFMAX(result, ff_adpcm_step_table[index]);
+    }
+    return result;
+  }
+
+  // the IMA data is interleaved in chunks of 4 bytes per channel: the
+  // channels are scanned together, so that the two chains overlap
+  int scanIMA(const uint8_t *block, int size) {
+    int chunks = (size - 4 * channel_count) / (4 * channel_count);
+    if (chunks == 0) return 0;
+    const uint8_t *data = block + 4 * channel_count;
+    int first = av_clip(block[2], 0, 88);
+    int last = av_clip(block[4 * channel_count - 2], 0, 88);
+    int64_t sum_first = 0, sum_last = 0;
+    for (int j = 0; j < chunks; j++, data += 4 * channel_count) {
+      for (int i = 0; i < 4; i++) {
+        sum_first += adaptIMA(first, data[i] & 0x0F);
+        sum_first += adaptIMA(first, data[i] >> 4);
+        if (channel_count == 2) {
+          sum_last += adaptIMA(last, data[i + 4] & 0x0F);
+          sum_last += adaptIMA(last, data[i + 4] >> 4);
+        }
+      }
+    }
+    return (int)(FFMAX(sum_first, sum_last) / (8 * chunks));
+  }
+
+  static int adaptIMA(int &index, int nibble) {
+    index = av_clip(index + ff_adpcm_index_table[nibble], 0, 88);
+    return ff_adpcm_step_table[index];
+  }
+
+  // the MS header: predictors, idelta, sample1 and sample2 of the channels
+  int headerMS(const uint8_t *block) {
+    int result = 0;
+    for (int ch = 0; ch < channel_count; ch++)
+      result = FFMAX(result, (int16_t)AV_RL16(block + channel_count + 2 * ch));
+    return result;
+  }
+
+  // the high nibble belongs to the first channel, the low nibble to the last
+  int scanMS(const uint8_t *block, int size) {
+    int count = size - 7 * channel_count;
+    if (count <= 0) return 0;
+    const uint8_t *data = block + 7 * channel_count;
+    int first = FFMAX((int16_t)AV_RL16(block + channel_count), 16);
+    int last = FFMAX((int16_t)AV_RL16(block + 3 * channel_count - 2), 16);
+    int64_t sum_first = 0, sum_last = 0;
+    if (channel_count == 1) {
+      for (int j = 0; j < count; j++) {
+        sum_first += adaptMS(first, data[j] >> 4);
+        sum_first += adaptMS(first, data[j] & 0x0F);
+      }
+      return (int)(sum_first / (2 * count));
+    }
+    for (int j = 0; j < count; j++) {
+      sum_first += adaptMS(first, data[j] >> 4);
+      sum_last += adaptMS(last, data[j] & 0x0F);
+    }
+    return (int)(FFMAX(sum_first, sum_last) / count);
+  }
+
+  static int adaptMS(int &idelta, int nibble) {
+    idelta = (ff_adpcm_AdaptationTable[nibble] * idelta) >> 8;
+    idelta = FFMIN(FFMAX(idelta, 16), INT_MAX / 768);
+    return idelta;
+  }
+};
+
+}  // namespace adpcm_ffmpeg
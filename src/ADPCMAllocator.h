@@ -0,0 +1,46 @@
+#pragma once
+#include <stddef.h>
+#include <stdlib.h>
+
+namespace adpcm_ffmpeg {
+
+/**
+ * @brief Memory allocation used by av_malloc() and ADPCMVector. Subclass it
+ * and register the instance with setInstance() to account for or redirect
+ * the memory of the codecs. The allocator should be replaced before any codec
+ * is created, since memory is released by the allocator that is active at
+ * that time.
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+class ADPCMAllocator {
+ public:
+  virtual ~ADPCMAllocator() = default;
+
+  /// Allocates size bytes: returns nullptr on failure
+  virtual void *allocate(size_t size) { return malloc(size); }
+
+  /// Releases memory provided by allocate()
+  virtual void release(void *ptr) { free(ptr); }
+
+  /// Provides the active allocator
+  static ADPCMAllocator &instance() { return *active(); }
+
+  /// Defines the active allocator: nullptr restores the default
+  static void setInstance(ADPCMAllocator *allocator) {
+    active() = allocator != nullptr ? allocator : &defaultInstance();
+  }
+
+ protected:
+  static ADPCMAllocator &defaultInstance() {
+    static ADPCMAllocator allocator;
+    return allocator;
+  }
+
+  static ADPCMAllocator *&active() {
+    static ADPCMAllocator *p_allocator = &defaultInstance();
+    return p_allocator;
+  }
+};
+
+}  // namespace adpcm_ffmpeg
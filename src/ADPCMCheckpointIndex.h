@@ -0,0 +1,172 @@
+#pragma once
+#include <stdio.h>
+#include <string.h>
+#include "ADPCMMappedFile.h"
+#include "ADPCMStreamState.h"
+#include "ADPCMVector.h"
+
+#define ADPCM_CHECKPOINT_VERSION 1
+
+namespace adpcm_ffmpeg {
+
+/**
+ * @brief Decoder state before a block of the stream
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+struct ADPCMCheckpoint {
+  /// index of the block which is decoded with the state
+  uint32_t block;
+  uint32_t reserved;
+  ADPCMStreamState state;
+};
+
+/**
+ * @brief Header of the checkpoint file: it identifies the stream, so that
+ * an outdated index is not applied. The checkpoints follow the header.
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+struct ADPCMCheckpointHeader {
+  char magic[4];
+  uint16_t version;
+  /// sizeof(ADPCMCheckpoint): the file is only valid on the same platform
+  uint16_t record_size;
+  uint32_t codec_id;
+  uint32_t channels;
+  uint32_t block_align;
+  /// blocks between two checkpoints
+  uint32_t interval;
+  uint32_t count;
+  uint32_t reserved;
+  uint64_t data_size;
+};
+
+/**
+ * @brief Decoder states at regular block intervals of a stream whose blocks
+ * depend on their predecessors: seeking only needs to decode the blocks from
+ * the preceding checkpoint. The index is created with
+ * ADPCMWavReader::buildIndex() and can be stored as a sidecar file which is
+ * mapped into memory by open().
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+class ADPCMCheckpointIndex {
+ public:
+  ADPCMCheckpointIndex() { memset(&header, 0, sizeof(header)); }
+  ADPCMCheckpointIndex(const ADPCMCheckpointIndex &) = delete;
+  ADPCMCheckpointIndex &operator=(const ADPCMCheckpointIndex &) = delete;
+
+  /// Starts a new index for the indicated stream
+  void begin(AVCodecID id, int channels, int blockAlign, uint64_t dataSize,
+             int interval) {
+    end();
+    memcpy(header.magic, "ADCK", 4);
+    header.version = ADPCM_CHECKPOINT_VERSION;
+    header.record_size = sizeof(ADPCMCheckpoint);
+    header.codec_id = id;
+    header.channels = channels;
+    header.block_align = blockAlign;
+    header.interval = FFMAX(interval, 1);
+    header.data_size = dataSize;
+    // reserve the checkpoints, so that add() does not need to reallocate
+    if (blockAlign > 0) {
+      uint64_t blocks = (dataSize + blockAlign - 1) / blockAlign;
+      entries.resize(blocks / header.interval + 1);
+      entries.clear();
+    }
+  }
+
+  /// Releases the checkpoints
+  void end() {
+    file.close();
+    entries.resize(0);
+    p_entries = nullptr;
+    memset(&header, 0, sizeof(header));
+  }
+
+  /// Adds the state before the indicated block: the blocks must be added in
+  /// increasing order
+  void add(uint32_t block, const ADPCMStreamState &state) {
+    ADPCMCheckpoint checkpoint;
+    memset(&checkpoint, 0, sizeof(checkpoint));
+    checkpoint.block = block;
+    checkpoint.state = state;
+    entries.push_back(checkpoint);
+    p_entries = &entries[0];
+    header.count = entries.size();
+  }
+
+  /// Provides the last checkpoint at or before the block (nullptr if there
+  /// is none)
+  const ADPCMCheckpoint *find(uint32_t block) const {
+    int low = 0, high = (int)header.count - 1;
+    const ADPCMCheckpoint *result = nullptr;
+    while (low <= high) {
+      int mid = (low + high) / 2;
+      if (p_entries[mid].block <= block) {
+        result = &p_entries[mid];
+        low = mid + 1;
+      } else {
+        high = mid - 1;
+      }
+    }
+    return result;
+  }
+
+  /// Checks if the index was created for the indicated stream
+  bool matches(AVCodecID id, int channels, int blockAlign,
+               uint64_t dataSize) const {
+    return header.count > 0 && header.codec_id == (uint32_t)id &&
+           header.channels == (uint32_t)channels &&
+           header.block_align == (uint32_t)blockAlign &&
+           header.data_size == dataSize;
+  }
+
+  int count() const { return header.count; }
+
+  /// Blocks between two checkpoints
+  int interval() const { return header.interval; }
+
+  /// Writes the index as sidecar file
+  bool save(const char *path) const {
+    FILE *out = fopen(path, "wb");
+    if (out == nullptr) return false;
+    bool ok = fwrite(&header, sizeof(header), 1, out) == 1 &&
+              fwrite(p_entries, sizeof(ADPCMCheckpoint), header.count, out) ==
+                  header.count;
+    return fclose(out) == 0 && ok;
+  }
+
+  /// Maps a sidecar file into memory: the checkpoints are not copied
+  bool open(const char *path) {
+    end();
+    if (!file.open(path, false)) return false;
+    const uint8_t *data = file.data();
+    ADPCMCheckpointHeader tmp;
+    if (file.size() < sizeof(tmp)) return invalid();
+    memcpy(&tmp, data, sizeof(tmp));
+    if (memcmp(tmp.magic, "ADCK", 4) != 0 ||
+        tmp.version != ADPCM_CHECKPOINT_VERSION ||
+        tmp.record_size != sizeof(ADPCMCheckpoint) ||
+        file.size() < sizeof(tmp) + (size_t)tmp.count * sizeof(ADPCMCheckpoint))
+      return invalid();
+    header = tmp;
+    p_entries = (const ADPCMCheckpoint *)(data + sizeof(header));
+    return true;
+  }
+
+ protected:
+  ADPCMCheckpointHeader header;
+  ADPCMVector<ADPCMCheckpoint> entries{0};
+  const ADPCMCheckpoint *p_entries = nullptr;
+  ADPCMMappedFile file;
+
+  bool invalid() {
+    av_log(NULL, AV_LOG_ERROR, "invalid checkpoint file\n");
+    end();
+    return false;
+  }
+};
+
+}  // namespace adpcm_ffmpeg
@@ -4,6 +4,9 @@
 #include "string.h"
 #include "stddef.h"
 #include "ADPCMVector.h"
+#include "ADPCMDescriptor.h"
+#include "ADPCMStreamState.h"
+#include "ADPCMStats.h"
 
 #define ADAPCM_DEFAULT_BLOCK_SIZE 128
 
@@ -12,6 +15,24 @@
 
 namespace adpcm_ffmpeg {
 
+/**
+ * @brief Memory used by an encoder or decoder in bytes
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+struct ADPCMMemoryUsage {
+  /// codec object incl. the channel state and lookup tables
+  size_t object = 0;
+  /// sample and packet buffers
+  size_t buffers = 0;
+  /// trellis paths, nodes and hash
+  size_t trellis = 0;
+  /// extradata owned by the codec
+  size_t extradata = 0;
+
+  size_t total() const { return object + buffers + trellis + extradata; }
+};
+
 /**
  * @brief Common ADPCM Functionality
  * @author Phil Schatzmann
@@ -25,6 +46,8 @@ class ADPCMCodec {
     memset(&enc_ctx, 0, sizeof(enc_ctx));
   }
 
+  virtual ~ADPCMCodec() = default;
+
   AVCodecContext &ctx() { return avctx; }
 
   void setCodecID(AVCodecID id) { avctx.codec_id = id; }
@@ -41,6 +64,43 @@ class ADPCMCodec {
 
   int channels() { return avctx.nb_channels; }
 
+  /// Provides the static codec properties (nullptr if not known)
+  const ADPCMDescriptor *descriptor() {
+    if (p_descriptor == nullptr || p_descriptor->id != avctx.codec_id)
+      p_descriptor = ADPCMDescriptors::find(avctx.codec_id);
+    return p_descriptor;
+  }
+
+  /// Provides the memory used by the codec in bytes per category
+  virtual ADPCMMemoryUsage memoryUsage() {
+    ADPCMMemoryUsage result;
+    result.object = objectSize();
+    result.buffers = bufferSize(sample_formats);
+    return result;
+  }
+
+  /// Provides a snapshot of the counters of the calls without stream state:
+  /// they are only collected if ADPCM_STATS is active, otherwise all values
+  /// are 0. The stream states have their own counters.
+  ADPCMStats stats() {
+#if ADPCM_STATS
+    return stats_data;
+#else
+    return ADPCMStats();
+#endif
+  }
+
+  /// Sets all counters to 0
+  void resetStats() {
+#if ADPCM_STATS
+    stats_data = ADPCMStats();
+#endif
+  }
+
+  /// Provides the result of the last encode() or decode() call: AV_OK or
+  /// the error code. Errors are only reported to the ADPCMLogger.
+  av_errors lastError() { return last_error; }
+
   bool isPlanar() { 
     for (AVSampleFormat fmt: sample_formats){
       if (fmt == AV_SAMPLE_FMT_S16P) return true;
@@ -52,35 +112,41 @@ class ADPCMCodec {
   AVCodecContext avctx;
   ADPCMEncodeContext enc_ctx;
   ADPCMVector<AVSampleFormat> sample_formats{0};
+  const ADPCMDescriptor *p_descriptor = nullptr;
+  av_errors last_error = AV_OK;
+#if ADPCM_STATS
+  ADPCMStats stats_data;
+  // counters of the stream which is processed
+  ADPCMStats *p_stats = &stats_data;
+#endif
+
+  /// Directs the counters to the stream (nullptr: the codec's own)
+  void selectStats(ADPCMStats *stats) {
+#if ADPCM_STATS
+    p_stats = stats != nullptr ? stats : &stats_data;
+#else
+    (void)stats;
+#endif
+  }
+
+  virtual size_t objectSize() { return sizeof(ADPCMCodec); }
+
+  template <class T>
+  static size_t bufferSize(ADPCMVector<T> &vector) {
+    return vector.capacity() * sizeof(T);
+  }
+
+  template <class T>
+  static size_t bufferSize(ADPCMVector<ADPCMVector<T>> &vector) {
+    size_t result = vector.capacity() * sizeof(ADPCMVector<T>);
+    for (int j = 0; j < vector.capacity(); j++)
+      result += bufferSize(vector.data()[j]);
+    return result;
+  }
 
   int av_get_bits_per_sample() {
-    switch (avctx.codec_id) {
-      case AV_CODEC_ID_ADPCM_SBPRO_2:
-        return 2;
-      case AV_CODEC_ID_ADPCM_SBPRO_3:
-        return 3;
-      case AV_CODEC_ID_ADPCM_SBPRO_4:
-      case AV_CODEC_ID_ADPCM_IMA_WAV:
-      case AV_CODEC_ID_ADPCM_IMA_QT:
-      case AV_CODEC_ID_ADPCM_SWF:
-      case AV_CODEC_ID_ADPCM_MS:
-      case AV_CODEC_ID_ADPCM_ARGO:
-      case AV_CODEC_ID_ADPCM_CT:
-      case AV_CODEC_ID_ADPCM_IMA_ALP:
-      case AV_CODEC_ID_ADPCM_IMA_AMV:
-      case AV_CODEC_ID_ADPCM_IMA_APC:
-      case AV_CODEC_ID_ADPCM_IMA_APM:
-      case AV_CODEC_ID_ADPCM_IMA_EA_SEAD:
-      case AV_CODEC_ID_ADPCM_IMA_OKI:
-      case AV_CODEC_ID_ADPCM_IMA_WS:
-      case AV_CODEC_ID_ADPCM_IMA_SSI:
-      case AV_CODEC_ID_ADPCM_G722:
-      case AV_CODEC_ID_ADPCM_YAMAHA:
-      case AV_CODEC_ID_ADPCM_AICA:
-        return 4;
-      default:
-        return 0;
-    }
+    const ADPCMDescriptor *desc = descriptor();
+    return desc == nullptr ? 0 : desc->bits_per_sample;
   }
 
   int ff_get_encode_buffer(AVCodecContext *avctx, AVPacket *avpkt, int64_t size,
@@ -93,9 +159,34 @@ class ADPCMCodec {
     return 0;
   }
 
+  /// Replaces the global av_clip_int16() in the codecs to count the clip events
+  int16_t av_clip_int16(int a) {
+#if ADPCM_STATS
+    if ((a + 0x8000U) & ~0xFFFF) p_stats->clips++;
+#endif
+    return adpcm_ffmpeg::av_clip_int16(a);
+  }
+
+  /// av_clip() for the step index or step size adaptation
+  int av_clip_step(int a, int amin, int amax) {
+    int result = av_clip(a, amin, amax);
+#if ADPCM_STATS
+    if (result == amin)
+      p_stats->step_floor++;
+    else if (result == amax)
+      p_stats->step_ceiling++;
+#endif
+    return result;
+  }
+
   //  error message about missing feature
   void avpriv_request_sample(void *avc, const char *msg, ...) {
-    printf("%s", msg);
+    last_error = AVERROR_PATCHWELCOME;
+    if (AV_LOG_WARNING > ADPCM_LOG_LEVEL) return;
+    va_list args;
+    va_start(args, msg);
+    ADPCMLogger::instance().vlog(AV_LOG_WARNING, msg, args);
+    va_end(args);
   }
 };
 
@@ -0,0 +1,125 @@
+#pragma once
+#include "ADPCMDecoder.h"
+#include "ADPCMEncoder.h"
+#include "ADPCMVector.h"
+
+namespace adpcm_ffmpeg {
+
+/**
+ * @brief Pool of encoders or decoders keyed by codec id, sample rate and
+ * channels. Released codecs are reset and handed out again by acquire(), so
+ * after the warm up new streams do not allocate any memory. acquire() only
+ * provides codecs with the default settings of the factory: a released
+ * codec with other settings (e.g. block size, trellis, output format or
+ * channel map) is deleted.
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+template <class T, class Factory>
+class ADPCMCodecPoolT {
+ public:
+  ADPCMCodecPoolT() = default;
+  ADPCMCodecPoolT(const ADPCMCodecPoolT &) = delete;
+  ADPCMCodecPoolT &operator=(const ADPCMCodecPoolT &) = delete;
+
+  ~ADPCMCodecPoolT() { clear(); }
+
+  /// Provides an idle codec for the indicated parameters or creates a new one
+  /// (nullptr if the codec is not supported)
+  T *acquire(AVCodecID id, int sampleRate, int channels) {
+    Bucket *bucket = findBucket(id, sampleRate, channels);
+    if (bucket != nullptr && !bucket->idle.empty()) {
+      T *codec = bucket->idle.back();
+      bucket->idle.pop_back();
+      return codec;
+    }
+    T *codec = Factory::create(id);
+    if (codec == nullptr) return nullptr;
+    if (!codec->begin(sampleRate, channels)) {
+      delete codec;
+      return nullptr;
+    }
+    return codec;
+  }
+
+  /// Resets the codec and makes it available for the next acquire(): a codec
+  /// without the default settings is ended and deleted
+  void release(T *codec) {
+    if (codec == nullptr) return;
+    if (!codec->hasDefaultSettings()) {
+      codec->end();
+      delete codec;
+      return;
+    }
+    codec->reset();
+    int rate = codec->ctx().sample_rate;
+    int channels = codec->channels();
+    Bucket *bucket = findBucket(codec->codecID(), rate, channels);
+    if (bucket == nullptr) {
+      bucket = new Bucket();
+      bucket->id = codec->codecID();
+      bucket->sample_rate = rate;
+      bucket->channels = channels;
+      buckets.push_back(bucket);
+    }
+    bucket->idle.push_back(codec);
+  }
+
+  /// Creates count idle codecs for the indicated parameters
+  bool reserve(AVCodecID id, int sampleRate, int channels, int count) {
+    for (int j = 0; j < count; j++) {
+      T *codec = Factory::create(id);
+      if (codec == nullptr) return false;
+      if (!codec->begin(sampleRate, channels)) {
+        delete codec;
+        return false;
+      }
+      release(codec);
+    }
+    return true;
+  }
+
+  /// Number of idle codecs
+  int idleCount() {
+    int result = 0;
+    for (int j = 0; j < buckets.size(); j++) result += buckets[j]->idle.size();
+    return result;
+  }
+
+  /// Ends and deletes all idle codecs
+  void clear() {
+    for (int j = 0; j < buckets.size(); j++) {
+      Bucket *bucket = buckets[j];
+      for (int i = 0; i < bucket->idle.size(); i++) {
+        bucket->idle[i]->end();
+        delete bucket->idle[i];
+      }
+      delete bucket;
+    }
+    buckets.clear();
+  }
+
+ protected:
+  struct Bucket {
+    AVCodecID id;
+    int sample_rate;
+    int channels;
+    ADPCMVector<T *> idle;
+  };
+  ADPCMVector<Bucket *> buckets;
+
+  Bucket *findBucket(AVCodecID id, int sampleRate, int channels) {
+    for (int j = 0; j < buckets.size(); j++) {
+      Bucket *bucket = buckets[j];
+      if (bucket->id == id && bucket->sample_rate == sampleRate &&
+          bucket->channels == channels)
+        return bucket;
+    }
+    return nullptr;
+  }
+};
+
+using ADPCMDecoderPool = ADPCMCodecPoolT<ADPCMDecoder, ADPCMDecoderFactory>;
+using ADPCMEncoderPool = ADPCMCodecPoolT<ADPCMEncoder, ADPCMEncoderFactory>;
+
+}  // namespace adpcm_ffmpeg
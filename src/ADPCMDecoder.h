@@ -1,13 +1,33 @@
 #pragma once
+#include <math.h>
 #include "ADPCM.h"
 #include "ADPCMCodec.h"
-#include "ADPCMEncoder.h"
+#include "ADPCMDescriptor.h"
+#include "ADPCMEnvelope.h"
 #include "adpcm-ffmpeg/adpcm.h"
 #include "adpcm-ffmpeg/bytestream.h"
 #include "adpcm-ffmpeg/get_bits.h"
 
 namespace adpcm_ffmpeg {
 
+/**
+ * @brief Packet layout of a stream with fixed parameters: determined once in
+ * ADPCMDecoder::begin()
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+struct ADPCMPacketGeometry {
+  /// expected packet size in bytes (0 if not known)
+  int packet_size = 0;
+  /// samples per channel in a packet of packet_size bytes
+  int samples_per_packet = 0;
+  /// overhead: packet_size minus the bytes the samples take at
+  /// bits_per_coded_sample
+  int header_size = 0;
+  /// the sample count depends on the packet content or decoder state
+  bool variable = true;
+};
+
 /**
  * @brief ADPCM Decoder
  * @author Phil Schatzmann
@@ -19,36 +39,55 @@ class ADPCMDecoder : public ADPCMCodec {
   ADPCMDecoder() : ADPCMCodec() {
     setBlockSize(ADAPCM_DEFAULT_BLOCK_SIZE);
     avctx.bits_per_coded_sample = av_get_bits_per_sample();
-    avctx.priv_data = (uint8_t *)&enc_ctx;
+    memset(&dec_ctx, 0, sizeof(dec_ctx));
+    avctx.priv_data = (uint8_t *)&dec_ctx;
   }
 
+  /// Sets up the decoder and allocates the frame buffers: decode() does not
+  /// allocate any memory
   bool begin(int sampleRate, int channels) {
     avctx.sample_rate = sampleRate;
     avctx.nb_channels = channels;
-    avctx.bits_per_coded_sample = av_get_bits_per_sample();
+    avctx.bits_per_coded_sample = bits_per_coded_sample > 0
+                                      ? bits_per_coded_sample
+                                      : av_get_bits_per_sample();
 
     data_source = Undefined;
     // determine frame size
     int rc = adpcm_decode_init();
     if (rc != 0) return false;
+    reset();
 
-    // if frame size has not been defined, get it from encoder
+    // if frame size has not been defined, get it from the descriptor
     int frame_size = frameSize();
     if (frame_size == 0) {
-      ADPCMEncoder &enc = *ADPCMEncoderFactory::create(codecID());
-      enc.begin(sampleRate, channels);
-      setFrameSize(enc.frameSize());
-      setBlockSize(enc.blockSize());
-      frame_size = frameSize();
-      avctx.block_align = enc.blockAlign();
+      const ADPCMDescriptor *desc = descriptor();
+      if (desc == nullptr || desc->frame_size == nullptr) {
+        av_log(avctx, AV_LOG_ERROR, "frame size must be defined\n");
+        return false;
+      }
+      frame_size = desc->frame_size(blockSize(), channels);
+      setFrameSize(frame_size);
+      if (avctx.block_align == 0)
+        avctx.block_align = desc->block_align(blockSize(), channels);
     }
 
     assert(frame_size != 0);
     // avctx.frame_size = frameSize;
     avctx.sample_fmt = sample_formats[0];
-    // setup result frame data
-    frame_data_vector.resize(frame_size * channels);
-    frame.data[0] = (uint8_t *)&frame_data_vector[0];
+    setupPacketGeometry();
+    if (!checkChannelMap()) return false;
+    // setup result frame data: the planar codecs only need the interleaved
+    // int16 frame of the output channels for the 16 bit output or the
+    // channel map
+    if (!isPlanar())
+      frame_data_vector.resize(frame_size * channels);
+    else if (output_format == AV_SAMPLE_FMT_S16 || channel_count > 0)
+      frame_data_vector.resize(frame_size * outputChannels());
+    else
+      frame_data_vector.resize(0);
+    frame.data[0] = (uint8_t *)frame_data_vector.data();
+    setupMappedOutput();
     // setup extra_data
     frame_extended_data_vectors.resize(channels);
     for (int ch = 0;ch < channels; ch++){
@@ -56,7 +95,12 @@ class ADPCMDecoder : public ADPCMCodec {
       extended_data[ch] = &frame_extended_data_vectors[ch][0];
     }
     frame.extended_data = extended_data;
-    // set result samples
+    // setup the converted output
+    output_float.resize(output_format == AV_SAMPLE_FMT_FLT ? frame_size * channels : 0);
+    output_s32.resize(output_format == AV_SAMPLE_FMT_S32 ? frame_size * channels : 0);
+    // the logger is set up here, so that logging does not need to initialize
+    // the static instance in decode()
+    ADPCMLogger::instance();
     return true;
   }
 
@@ -66,35 +110,191 @@ class ADPCMDecoder : public ADPCMCodec {
     for (int ch = 0; ch < frame_extended_data_vectors.size(); ch++)
        frame_extended_data_vectors[ch].resize(0);
     frame_data_vector.resize(0);
+    output_float.resize(0);
+    output_s32.resize(0);
   }
 
+  /// Defines the sample format of the decoded frames: AV_SAMPLE_FMT_S16
+  /// (default), AV_SAMPLE_FMT_FLT (normalized to -1.0..1.0) or
+  /// AV_SAMPLE_FMT_S32 (left-justified). This must be called before begin().
+  bool setOutputFormat(AVSampleFormat fmt) {
+    if (fmt != AV_SAMPLE_FMT_S16 && fmt != AV_SAMPLE_FMT_FLT &&
+        fmt != AV_SAMPLE_FMT_S32) {
+      av_log(avctx, AV_LOG_ERROR, "output format not supported\n");
+      return false;
+    }
+    output_format = fmt;
+    return true;
+  }
+
+  AVSampleFormat outputFormat() { return output_format; }
+
+  /// Bytes of a decoded sample in the output format
+  int outputSampleSize() {
+    return output_format == AV_SAMPLE_FMT_S16 ? sizeof(int16_t) : 4;
+  }
+
+  /// Defines the channels of the decoded frames: output channel i is the
+  /// decoded channel map[i]. This selects a subset or changes the order of
+  /// the channels; count must not exceed the decoded channels. nullptr
+  /// provides all channels. IMA_WAV, IMA_QT and MS write the output channels
+  /// from their kernel, so the full frame is not stored, unless a channel is
+  /// used twice. This must be called before begin().
+  bool setChannelMap(const int *map, int count) {
+    decode_channel = -1;
+    if (map == nullptr || count <= 0) {
+      channel_count = 0;
+      return true;
+    }
+    if (count > max_channels) return false;
+    for (int i = 0; i < count; i++) {
+      if (map[i] < 0 || map[i] >= max_channels) return false;
+      channel_map[i] = map[i];
+    }
+    channel_count = count;
+    return true;
+  }
+
+  /// Provides mono frames with the average of all decoded channels: IMA_WAV,
+  /// IMA_QT and MS average two channels where the kernel writes them. This
+  /// must be called before begin().
+  void setDownmix(bool active) {
+    decode_channel = -1;
+    channel_count = active ? 1 : 0;
+    channel_map[0] = DownmixChannel;
+  }
+
+  /// Provides mono frames with the indicated channel (-1 for all channels):
+  /// IMA_QT, IMA_WAV, PSX, AFC, DTK, THP and MS do not expand the samples of
+  /// the other channels, so their state is not updated. The other codecs
+  /// decode all channels. This must be called before begin().
+  bool setDecodeChannel(int channel) {
+    if (channel < 0) return setChannelMap(nullptr, 0);
+    if (!setChannelMap(&channel, 1)) return false;
+    decode_channel = channel;
+    return true;
+  }
+
+  /// Number of channels in the decoded frames
+  int outputChannels() {
+    return channel_count > 0 ? channel_count : channels();
+  }
+
+  /// Defines the factor which is applied in the conversion to float or
+  /// int32: it can be changed between the decode() calls, e.g. for each
+  /// stream. The int32 result is clipped.
+  void setGain(float gain) {
+    output_gain = gain;
+    float_scale = gain / 32768.0f;
+    s32_scale = (int64_t)lrintf(gain * 65536.0f);
+  }
+
+  float gain() { return output_gain; }
+
   AVFrame &decode(uint8_t *data, size_t size) {
     packet.size = size;
     packet.data = (uint8_t *)data;
     return decode(packet);
   }
 
-  AVFrame &decode(AVPacket &packet) {
-    int got_packet_ptr = 0;
-
-    // clear frame data result
-    // just reset the data, for the subsequent source determination
-    //std::fill(frame_data_vector.begin(), frame_data_vector.end(), 0);
-    frame_data_vector.clearContent();
-    for (int ch = 0; ch < channels(); ch++) {
-      //std::fill(frame_extended_data_vectors[ch].begin(), frame_extended_data_vectors[ch].end(), 0);
-      frame_extended_data_vectors[ch].clearContent();
+  /// Sets up the state for a new stream. Note that the streams share the
+  /// decoder, so its own state is overwritten.
+  template <class S, int N>
+  bool initState(ADPCMStreamStateT<S, N> &state) {
+    if (!state.isSupported(descriptor(), channels())) {
+      av_log(avctx, AV_LOG_ERROR, "stream state not supported\n");
+      return false;
     }
+    adpcm_flush();
+    saveState(state);
+    state.resetStats();
+    return true;
+  }
 
-    int rc = adpcm_decode_frame(&frame, &got_packet_ptr, &packet);
-    if (rc == 0 || !got_packet_ptr) {
+  /// Replaces the decoder state with the indicated stream state, e.g. to
+  /// resume decoding at a checkpoint: the decoder keeps its own counters
+  template <class S, int N>
+  bool restoreState(ADPCMStreamStateT<S, N> &state) {
+    if (!state.isSupported(descriptor(), channels())) return false;
+    loadState(state);
+    selectStats(nullptr);
+    return true;
+  }
+
+  /// Decodes the packet of the stream with the indicated state: the state is
+  /// updated. The frame belongs to the decoder and is overwritten by the next
+  /// call, so the decoder can only be shared by the streams of one thread.
+  template <class S, int N>
+  AVFrame &decode(ADPCMStreamStateT<S, N> &state, AVPacket &packet) {
+    if (!state.isSupported(descriptor(), channels())) {
       frame.nb_samples = 0;
+      return frame;
     }
+    loadState(state);
+    AVFrame &result = decode(packet);
+    saveState(state);
+    return result;
+  }
 
-    /// determine data source: only once
-    if (data_source == Undefined) {
-      data_source = getDataSource((int16_t *)(frame.data[0]),
-                                  frame.extended_data[0], frame.nb_samples);
+  template <class S, int N>
+  AVFrame &decode(ADPCMStreamStateT<S, N> &state, uint8_t *data,
+                  size_t size) {
+    packet.size = size;
+    packet.data = (uint8_t *)data;
+    return decode(state, packet);
+  }
+
+  AVFrame &decode(AVPacket &packet) {
+    // IMA_WAV, IMA_QT and MS apply the channel map and the conversion where
+    // the kernel writes the sample: the other codecs decode all channels into
+    // the frame
+    mapped_output.done = false;
+    FloatOutput float_output{output_float.data(), channels(), float_scale,
+                             false};
+    S32Output s32_output{output_s32.data(), channels(), s32_scale, false};
+    if (use_mapped_output)
+      p_mapped = &mapped_output;
+    else if (channel_count == 0 && output_format == AV_SAMPLE_FMT_FLT)
+      p_float_output = &float_output;
+    else if (channel_count == 0 && output_format == AV_SAMPLE_FMT_S32)
+      p_s32_output = &s32_output;
+    decodeFrame(packet);
+    p_mapped = nullptr;
+    p_float_output = nullptr;
+    p_s32_output = nullptr;
+
+    if (float_output.done) {
+      frame.data[0] = (uint8_t *)float_output.data;
+      return frame;
+    }
+    if (s32_output.done) {
+      frame.data[0] = (uint8_t *)s32_output.data;
+      return frame;
+    }
+    if (mapped_output.done) {
+      if (output_format == AV_SAMPLE_FMT_FLT)
+        convertMapped(&output_float[0], float_scale);
+      else if (output_format == AV_SAMPLE_FMT_S32)
+        convertMapped(&output_s32[0], s32_scale);
+      return frame;
+    }
+
+    // the conversion is done while interleaving the planar data
+    if (output_format == AV_SAMPLE_FMT_FLT) {
+      convert(&output_float[0], float_scale);
+      return frame;
+    }
+    if (output_format == AV_SAMPLE_FMT_S32) {
+      convert(&output_s32[0], s32_scale);
+      return frame;
+    }
+
+    // the channel layout is written in place: the output is not wider than
+    // the decoded frame
+    if (channel_count > 0) {
+      int16_t *result16 = &frame_data_vector[0];
+      forEachSample([&](int pos, int sample) { result16[pos] = sample; });
+      return frame;
     }
 
     // if data is in exended data, we copy it to the frame_data
@@ -111,23 +311,229 @@ class ADPCMDecoder : public ADPCMCodec {
     return frame;
   }
 
+  /// Decodes the packet and adds the samples multiplied with the gain to the
+  /// interleaved float bus (full scale = 1.0): returns the number of samples
+  /// per channel. The bus must provide frameSize() * outputChannels() values:
+  /// the channel map and downmix are applied. The output format is ignored
+  /// and the samples are not interleaved into the frame, so a decoder which
+  /// is shared with ADPCMStreamState can mix any number of voices. Without a
+  /// channel map IMA_WAV, IMA_QT and MS add the samples from their kernel to
+  /// the bus, so the frame does not provide them afterwards.
+  int decodeMix(AVPacket &packet, float *bus, float gain) {
+    float scale = gain / 32768.0f;
+    FloatMixOutput out{bus, channels(), scale};
+    if (channel_count == 0) p_float_mix = &out;
+    decodeFrame(packet);
+    p_float_mix = nullptr;
+    if (channel_count > 0)
+      forEachSample([&](int pos, int sample) { bus[pos] += sample * scale; });
+    return frame.nb_samples;
+  }
+
+  /// Decodes the packet and adds the samples multiplied with the gain to the
+  /// interleaved int32 bus: the bus is in 16 bit units, which leaves 16 bits
+  /// of headroom for the sum
+  int decodeMix(AVPacket &packet, int32_t *bus, float gain) {
+    int64_t scale = lrintf(gain * 65536.0f);
+    Int32MixOutput out{bus, channels(), scale};
+    if (channel_count == 0) p_int32_mix = &out;
+    decodeFrame(packet);
+    p_int32_mix = nullptr;
+    if (channel_count > 0)
+      forEachSample([&](int pos, int sample) {
+        bus[pos] += (int32_t)((sample * scale) >> 16);
+      });
+    return frame.nb_samples;
+  }
+
+  /// Decodes and mixes the packet of the stream with the indicated state: the
+  /// state is updated
+  template <class S, int N, class T>
+  int decodeMix(ADPCMStreamStateT<S, N> &state, AVPacket &packet, T *bus,
+                float gain) {
+    if (!state.isSupported(descriptor(), channels())) return 0;
+    loadState(state);
+    int result = decodeMix(packet, bus, gain);
+    saveState(state);
+    return result;
+  }
+
+  /// Decodes the packet and adds at most maxSamples samples per channel to
+  /// the envelope at its current position: IMA_WAV, IMA_QT and MS pass the
+  /// samples from their kernel to the envelope without storing them, the
+  /// other codecs decode into the frame buffers which are then read. The
+  /// frame does not provide the samples afterwards. The envelope must have
+  /// been started with outputChannels(). Returns the number of added samples
+  /// per channel.
+  int summarize(AVPacket &packet, ADPCMEnvelope &envelope,
+                int maxSamples = INT32_MAX) {
+    if (envelope.channels() != outputChannels()) {
+      av_log(avctx, AV_LOG_ERROR, "envelope does not match the channels\n");
+      return 0;
+    }
+    ADPCMEnvelopeCollector collector(envelope, maxSamples);
+    // the channel selection and mixing need the frame
+    if (channel_count == 0 && !hasVariableSampleCount())
+      p_collector = &collector;
+    decodeFrame(packet);
+    p_collector = nullptr;
+    frame.nb_samples = FFMIN(frame.nb_samples, maxSamples);
+    if (!collector.isActive()) {
+      forEachSample([&](int pos, int sample) { envelope.add(sample); });
+    } else if (frame.nb_samples > 0) {
+      collector.commit(frame.nb_samples);
+    }
+    return frame.nb_samples;
+  }
+
+  /// Advances the stream state over the packet without providing any
+  /// samples: returns the number of skipped samples per channel (0 if the
+  /// packet is invalid). The codecs without block headers only update the
+  /// predictor and step and do not write any samples. The IMA codecs among
+  /// them look up the change of a byte in a shared table, which is built by
+  /// the first skip(): this is 2 to 4 times faster than decode() to 16 bit.
+  /// CT and YAMAHA adapt the step size with a multiplication, which limits
+  /// skip() like decode() (see tests/skip).
+  int skip(uint8_t *data, size_t size) {
+    packet.size = size;
+    packet.data = data;
+    return skip(packet);
+  }
+
+  int skip(AVPacket &packet) {
+    int got_packet_ptr = 0;
+    last_error = AV_OK;
+    int rc = decode_frame_init(&frame, &got_packet_ptr, &packet);
+    if (rc == AV_OK) rc = skip_frame_impl(&frame, &got_packet_ptr, &packet);
+    if (rc == AV_OK && packet.size < bytestream2_tell(&gb))
+      rc = AVERROR_INVALIDDATA;
+    frame.nb_samples = 0;
+    if (rc != AV_OK) {
+      last_error = (av_errors)rc;
+      ADPCM_STATS_ADD(invalid_packets, 1);
+      return 0;
+    }
+    return nb_samples;
+  }
+
+  /// Skips the packet of the stream with the indicated state: the state is
+  /// updated
+  template <class S, int N>
+  int skip(ADPCMStreamStateT<S, N> &state, AVPacket &packet) {
+    if (!state.isSupported(descriptor(), channels())) return 0;
+    loadState(state);
+    int result = skip(packet);
+    saveState(state);
+    return result;
+  }
+
   virtual ADPCMVector<AVSampleFormat> get_sample_format() {
     return sample_formats;
   }
 
+  ADPCMMemoryUsage memoryUsage() override {
+    ADPCMMemoryUsage result = ADPCMCodec::memoryUsage();
+    result.buffers += bufferSize(frame_data_vector);
+    result.buffers += bufferSize(frame_extended_data_vectors);
+    result.buffers += bufferSize(output_float);
+    result.buffers += bufferSize(output_s32);
+    return result;
+  }
+
+  /// Defines the bits per coded sample of the stream (e.g. from a WAV
+  /// header): 0 uses the default of the codec. This must be called before
+  /// begin().
+  void setBitsPerCodedSample(int bits) { bits_per_coded_sample = bits; }
+
+  /// true if the settings which are defined before begin() and the gain have
+  /// the values of a new decoder
+  bool hasDefaultSettings() {
+    return blockSize() == ADAPCM_DEFAULT_BLOCK_SIZE &&
+           output_format == AV_SAMPLE_FMT_S16 && channel_count == 0 &&
+           decode_channel < 0 && output_gain == 1.0f &&
+           bits_per_coded_sample == 0;
+  }
+
+  /// true if every block starts with the complete decoder state in its
+  /// header, so that a block can be decoded without its predecessors
+  bool hasIndependentBlocks() {
+    switch (avctx.codec_id) {
+      case AV_CODEC_ID_ADPCM_IMA_WAV:
+      case AV_CODEC_ID_ADPCM_IMA_DK3:
+      case AV_CODEC_ID_ADPCM_IMA_DK4:
+      case AV_CODEC_ID_ADPCM_IMA_SMJPEG:
+      case AV_CODEC_ID_ADPCM_IMA_RAD:
+      case AV_CODEC_ID_ADPCM_MS:
+      case AV_CODEC_ID_ADPCM_4XM:
+      case AV_CODEC_ID_ADPCM_SWF:
+      case AV_CODEC_ID_ADPCM_EA_XAS:
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  /// Provides the packet layout determined in begin()
+  const ADPCMPacketGeometry &packetGeometry() { return geometry; }
+
   void flush() {
     adpcm_flush();
   }
 
+  /// Restores the initial stream state so that the decoder can be reused for
+  /// a new stream with the same parameters: the buffers are kept
+  void reset() {
+    adpcm_flush();
+    frame.nb_samples = 0;
+  }
+
  protected:
   enum DataSource { Undefined, FromFrame, FromExtended };
+  ADPCMDecodeContext dec_ctx;
   AVPacket packet;
+
+  size_t objectSize() override { return sizeof(ADPCMDecoder); }
+
+  /// Loads the stream state: the counters are updated in the state until
+  /// saveState()
+  template <class S, int N>
+  void loadState(ADPCMStreamStateT<S, N> &state) {
+    state.load(dec_ctx.status, channels(), false);
+    dec_ctx.vqa_version = state.vqa_version;
+    dec_ctx.has_status = state.has_status;
+    selectStats(state.statsData());
+  }
+
+  template <class S, int N>
+  void saveState(ADPCMStreamStateT<S, N> &state) {
+    state.save(dec_ctx.status, channels(), false);
+    state.vqa_version = dec_ctx.vqa_version;
+    state.has_status = dec_ctx.has_status;
+    selectStats(nullptr);
+  }
+
   AVFrame frame;
   DataSource data_source = Undefined;
+  int bits_per_coded_sample = 0;
   bool is_frame_data = true;
   ADPCMVector<int16_t> frame_data_vector;
   ADPCMVector<ADPCMVector<int16_t>> frame_extended_data_vectors;
-  int16_t *extended_data[2] = {NULL};
+  // the most channels of any codec descriptor
+  static constexpr int max_channels = 14;
+  int16_t *extended_data[max_channels] = {NULL};
+  // output channels: a map with the DownmixChannel averages all channels
+  static constexpr int8_t DownmixChannel = -1;
+  int8_t channel_map[max_channels] = {0};
+  int channel_count = 0;
+  // the only channel which is expanded (-1 for all)
+  int decode_channel = -1;
+  // converted output
+  AVSampleFormat output_format = AV_SAMPLE_FMT_S16;
+  ADPCMVector<float> output_float;
+  ADPCMVector<int32_t> output_s32;
+  float output_gain = 1.0f;
+  float float_scale = 1.0f / 32768.0f;
+  int64_t s32_scale = 65536;
   uint8_t *data[AV_NUM_DATA_POINTERS] = {NULL};
   // decoding
   const uint8_t *buf;
@@ -138,6 +544,278 @@ class ADPCMDecoder : public ADPCMCodec {
   int st; /* stereo */
   int nb_samples, coded_samples, approx_nb_samples, ret;
   GetByteContext gb;
+  ADPCMPacketGeometry geometry;
+  /// Writes the samples of a kernel into the planar frame
+  struct PlanarOutput {
+    int16_t **data;
+    inline void put(int channel, int index, int sample) {
+      data[channel][index] = sample;
+    }
+  };
+
+  /// Writes the samples of a kernel into the interleaved frame
+  struct InterleavedOutput {
+    int16_t *data;
+    int channels;
+    inline void put(int channel, int index, int sample) {
+      data[index * channels + channel] = sample;
+    }
+  };
+
+  /// Adds the scaled samples of a kernel to the interleaved float bus
+  struct FloatMixOutput {
+    float *bus;
+    int channels;
+    float scale;
+    inline void put(int channel, int index, int sample) {
+      bus[index * channels + channel] += sample * scale;
+    }
+  };
+
+  /// Adds the scaled samples of a kernel to the interleaved int32 bus
+  struct Int32MixOutput {
+    int32_t *bus;
+    int channels;
+    int64_t scale;
+    inline void put(int channel, int index, int sample) {
+      bus[index * channels + channel] += (int32_t)((sample * scale) >> 16);
+    }
+  };
+
+  /// Writes the samples of a kernel multiplied with the gain into the
+  /// interleaved float output
+  struct FloatOutput {
+    float *data;
+    int channels;
+    float scale;
+    // false if the codec decoded into the frame instead
+    bool done;
+    inline void put(int channel, int index, int sample) {
+      data[index * channels + channel] = convertSample(sample, scale);
+    }
+  };
+
+  /// Writes the samples of a kernel multiplied with the gain into the
+  /// interleaved int32 output
+  struct S32Output {
+    int32_t *data;
+    int channels;
+    int64_t scale;
+    // false if the codec decoded into the frame instead
+    bool done;
+    inline void put(int channel, int index, int sample) {
+      data[index * channels + channel] = convertSample(sample, scale);
+    }
+  };
+
+  /// Writes the samples of a kernel into the interleaved frame of the output
+  /// channels: the downmix averages two channels, so the first channel of a
+  /// sample must be written first
+  struct MappedOutput {
+    int16_t *data = nullptr;
+    int count = 0;
+    // output channel of the decoded channels (-1 if not used)
+    int8_t position[max_channels];
+    bool downmix = false;
+    // false if the codec decoded into the frame instead
+    bool done = false;
+    inline void put(int channel, int index, int sample) {
+      if (downmix) {
+        int16_t &out = data[index];
+        out = channel == 0 ? sample : (out + sample) / 2;
+        return;
+      }
+      int i = position[channel];
+      if (i >= 0) data[index * count + i] = sample;
+    }
+  };
+
+  // receive the samples in decode() with a channel map or to float or int32,
+  // summarize() and decodeMix()
+  MappedOutput mapped_output;
+  bool use_mapped_output = false;
+  MappedOutput *p_mapped = nullptr;
+  FloatOutput *p_float_output = nullptr;
+  S32Output *p_s32_output = nullptr;
+  ADPCMEnvelopeCollector *p_collector = nullptr;
+  FloatMixOutput *p_float_mix = nullptr;
+  Int32MixOutput *p_int32_mix = nullptr;
+
+  /// true if the sample count depends on the packet content or the state
+  bool hasVariableSampleCount() {
+    switch (avctx.codec_id) {
+      case AV_CODEC_ID_ADPCM_IMA_AMV:
+      case AV_CODEC_ID_ADPCM_EA:
+      case AV_CODEC_ID_ADPCM_IMA_EA_EACS:
+      case AV_CODEC_ID_ADPCM_EA_R1:
+      case AV_CODEC_ID_ADPCM_EA_R2:
+      case AV_CODEC_ID_ADPCM_EA_R3:
+      case AV_CODEC_ID_ADPCM_SBPRO_2:
+      case AV_CODEC_ID_ADPCM_SBPRO_3:
+      case AV_CODEC_ID_ADPCM_SBPRO_4:
+      case AV_CODEC_ID_ADPCM_SWF:
+      case AV_CODEC_ID_ADPCM_THP:
+      case AV_CODEC_ID_ADPCM_THP_LE:
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  /// Determines the packet size and sample count of the stream so that
+  /// decode_frame_init() does not need to call get_nb_samples()
+  void setupPacketGeometry() {
+    int ch = avctx.nb_channels;
+    int bits = avctx.bits_per_coded_sample;
+    geometry = ADPCMPacketGeometry();
+    geometry.variable = hasVariableSampleCount();
+    if (geometry.variable || ch <= 0) return;
+
+    int packet_size = avctx.block_align;
+    if (packet_size <= 0 && bits > 0)
+      packet_size = (frameSize() * ch * bits + 7) / 8;
+    if (packet_size <= 0) return;
+
+    // the sample count of the fixed formats only depends on the size
+    GetByteContext tmp;
+    int tmp_coded, tmp_approx;
+    bytestream2_init(&tmp, NULL, 0);
+    int samples = get_nb_samples(&tmp, packet_size, &tmp_coded, &tmp_approx);
+    if (samples <= 0 || tmp_coded != 0) return;
+
+    geometry.packet_size = packet_size;
+    geometry.samples_per_packet = samples;
+    if (bits > 0)
+      geometry.header_size = FFMAX(0, packet_size - samples * ch * bits / 8);
+  }
+
+  /// Decodes the packet into the int16 frame buffers
+  void decodeFrame(AVPacket &packet) {
+    int got_packet_ptr = 0;
+
+    // the kernels write all samples of the frame, so the buffers are not
+    // cleared: data[0] might still point to the converted output
+    frame.data[0] = (uint8_t *)frame_data_vector.data();
+
+    last_error = AV_OK;
+    int rc = adpcm_decode_frame(&frame, &got_packet_ptr, &packet);
+    if (rc == 0 || !got_packet_ptr) {
+      frame.nb_samples = 0;
+    }
+    // the error codes are positive: they are indicated by got_packet_ptr
+    if (!got_packet_ptr) {
+      last_error = rc != AV_OK ? (av_errors)rc : AVERROR_INVALIDDATA;
+      ADPCM_STATS_ADD(invalid_packets, 1);
+    } else if (frame.nb_samples > 0) {
+      ADPCM_STATS_ADD(frames, 1);
+      ADPCM_STATS_ADD(samples, frame.nb_samples);
+      ADPCM_STATS_ADD(bytes, rc);
+    }
+
+    /// determine data source: only once
+    if (data_source == Undefined) {
+      data_source = getDataSource((int16_t *)(frame.data[0]),
+                                  frame.extended_data[0], frame.nb_samples);
+    }
+  }
+
+  static float convertSample(int sample, float scale) {
+    return sample * scale;
+  }
+
+  static int32_t convertSample(int sample, int64_t scale) {
+    return av_clipl_int32(sample * scale);
+  }
+
+  /// The kernels can write the output channels if each decoded channel is
+  /// used at most once or if two channels are averaged
+  void setupMappedOutput() {
+    MappedOutput &out = mapped_output;
+    out.data = (int16_t *)frame_data_vector.data();
+    out.count = channel_count;
+    out.downmix = channel_count == 1 && channel_map[0] == DownmixChannel;
+    use_mapped_output = channel_count > 0 && (!out.downmix || channels() <= 2);
+    for (int ch = 0; ch < max_channels; ch++) out.position[ch] = -1;
+    for (int i = 0; use_mapped_output && !out.downmix && i < channel_count;
+         i++) {
+      use_mapped_output = out.position[channel_map[i]] < 0;
+      out.position[channel_map[i]] = i;
+    }
+  }
+
+  bool checkChannelMap() {
+    bool ok = channel_count <= channels();
+    for (int i = 0; i < channel_count; i++)
+      ok = ok &&
+           (channel_map[i] == DownmixChannel || channel_map[i] < channels());
+    if (!ok) av_log(avctx, AV_LOG_ERROR, "invalid channel map\n");
+    return ok;
+  }
+
+  /// Calls op(index, sample) for the output samples in interleaved order: the
+  /// channel map is applied
+  template <class Op>
+  void forEachSample(Op op) {
+    int n = frame.nb_samples;
+    if (channel_count > 0) {
+      // the channels as pointer and stride for both layouts
+      const int16_t *src[max_channels];
+      int ch_in = channels();
+      int stride = data_source == FromExtended ? 1 : ch_in;
+      for (int ch = 0; ch < ch_in; ch++)
+        src[ch] = data_source == FromExtended
+                      ? frame.extended_data[ch]
+                      : (const int16_t *)frame.data[0] + ch;
+      if (channel_count == 1 && channel_map[0] == DownmixChannel) {
+        for (int j = 0; j < n; j++) {
+          int sum = 0;
+          for (int ch = 0; ch < ch_in; ch++) sum += src[ch][j * stride];
+          op(j, sum / ch_in);
+        }
+      } else if (channel_count == 1) {
+        const int16_t *in = src[channel_map[0]];
+        for (int j = 0; j < n; j++) op(j, in[j * stride]);
+      } else {
+        // all channels of a sample are read before the output is written, so
+        // that op can overwrite the decoded frame
+        int16_t values[max_channels];
+        for (int j = 0, pos = 0; j < n; j++) {
+          for (int i = 0; i < channel_count; i++)
+            values[i] = src[channel_map[i]][j * stride];
+          for (int i = 0; i < channel_count; i++) op(pos++, values[i]);
+        }
+      }
+    } else if (data_source == FromExtended) {
+      int pos = 0;
+      for (int j = 0; j < n; j++) {
+        for (int ch = 0; ch < channels(); ch++) {
+          op(pos++, frame.extended_data[ch][j]);
+        }
+      }
+    } else {
+      const int16_t *in = (const int16_t *)frame.data[0];
+      for (int j = 0; j < n * channels(); j++) op(j, in[j]);
+    }
+  }
+
+  /// Converts the decoded samples into the interleaved output buffer
+  template <class T, class Scale>
+  void convert(T *out, Scale scale) {
+    forEachSample([&](int pos, int sample) {
+      out[pos] = convertSample(sample, scale);
+    });
+    frame.data[0] = (uint8_t *)out;
+  }
+
+  /// Converts the output channels which the kernel wrote into the frame
+  template <class T, class Scale>
+  void convertMapped(T *out, Scale scale) {
+    const int16_t *in = (const int16_t *)frame.data[0];
+    for (int pos = 0; pos < frame.nb_samples * channel_count; pos++)
+      out[pos] = convertSample(in[pos], scale);
+    frame.data[0] = (uint8_t *)out;
+  }
+
 
   /// The result is not returned consistently: sometimes it is in the frame
   /// data, sometimes it is in the extra data. Here we check where it actually
@@ -155,50 +833,34 @@ class ADPCMDecoder : public ADPCMCodec {
   /// @brief Init decoder
   virtual int adpcm_decode_init() {
     ADPCMDecodeContext *c = (ADPCMDecodeContext *)avctx.priv_data;
-    unsigned int min_channels = 1;
-    unsigned int max_channels = 2;
+    const ADPCMDescriptor *desc = descriptor();
 
     if (c == NULL) {
       av_log(avctx, AV_LOG_ERROR, "priv_data is null");
       return -1;
     }
+    if (desc == nullptr || !desc->has_decoder) {
+      av_log(avctx, AV_LOG_ERROR, "decoder not supported\n");
+      return AVERROR(AVERROR_INVALID);
+    }
+    int min_channels = desc->min_channels;
+    int max_channels = desc->max_channels;
 
     // adpcm_flush(avctx);
 
     switch (avctx.codec_id) {
-      case AV_CODEC_ID_ADPCM_IMA_AMV:
-        max_channels = 1;
-        break;
-      case AV_CODEC_ID_ADPCM_DTK:
-      case AV_CODEC_ID_ADPCM_EA:
-        min_channels = 2;
-        break;
-      case AV_CODEC_ID_ADPCM_AFC:
-      case AV_CODEC_ID_ADPCM_EA_R1:
-      case AV_CODEC_ID_ADPCM_EA_R2:
-      case AV_CODEC_ID_ADPCM_EA_R3:
-      case AV_CODEC_ID_ADPCM_EA_XAS:
-      case AV_CODEC_ID_ADPCM_MS:
-        max_channels = 6;
-        break;
       case AV_CODEC_ID_ADPCM_MTAF:
-        min_channels = 2;
-        max_channels = 8;
         if (avctx.nb_channels & 1) {
           avpriv_request_sample(&avctx, "channel count %d", avctx.nb_channels);
           return AVERROR_PATCHWELCOME;
         }
         break;
       case AV_CODEC_ID_ADPCM_PSX:
-        max_channels = 8;
         if (avctx.nb_channels <= 0 ||
             avctx.block_align % (16 * avctx.nb_channels))
           return AVERROR_INVALIDDATA;
         break;
-      case AV_CODEC_ID_ADPCM_IMA_DAT4:
-      case AV_CODEC_ID_ADPCM_THP:
-      case AV_CODEC_ID_ADPCM_THP_LE:
-        max_channels = 14;
+      default:
         break;
     }
     if (avctx.nb_channels < min_channels || avctx.nb_channels > max_channels) {
@@ -275,7 +937,7 @@ class ADPCMDecoder : public ADPCMCodec {
 
     step = ff_adpcm_step_table[c->step_index];
     step_index = c->step_index + ff_adpcm_index_table[(unsigned)nibble];
-    step_index = av_clip(step_index, 0, 88);
+    step_index = av_clip_step(step_index, 0, 88);
 
     sign = nibble & 8;
     delta = nibble & 7;
@@ -305,7 +967,7 @@ class ADPCMDecoder : public ADPCMCodec {
 
     step_index = c->step_index + mtf_index_table[(unsigned)nibble];
     c->predictor = av_clip_int16(predictor >> 4);
-    c->step_index = av_clip(step_index, 0, 88);
+    c->step_index = av_clip_step(step_index, 0, 88);
 
     return (int16_t)c->predictor;
   }
@@ -320,7 +982,7 @@ class ADPCMDecoder : public ADPCMCodec {
 
     step = ima_cunning_step_table[c->step_index];
     step_index = c->step_index + ima_cunning_index_table[abs(nibble)];
-    step_index = av_clip(step_index, 0, 60);
+    step_index = av_clip_step(step_index, 0, 60);
 
     predictor = c->predictor + step * nibble;
 
@@ -330,6 +992,21 @@ class ADPCMDecoder : public ADPCMCodec {
     return c->predictor;
   }
 
+  /// Nibble model of adpcm_ima_qt_expand_nibble() for skip()
+  struct QTNibble {
+    static constexpr int steps = 89;
+    static constexpr int min_predictor = -32768;
+    static constexpr int max_predictor = 32767;
+    static int diff(int step_index, int nibble) {
+      int step = ff_adpcm_step_table[step_index];
+      int diff = step >> 3;
+      if (nibble & 4) diff += step;
+      if (nibble & 2) diff += step >> 1;
+      if (nibble & 1) diff += step >> 2;
+      return nibble & 8 ? -diff : diff;
+    }
+  };
+
   int adpcm_ima_qt_expand_nibble(ADPCMChannelStatus *c, int nibble) {
     int step_index;
     int predictor;
@@ -337,7 +1014,7 @@ class ADPCMDecoder : public ADPCMCodec {
 
     step = ff_adpcm_step_table[c->step_index];
     step_index = c->step_index + ff_adpcm_index_table[nibble];
-    step_index = av_clip(step_index, 0, 88);
+    step_index = av_clip_step(step_index, 0, 88);
 
     diff = step >> 3;
     if (nibble & 4) diff += step;
@@ -364,7 +1041,7 @@ class ADPCMDecoder : public ADPCMCodec {
     c->predictor += (c->step * ff_adpcm_yamaha_difflookup[nibble]) / 8;
     c->predictor = av_clip_int16(c->predictor);
     c->step = (c->step * ff_adpcm_yamaha_indexscale[nibble]) >> 8;
-    c->step = av_clip(c->step, 127, 24576);
+    c->step = av_clip_step(c->step, 127, 24576);
     return c->predictor;
   }
 
@@ -378,6 +1055,8 @@ class ADPCMDecoder : public ADPCMCodec {
    *                           number of samples in each frame.
    * @param[out] approx_nb_samples set to non-zero if the number of samples
    *                               returned is an approximation.
+   * @return 0 if the packet is invalid: the error codes are positive and
+   *         could not be distinguished from a sample count
    */
   int get_nb_samples(GetByteContext *gb, int buf_size, int *coded_samples,
                      int *approx_nb_samples) {
@@ -493,7 +1172,7 @@ class ADPCMDecoder : public ADPCMCodec {
       case AV_CODEC_ID_ADPCM_IMA_DK4:
         if (avctx.block_align > 0)
           buf_size = FFMIN(buf_size, avctx.block_align);
-        if (buf_size < 4 * ch) return AVERROR_INVALIDDATA;
+        if (buf_size < 4 * ch) return 0;
         nb_samples = 1 + (buf_size - 4 * ch) * 2 / ch;
         break;
       case AV_CODEC_ID_ADPCM_IMA_RAD:
@@ -507,7 +1186,7 @@ class ADPCMDecoder : public ADPCMCodec {
             ff_adpcm_ima_block_samples[avctx.bits_per_coded_sample - 2];
         if (avctx.block_align > 0)
           buf_size = FFMIN(buf_size, avctx.block_align);
-        if (buf_size < 4 * ch) return AVERROR_INVALIDDATA;
+        if (buf_size < 4 * ch) return 0;
         nb_samples = 1 + (buf_size - 4 * ch) / (bsize * ch) * bsamples;
       } break; /* End of CASE */
       case AV_CODEC_ID_ADPCM_MS:
@@ -536,7 +1215,7 @@ class ADPCMDecoder : public ADPCMCodec {
             break;
         }
         if (!s->status[0].step_index) {
-          if (buf_size < ch) return AVERROR_INVALIDDATA;
+          if (buf_size < ch) return 0;
           nb_samples++;
           buf_size -= ch;
         }
@@ -545,7 +1224,11 @@ class ADPCMDecoder : public ADPCMCodec {
       }
       case AV_CODEC_ID_ADPCM_SWF: {
         int buf_bits = buf_size * 8 - 2;
+#ifdef BITSTREAM_READER_LE
+        int nbits = (bytestream2_get_byte(gb) & 3) + 2;
+#else
         int nbits = (bytestream2_get_byte(gb) >> 6) + 2;
+#endif
         int block_hdr_size = 22 * ch;
         int block_size = block_hdr_size + nbits * ch * 4095;
         int nblocks = buf_bits / block_size;
@@ -596,7 +1279,7 @@ class ADPCMDecoder : public ADPCMCodec {
     /* validate coded sample count */
     if (has_coded_samples &&
         (*coded_samples <= 0 || *coded_samples > nb_samples))
-      return AVERROR_INVALIDDATA;
+      return 0;
 
     return nb_samples;
   }
@@ -650,12 +1333,245 @@ class ADPCMDecoder : public ADPCMCodec {
   virtual int decode_frame_impl(AVFrame *frame, int *got_frame_ptr,
                                 AVPacket *avpkt) = 0;
 
+  /// Decodes the packet for summarize(): the samples are passed to the
+  /// collector. Codecs which can feed the collector from their kernel
+  /// override this, the others decode into the frame which is then read.
+  virtual int summarize_frame_impl(AVFrame *frame, int *got_frame_ptr,
+                                   AVPacket *avpkt,
+                                   ADPCMEnvelopeCollector &out) {
+    int rc = decode_frame_impl(frame, got_frame_ptr, avpkt);
+    if (rc == AV_OK) readFrame(frame, out);
+    return rc;
+  }
+
+  /// Decodes the packet for decode() with the channel map: the codecs which
+  /// do not override this decode into the frame and the map is applied
+  /// afterwards
+  virtual int map_frame_impl(AVFrame *frame, int *got_frame_ptr,
+                             AVPacket *avpkt, MappedOutput &out) {
+    out.done = false;
+    return decode_frame_impl(frame, got_frame_ptr, avpkt);
+  }
+
+  /// Decodes the packet for decodeMix() into the float bus: like
+  /// summarize_frame_impl()
+  virtual int mix_frame_impl(AVFrame *frame, int *got_frame_ptr,
+                             AVPacket *avpkt, FloatMixOutput &out) {
+    int rc = decode_frame_impl(frame, got_frame_ptr, avpkt);
+    if (rc == AV_OK) readFrame(frame, out);
+    return rc;
+  }
+
+  /// Decodes the packet for decodeMix() into the int32 bus
+  virtual int mix_frame_impl(AVFrame *frame, int *got_frame_ptr,
+                             AVPacket *avpkt, Int32MixOutput &out) {
+    int rc = decode_frame_impl(frame, got_frame_ptr, avpkt);
+    if (rc == AV_OK) readFrame(frame, out);
+    return rc;
+  }
+
+  /// Decodes the packet for decode() to float: the codecs which do not
+  /// override this decode into the frame, which is converted afterwards
+  virtual int convert_frame_impl(AVFrame *frame, int *got_frame_ptr,
+                                 AVPacket *avpkt, FloatOutput &out) {
+    out.done = false;
+    return decode_frame_impl(frame, got_frame_ptr, avpkt);
+  }
+
+  /// Decodes the packet for decode() to int32
+  virtual int convert_frame_impl(AVFrame *frame, int *got_frame_ptr,
+                                 AVPacket *avpkt, S32Output &out) {
+    out.done = false;
+    return decode_frame_impl(frame, got_frame_ptr, avpkt);
+  }
+
+  /// Passes the decoded samples of the frame to out
+  template <class Out>
+  void readFrame(AVFrame *frame, Out &out) {
+    const int16_t *interleaved = (const int16_t *)frame->data[0];
+    int ch_count = channels();
+    if (isPlanar()) {
+      for (int j = 0; j < nb_samples; j++) {
+        for (int ch = 0; ch < ch_count; ch++) out.put(ch, j, samples_p[ch][j]);
+      }
+      return;
+    }
+    for (int j = 0; j < nb_samples; j++) {
+      for (int ch = 0; ch < ch_count; ch++)
+        out.put(ch, j, interleaved[j * ch_count + ch]);
+    }
+  }
+
+  /// Decodes the packet into the frame or into the active output of decode()
+  /// with a channel map, summarize() or decodeMix()
+  int expand_frame_impl(AVFrame *frame, int *got_frame_ptr, AVPacket *avpkt) {
+    if (p_mapped != nullptr) {
+      p_mapped->done = true;
+      return map_frame_impl(frame, got_frame_ptr, avpkt, *p_mapped);
+    }
+    if (p_collector != nullptr && p_collector->begin(nb_samples))
+      return summarize_frame_impl(frame, got_frame_ptr, avpkt, *p_collector);
+    if (p_float_mix != nullptr)
+      return mix_frame_impl(frame, got_frame_ptr, avpkt, *p_float_mix);
+    if (p_int32_mix != nullptr)
+      return mix_frame_impl(frame, got_frame_ptr, avpkt, *p_int32_mix);
+    if (p_float_output != nullptr) {
+      p_float_output->done = true;
+      return convert_frame_impl(frame, got_frame_ptr, avpkt, *p_float_output);
+    }
+    if (p_s32_output != nullptr) {
+      p_s32_output->done = true;
+      return convert_frame_impl(frame, got_frame_ptr, avpkt, *p_s32_output);
+    }
+    return decode_frame_impl(frame, got_frame_ptr, avpkt);
+  }
+
+  /// true if the samples of the channel are not needed: the codecs which
+  /// can locate the data of a channel skip it
+  bool skipChannel(int channel) {
+    return decode_channel >= 0 && channel != decode_channel;
+  }
+
+  /// Updates the state like decode_frame_impl(): the result is ignored. Codecs
+  /// which can update the state without the samples override this.
+  virtual int skip_frame_impl(AVFrame *frame, int *got_frame_ptr,
+                              AVPacket *avpkt) {
+    return decode_frame_impl(frame, got_frame_ptr, avpkt);
+  }
+
+  /// Step index after a nibble of the IMA codecs
+  template <class Nibble>
+  static int next_step_index(int step_index, int nibble) {
+    return av_clip(step_index + ff_adpcm_index_table[nibble], 0,
+                   Nibble::steps - 1);
+  }
+
+  /// Predictor change and step index after a nibble and after the two
+  /// nibbles of a byte (high nibble first) for each step index. The Nibble
+  /// model provides the number of step indexes, the range of the predictor
+  /// and the signed predictor change. bound is the largest change after the
+  /// first or the second nibble of a byte: within this distance of the
+  /// limits the predictor could clip. There is one shared instance per
+  /// codec, which is built by the first decoder that needs it.
+  template <class Nibble>
+  struct SkipTable {
+    int32_t delta[Nibble::steps][256];
+    uint8_t step_index[Nibble::steps][256];
+    int32_t bound[Nibble::steps];
+    int32_t nibble_delta[Nibble::steps][16];
+    uint8_t nibble_step_index[Nibble::steps][16];
+
+    SkipTable() {
+      for (int index = 0; index < Nibble::steps; index++) {
+        for (int nibble = 0; nibble < 16; nibble++) {
+          nibble_delta[index][nibble] = Nibble::diff(index, nibble);
+          nibble_step_index[index][nibble] =
+              next_step_index<Nibble>(index, nibble);
+        }
+        bound[index] = 0;
+        for (int v = 0; v < 256; v++) {
+          int first = Nibble::diff(index, v >> 4);
+          int next = next_step_index<Nibble>(index, v >> 4);
+          delta[index][v] = first + Nibble::diff(next, v & 0x0F);
+          step_index[index][v] = next_step_index<Nibble>(next, v & 0x0F);
+          bound[index] = FFMAX(bound[index], FFMAX(abs(first),
+                                                   abs(delta[index][v])));
+        }
+      }
+    }
+
+    static const SkipTable &instance() {
+      static SkipTable skip_table;
+      return skip_table;
+    }
+  };
+
+  /// Applies a nibble of an IMA codec to the predictor and the step index
+  /// with the clipping of the decoder: the counters of ADPCM_STATS need the
+  /// clipping of the step index.
+  template <class Nibble>
+  void skip_nibble(const SkipTable<Nibble> &table, int &predictor,
+                   int &step_index, int nibble) {
+#if ADPCM_STATS
+    int value = predictor + Nibble::diff(step_index, nibble);
+    step_index = av_clip_step(step_index + ff_adpcm_index_table[nibble], 0,
+                              Nibble::steps - 1);
+#else
+    int value = predictor + table.nibble_delta[step_index][nibble];
+    step_index = table.nibble_step_index[step_index][nibble];
+#endif
+    if (Nibble::max_predictor == 32767)
+      predictor = av_clip_int16(value);
+    else
+      predictor = av_clip(value, Nibble::min_predictor, Nibble::max_predictor);
+  }
+
+  /// Skips count bytes which hold two nibbles of the same channel: the next
+  /// byte of the channel follows after stride bytes. The predictor change of
+  /// a byte is looked up unless the predictor could clip. The counters of
+  /// ADPCM_STATS need each nibble.
+  template <class Nibble>
+  void skip_nibble_pairs(ADPCMChannelStatus *cs, const uint8_t *buf,
+                         int count, int stride) {
+    const SkipTable<Nibble> &table = SkipTable<Nibble>::instance();
+    int predictor = cs->predictor, step_index = cs->step_index;
+    for (int n = 0; n < count; n++, buf += stride) {
+      int v = *buf;
+      int bound = table.bound[step_index];
+      if (!ADPCM_STATS && predictor >= Nibble::min_predictor + bound &&
+          predictor <= Nibble::max_predictor - bound) {
+        predictor += table.delta[step_index][v];
+        step_index = table.step_index[step_index][v];
+      } else {
+        skip_nibble(table, predictor, step_index, v >> 4);
+        skip_nibble(table, predictor, step_index, v & 0x0F);
+      }
+    }
+    cs->predictor = predictor;
+    cs->step_index = step_index;
+  }
+
+  /// Skips the bytes of the codecs which store one byte per sample frame:
+  /// mono bytes hold two samples, stereo bytes the left sample in the high
+  /// and the right sample in the low nibble
+  template <class Nibble>
+  void skip_nibble_frames() {
+    const SkipTable<Nibble> &table = SkipTable<Nibble>::instance();
+    const uint8_t *buf = gb.buffer;
+    int count = nb_samples >> (1 - st);
+    bytestream2_skipu(&gb, count);
+    if (!st) {
+      skip_nibble_pairs<Nibble>(&c->status[0], buf, count, 1);
+      return;
+    }
+    int predictor0 = c->status[0].predictor;
+    int step_index0 = c->status[0].step_index;
+    int predictor1 = c->status[1].predictor;
+    int step_index1 = c->status[1].step_index;
+    for (int n = 0; n < count; n++) {
+      int v = buf[n];
+      skip_nibble(table, predictor0, step_index0, v >> 4);
+      skip_nibble(table, predictor1, step_index1, v & 0x0F);
+    }
+    c->status[0].predictor = predictor0;
+    c->status[0].step_index = step_index0;
+    c->status[1].predictor = predictor1;
+    c->status[1].step_index = step_index1;
+  }
+
   /// @brief Decode a pcm frame
   virtual int adpcm_decode_frame(AVFrame *frame, int *got_frame_ptr,
                                  AVPacket *avpkt) {
-    decode_frame_init(frame, got_frame_ptr, avpkt);
+    int init_rc = decode_frame_init(frame, got_frame_ptr, avpkt);
+    if (init_rc != AV_OK) return init_rc;
 
-    int rc = decode_frame_impl(frame, got_frame_ptr, avpkt);
+#if ADPCM_STATS
+    uint64_t start = ADPCM_STATS_NS();
+#endif
+    int rc = expand_frame_impl(frame, got_frame_ptr, avpkt);
+#if ADPCM_STATS
+    p_stats->ns += ADPCM_STATS_NS() - start;
+#endif
     if (rc != AV_OK) return rc;
 
     if (avpkt->size && bytestream2_tell(&gb) == 0) {
@@ -668,6 +1584,8 @@ class ADPCMDecoder : public ADPCMCodec {
     if (avpkt->size < bytestream2_tell(&gb)) {
       av_log(avctx, AV_LOG_ERROR, "Overread of %d < %d\n", avpkt->size,
              bytestream2_tell(&gb));
+      ADPCM_STATS_ADD(invalid_packets, 1);
+      last_error = AVERROR_INVALIDDATA;
       return avpkt->size;
     }
 
@@ -680,12 +1598,22 @@ class ADPCMDecoder : public ADPCMCodec {
     c = (ADPCMDecodeContext *)avctx.priv_data;
 
     bytestream2_init(&gb, buf, buf_size);
-    nb_samples =
-        get_nb_samples(&gb, buf_size, &coded_samples, &approx_nb_samples);
+    if (geometry.packet_size > 0 && buf_size == geometry.packet_size) {
+      nb_samples = geometry.samples_per_packet;
+      coded_samples = approx_nb_samples = 0;
+    } else {
+      nb_samples =
+          get_nb_samples(&gb, buf_size, &coded_samples, &approx_nb_samples);
+    }
     if (nb_samples <= 0) {
       av_log(avctx, AV_LOG_ERROR, "invalid number of samples in packet\n");
       return AVERROR_INVALIDDATA;
     }
+    // the frame buffer is allocated in begin() and does not grow
+    if (nb_samples > frameSize()) {
+      av_log(avctx, AV_LOG_ERROR, "packet exceeds the frame size\n");
+      return AVERROR_INVALIDDATA;
+    }
 
     /* get output buffer */
     frame->nb_samples = nb_samples;
@@ -713,12 +1641,63 @@ class DecoderADPCM_IMA_QT : public ADPCMDecoder {
     sample_formats.push_back(AV_SAMPLE_FMT_S16P);
   }
   int decode_frame_impl(AVFrame *frame, int *got_frame_ptr, AVPacket *avpkt) {
+    PlanarOutput out{samples_p};
+    return expand(out);
+  }
+
+  int summarize_frame_impl(AVFrame *frame, int *got_frame_ptr,
+                           AVPacket *avpkt,
+                           ADPCMEnvelopeCollector &out) override {
+    return expand(out);
+  }
+
+  int mix_frame_impl(AVFrame *frame, int *got_frame_ptr, AVPacket *avpkt,
+                     FloatMixOutput &out) override {
+    return expand(out);
+  }
+
+  int mix_frame_impl(AVFrame *frame, int *got_frame_ptr, AVPacket *avpkt,
+                     Int32MixOutput &out) override {
+    return expand(out);
+  }
+
+  int convert_frame_impl(AVFrame *frame, int *got_frame_ptr, AVPacket *avpkt,
+                         FloatOutput &out) override {
+    return expand(out);
+  }
+
+  int convert_frame_impl(AVFrame *frame, int *got_frame_ptr, AVPacket *avpkt,
+                         S32Output &out) override {
+    return expand(out);
+  }
+
+  int map_frame_impl(AVFrame *frame, int *got_frame_ptr, AVPacket *avpkt,
+                     MappedOutput &out) override {
+    return expand(out);
+  }
+
+  template <class Out>
+  int expand(Out &out) {
+    // the step index of the header is used in any case: an invalid header
+    // is reported before any sample is output
+    for (int channel = 0; channel < channels(); channel++) {
+      int step_index = gb.buffer[34 * channel + 1] & 0x7F;
+      if (!skipChannel(channel) && step_index > 88) {
+        av_log(avctx, AV_LOG_ERROR, "ERROR: step_index[%d] = %i\n", channel,
+               step_index);
+        return AVERROR_INVALIDDATA;
+      }
+    }
     /* In QuickTime, IMA is encoded by chunks of 34 bytes (=64 samples).
        Channel data is interleaved per-chunk. */
     for (int channel = 0; channel < channels(); channel++) {
       ADPCMChannelStatus *cs = &c->status[channel];
       int predictor;
       int step_index;
+      if (skipChannel(channel)) {
+        bytestream2_skipu(&gb, 34);
+        continue;
+      }
       /* (pppppp) (piiiiiii) */
 
       /* Bits 15-7 are the _top_ 9 bits of the 16-bit initial predictor value */
@@ -739,15 +1718,13 @@ class DecoderADPCM_IMA_QT : public ADPCMDecoder {
       if (cs->step_index > 88u) {
         av_log(avctx, AV_LOG_ERROR, "ERROR: step_index[%d] = %i\n", channel,
                cs->step_index);
-        // return AVERROR_INVALIDDATA;
+        return AVERROR_INVALIDDATA;
       }
 
-      samples = samples_p[channel];
-
       for (int m = 0; m < 64; m += 2) {
         int byte = bytestream2_get_byteu(&gb);
-        samples[m] = adpcm_ima_qt_expand_nibble(cs, byte & 0x0F);
-        samples[m + 1] = adpcm_ima_qt_expand_nibble(cs, byte >> 4);
+        out.put(channel, m, adpcm_ima_qt_expand_nibble(cs, byte & 0x0F));
+        out.put(channel, m + 1, adpcm_ima_qt_expand_nibble(cs, byte >> 4));
       }
     }
     return AV_OK;
@@ -767,7 +1744,7 @@ class DecoderADPCM_IMA_WAV : public ADPCMDecoder {
     shift = bps - 1;
     nibble = get_bits_le(gb, bps), step = ff_adpcm_step_table[c->step_index];
     step_index = c->step_index + adpcm_index_tables[bps - 2][nibble];
-    step_index = av_clip(step_index, 0, 88);
+    step_index = av_clip_step(step_index, 0, 88);
 
     sign = nibble & (1 << shift);
     delta = av_mod_uintp2(nibble, shift);
@@ -785,11 +1762,46 @@ class DecoderADPCM_IMA_WAV : public ADPCMDecoder {
   }
 
   int decode_frame_impl(AVFrame *frame, int *got_frame_ptr, AVPacket *avpkt) {
+    PlanarOutput out{samples_p};
+    return expand(out);
+  }
+
+  int summarize_frame_impl(AVFrame *frame, int *got_frame_ptr,
+                           AVPacket *avpkt,
+                           ADPCMEnvelopeCollector &out) override {
+    return expand(out);
+  }
+
+  int mix_frame_impl(AVFrame *frame, int *got_frame_ptr, AVPacket *avpkt,
+                     FloatMixOutput &out) override {
+    return expand(out);
+  }
+
+  int mix_frame_impl(AVFrame *frame, int *got_frame_ptr, AVPacket *avpkt,
+                     Int32MixOutput &out) override {
+    return expand(out);
+  }
+
+  int convert_frame_impl(AVFrame *frame, int *got_frame_ptr, AVPacket *avpkt,
+                         FloatOutput &out) override {
+    return expand(out);
+  }
+
+  int convert_frame_impl(AVFrame *frame, int *got_frame_ptr, AVPacket *avpkt,
+                         S32Output &out) override {
+    return expand(out);
+  }
+
+  int map_frame_impl(AVFrame *frame, int *got_frame_ptr, AVPacket *avpkt,
+                     MappedOutput &out) override {
+    return expand(out);
+  }
+
+  template <class Out>
+  int expand(Out &out) {
     for (int i = 0; i < channels(); i++) {
       ADPCMChannelStatus *cs = &c->status[i];
-      cs->predictor = samples_p[i][0] =
-          sign_extend(bytestream2_get_le16u(&gb), 16);
-
+      cs->predictor = sign_extend(bytestream2_get_le16u(&gb), 16);
       cs->step_index = sign_extend(bytestream2_get_le16u(&gb), 16);
       if (cs->step_index > 88u) {
         av_log(avctx, AV_LOG_ERROR, "ERROR: step_index[%d] = %i\n", i,
@@ -797,6 +1809,8 @@ class DecoderADPCM_IMA_WAV : public ADPCMDecoder {
         return AVERROR_INVALIDDATA;
       }
     }
+    // an invalid header does not output any sample
+    for (int i = 0; i < channels(); i++) out.put(i, 0, c->status[i].predictor);
 
     if (avctx.bits_per_coded_sample != 4) {
       int samples_per_block =
@@ -809,7 +1823,8 @@ class DecoderADPCM_IMA_WAV : public ADPCMDecoder {
       for (int n = 0; n < (nb_samples - 1) / samples_per_block; n++) {
         for (int i = 0; i < channels(); i++) {
           ADPCMChannelStatus *cs = &c->status[i];
-          samples = &samples_p[i][1 + n * samples_per_block];
+          if (skipChannel(i)) continue;
+          int start = 1 + n * samples_per_block;
           for (int j = 0; j < block_size; j++) {
             temp[j] = buf[4 * channels() + block_size * n * channels() + (j % 4) +
                           (j / 4) * (channels() * 4) + i * 4];
@@ -817,8 +1832,9 @@ class DecoderADPCM_IMA_WAV : public ADPCMDecoder {
           ret = init_get_bits8(&g, (const uint8_t *)&temp, block_size);
           if (ret < 0) return ret;
           for (int m = 0; m < samples_per_block; m++) {
-            samples[m] = adpcm_ima_wav_expand_nibble(
-                cs, &g, avctx.bits_per_coded_sample);
+            out.put(i, start + m,
+                    adpcm_ima_wav_expand_nibble(cs, &g,
+                                                avctx.bits_per_coded_sample));
           }
         }
       }
@@ -827,11 +1843,15 @@ class DecoderADPCM_IMA_WAV : public ADPCMDecoder {
       for (int n = 0; n < (nb_samples - 1) / 8; n++) {
         for (int i = 0; i < channels(); i++) {
           ADPCMChannelStatus *cs = &c->status[i];
-          samples = &samples_p[i][1 + n * 8];
+          if (skipChannel(i)) {
+            bytestream2_skipu(&gb, 4);
+            continue;
+          }
+          int start = 1 + n * 8;
           for (int m = 0; m < 8; m += 2) {
             int v = bytestream2_get_byteu(&gb);
-            samples[m] = adpcm_ima_expand_nibble(cs, v & 0x0F, 3);
-            samples[m + 1] = adpcm_ima_expand_nibble(cs, v >> 4, 3);
+            out.put(i, start + m, adpcm_ima_expand_nibble(cs, v & 0x0F, 3));
+            out.put(i, start + m + 1, adpcm_ima_expand_nibble(cs, v >> 4, 3));
           }
         }
       }
@@ -861,7 +1881,7 @@ class DecoderADPCM_4XM : public ADPCMDecoder {
 
     for (int i = 0; i < channels(); i++) {
       ADPCMChannelStatus *cs = &c->status[i];
-      samples = (int16_t *)frame->data[i];
+      samples = samples_p[i];
       for (int n = nb_samples >> 1; n > 0; n--) {
         int v = bytestream2_get_byteu(&gb);
         *samples++ = adpcm_ima_expand_nibble(cs, v & 0x0F, 4);
@@ -897,7 +1917,7 @@ class DecoderADPCM_AGM : public ADPCMDecoder {
         step *= 0x99;
         break;
       case 6:
-        c->step = av_clip(c->step * 2, 127, 24576);
+        c->step = av_clip_step(c->step * 2, 127, 24576);
         c->predictor = pred;
         return pred;
       case 5:
@@ -914,7 +1934,7 @@ class DecoderADPCM_AGM : public ADPCMDecoder {
     if (step < 0) step += 0x3f;
 
     c->step = step >> 6;
-    c->step = av_clip(c->step, 127, 24576);
+    c->step = av_clip_step(c->step, 127, 24576);
     c->predictor = pred;
     return pred;
   }
@@ -941,7 +1961,8 @@ class DecoderADPCM_MS : public ADPCMDecoder {
     sample_formats.push_back(AV_SAMPLE_FMT_S16);
     //sample_formats.push_back(AV_SAMPLE_FMT_S16P);
   }
-  int16_t adpcm_ms_expand_nibble(ADPCMChannelStatus *c, int nibble) {
+  av_always_inline int16_t adpcm_ms_expand_nibble(ADPCMChannelStatus *c,
+                                                  int nibble) {
     int predictor;
 
     predictor =
@@ -951,83 +1972,161 @@ class DecoderADPCM_MS : public ADPCMDecoder {
     c->sample2 = c->sample1;
     c->sample1 = av_clip_int16(predictor);
     c->idelta = (ff_adpcm_AdaptationTable[(int)nibble] * c->idelta) >> 8;
-    if (c->idelta < 16) c->idelta = 16;
+    if (c->idelta <= 16) {
+      c->idelta = 16;
+      ADPCM_STATS_ADD(step_floor, 1);
+    }
     if (c->idelta > INT_MAX / 768) {
       av_log(NULL, AV_LOG_WARNING, "idelta overflow\n");
       c->idelta = INT_MAX / 768;
+      ADPCM_STATS_ADD(step_ceiling, 1);
     }
 
     return c->sample1;
   }
 
   int decode_frame_impl(AVFrame *frame, int *got_frame_ptr, AVPacket *avpkt) {
-    int block_predictor;
+    if (avctx.nb_channels > 2) return decode_channels();
+    InterleavedOutput out{samples, channels()};
+    return expand(out);
+  }
 
-    if (avctx.nb_channels > 2) {
-      for (int channel = 0; channel < avctx.nb_channels; channel++) {
-        samples = samples_p[channel];
-        block_predictor = bytestream2_get_byteu(&gb);
-        if (block_predictor > 6) {
-          av_log(avctx, AV_LOG_ERROR, "ERROR: block_predictor[%d] = %d\n",
-                 channel, block_predictor);
-          return AVERROR_INVALIDDATA;
-        }
-        c->status[channel].coeff1 = ff_adpcm_AdaptCoeff1[block_predictor];
-        c->status[channel].coeff2 = ff_adpcm_AdaptCoeff2[block_predictor];
-        c->status[channel].idelta = sign_extend(bytestream2_get_le16u(&gb), 16);
-        c->status[channel].sample1 =
-            sign_extend(bytestream2_get_le16u(&gb), 16);
-        c->status[channel].sample2 =
-            sign_extend(bytestream2_get_le16u(&gb), 16);
-        *samples++ = c->status[channel].sample2;
-        *samples++ = c->status[channel].sample1;
-        for (int n = (nb_samples - 2) >> 1; n > 0; n--) {
-          int byte = bytestream2_get_byteu(&gb);
-          *samples++ = adpcm_ms_expand_nibble(&c->status[channel], byte >> 4);
-          *samples++ = adpcm_ms_expand_nibble(&c->status[channel], byte & 0x0F);
-        }
+  int summarize_frame_impl(AVFrame *frame, int *got_frame_ptr,
+                           AVPacket *avpkt,
+                           ADPCMEnvelopeCollector &out) override {
+    return expandTo(frame, out);
+  }
+
+  int mix_frame_impl(AVFrame *frame, int *got_frame_ptr, AVPacket *avpkt,
+                     FloatMixOutput &out) override {
+    return expandTo(frame, out);
+  }
+
+  int mix_frame_impl(AVFrame *frame, int *got_frame_ptr, AVPacket *avpkt,
+                     Int32MixOutput &out) override {
+    return expandTo(frame, out);
+  }
+
+  int convert_frame_impl(AVFrame *frame, int *got_frame_ptr, AVPacket *avpkt,
+                         FloatOutput &out) override {
+    return expandTo(frame, out);
+  }
+
+  int convert_frame_impl(AVFrame *frame, int *got_frame_ptr, AVPacket *avpkt,
+                         S32Output &out) override {
+    return expandTo(frame, out);
+  }
+
+  int map_frame_impl(AVFrame *frame, int *got_frame_ptr, AVPacket *avpkt,
+                     MappedOutput &out) override {
+    if (avctx.nb_channels > 2)
+      return ADPCMDecoder::map_frame_impl(frame, got_frame_ptr, avpkt, out);
+    return expand(out);
+  }
+
+  // only mono and stereo are expanded into out directly
+  template <class Out>
+  int expandTo(AVFrame *frame, Out &out) {
+    if (avctx.nb_channels <= 2) return expand(out);
+    int rc = decode_channels();
+    if (rc == AV_OK) readFrame(frame, out);
+    return rc;
+  }
+
+  // more than 2 channels: the channels are stored one after the other
+  int decode_channels() {
+    int block_predictor;
+    for (int channel = 0; channel < avctx.nb_channels; channel++) {
+      samples = samples_p[channel];
+      block_predictor = bytestream2_get_byteu(&gb);
+      if (block_predictor > 6) {
+        av_log(avctx, AV_LOG_ERROR, "ERROR: block_predictor[%d] = %d\n",
+               channel, block_predictor);
+        return AVERROR_INVALIDDATA;
       }
-    } else {
+      c->status[channel].coeff1 = ff_adpcm_AdaptCoeff1[block_predictor];
+      c->status[channel].coeff2 = ff_adpcm_AdaptCoeff2[block_predictor];
+      c->status[channel].idelta = sign_extend(bytestream2_get_le16u(&gb), 16);
+      c->status[channel].sample1 =
+          sign_extend(bytestream2_get_le16u(&gb), 16);
+      c->status[channel].sample2 =
+          sign_extend(bytestream2_get_le16u(&gb), 16);
+      *samples++ = c->status[channel].sample2;
+      *samples++ = c->status[channel].sample1;
+      for (int n = (nb_samples - 2) >> 1; n > 0; n--) {
+        int byte = bytestream2_get_byteu(&gb);
+        *samples++ = adpcm_ms_expand_nibble(&c->status[channel], byte >> 4);
+        *samples++ = adpcm_ms_expand_nibble(&c->status[channel], byte & 0x0F);
+      }
+    }
+    return AV_OK;
+  }
+
+  // mono or stereo
+  template <class Out>
+  int expand(Out &out) {
+    int block_predictor = bytestream2_get_byteu(&gb);
+    if (block_predictor > 6) {
+      av_log(avctx, AV_LOG_ERROR, "ERROR: block_predictor[0] = %d\n",
+             block_predictor);
+      return AVERROR_INVALIDDATA;
+    }
+    c->status[0].coeff1 = ff_adpcm_AdaptCoeff1[block_predictor];
+    c->status[0].coeff2 = ff_adpcm_AdaptCoeff2[block_predictor];
+    if (st) {
       block_predictor = bytestream2_get_byteu(&gb);
       if (block_predictor > 6) {
-        av_log(avctx, AV_LOG_ERROR, "ERROR: block_predictor[0] = %d\n",
+        av_log(avctx, AV_LOG_ERROR, "ERROR: block_predictor[1] = %d\n",
                block_predictor);
         return AVERROR_INVALIDDATA;
       }
-      c->status[0].coeff1 = ff_adpcm_AdaptCoeff1[block_predictor];
-      c->status[0].coeff2 = ff_adpcm_AdaptCoeff2[block_predictor];
-      if (st) {
-        block_predictor = bytestream2_get_byteu(&gb);
-        if (block_predictor > 6) {
-          av_log(avctx, AV_LOG_ERROR, "ERROR: block_predictor[1] = %d\n",
-                 block_predictor);
-          return AVERROR_INVALIDDATA;
-        }
-        c->status[1].coeff1 = ff_adpcm_AdaptCoeff1[block_predictor];
-        c->status[1].coeff2 = ff_adpcm_AdaptCoeff2[block_predictor];
+      c->status[1].coeff1 = ff_adpcm_AdaptCoeff1[block_predictor];
+      c->status[1].coeff2 = ff_adpcm_AdaptCoeff2[block_predictor];
+    }
+    c->status[0].idelta = sign_extend(bytestream2_get_le16u(&gb), 16);
+    if (st) {
+      c->status[1].idelta = sign_extend(bytestream2_get_le16u(&gb), 16);
+    }
+
+    c->status[0].sample1 = sign_extend(bytestream2_get_le16u(&gb), 16);
+    if (st)
+      c->status[1].sample1 = sign_extend(bytestream2_get_le16u(&gb), 16);
+    c->status[0].sample2 = sign_extend(bytestream2_get_le16u(&gb), 16);
+    if (st)
+      c->status[1].sample2 = sign_extend(bytestream2_get_le16u(&gb), 16);
+
+    out.put(0, 0, c->status[0].sample2);
+    if (st) out.put(1, 0, c->status[1].sample2);
+    out.put(0, 1, c->status[0].sample1);
+    if (st) out.put(1, 1, c->status[1].sample1);
+    // the loops work on copies of the states, which stay in registers: with
+    // c->status each sample stored and reloaded the state of the recurrence
+    ADPCMChannelStatus left = c->status[0], right = c->status[1];
+    if (st && decode_channel >= 0) {
+      // the packet holds the state of each channel: the other nibble is not
+      // needed
+      ADPCMChannelStatus &cs = decode_channel == 0 ? left : right;
+      int shift = decode_channel == 0 ? 4 : 0;
+      for (int j = 2; j < nb_samples; j++) {
+        int byte = bytestream2_get_byteu(&gb);
+        out.put(decode_channel, j,
+                adpcm_ms_expand_nibble(&cs, (byte >> shift) & 0x0F));
       }
-      c->status[0].idelta = sign_extend(bytestream2_get_le16u(&gb), 16);
-      if (st) {
-        c->status[1].idelta = sign_extend(bytestream2_get_le16u(&gb), 16);
+    } else if (st) {
+      for (int j = 2; j < nb_samples; j++) {
+        int byte = bytestream2_get_byteu(&gb);
+        out.put(0, j, adpcm_ms_expand_nibble(&left, byte >> 4));
+        out.put(1, j, adpcm_ms_expand_nibble(&right, byte & 0x0F));
       }
-
-      c->status[0].sample1 = sign_extend(bytestream2_get_le16u(&gb), 16);
-      if (st)
-        c->status[1].sample1 = sign_extend(bytestream2_get_le16u(&gb), 16);
-      c->status[0].sample2 = sign_extend(bytestream2_get_le16u(&gb), 16);
-      if (st)
-        c->status[1].sample2 = sign_extend(bytestream2_get_le16u(&gb), 16);
-
-      *samples++ = c->status[0].sample2;
-      if (st) *samples++ = c->status[1].sample2;
-      *samples++ = c->status[0].sample1;
-      if (st) *samples++ = c->status[1].sample1;
-      for (int n = (nb_samples - 2) >> (1 - st); n > 0; n--) {
+    } else {
+      for (int j = 2; j + 1 < nb_samples; j += 2) {
         int byte = bytestream2_get_byteu(&gb);
-        *samples++ = adpcm_ms_expand_nibble(&c->status[0], byte >> 4);
-        *samples++ = adpcm_ms_expand_nibble(&c->status[st], byte & 0x0F);
+        out.put(0, j, adpcm_ms_expand_nibble(&left, byte >> 4));
+        out.put(0, j + 1, adpcm_ms_expand_nibble(&left, byte & 0x0F));
       }
     }
+    c->status[0] = left;
+    if (st) c->status[1] = right;
     return AV_OK;
   }
 };
@@ -1294,6 +2393,11 @@ class DecoderADPCM_IMA_SSI : public ADPCMDecoder {
     }
     return AV_OK;
   }
+  int skip_frame_impl(AVFrame *frame, int *got_frame_ptr,
+                      AVPacket *avpkt) override {
+    skip_nibble_frames<QTNibble>();
+    return AV_OK;
+  }
 };
 
 class DecoderADPCM_IMA_APM : public ADPCMDecoder {
@@ -1313,6 +2417,15 @@ class DecoderADPCM_IMA_APM : public ADPCMDecoder {
     }
     return AV_OK;
   }
+  int skip_frame_impl(AVFrame *frame, int *got_frame_ptr,
+                      AVPacket *avpkt) override {
+    int count = nb_samples / 2;
+    for (int channel = 0; channel < channels(); channel++)
+      skip_nibble_pairs<QTNibble>(&c->status[channel], gb.buffer + channel,
+                                  count, channels());
+    bytestream2_skipu(&gb, count * channels());
+    return AV_OK;
+  }
 };
 
 class DecoderADPCM_IMA_ALP : public ADPCMDecoder {
@@ -1329,7 +2442,7 @@ class DecoderADPCM_IMA_ALP : public ADPCMDecoder {
 
     step = ff_adpcm_step_table[c->step_index];
     step_index = c->step_index + ff_adpcm_index_table[(unsigned)nibble];
-    step_index = av_clip(step_index, 0, 88);
+    step_index = av_clip_step(step_index, 0, 88);
 
     sign = nibble & 8;
     delta = nibble & 7;
@@ -1359,6 +2472,26 @@ class DecoderADPCM_IMA_ALP : public ADPCMDecoder {
     }
     return AV_OK;
   }
+  /// Nibble model of adpcm_ima_alp_expand_nibble() with shift 2
+  struct ALPNibble {
+    static constexpr int steps = 89;
+    static constexpr int min_predictor = -32768;
+    static constexpr int max_predictor = 32767;
+    static int diff(int step_index, int nibble) {
+      int diff = ((nibble & 7) * ff_adpcm_step_table[step_index]) >> 2;
+      return nibble & 8 ? -diff : diff;
+    }
+  };
+
+  int skip_frame_impl(AVFrame *frame, int *got_frame_ptr,
+                      AVPacket *avpkt) override {
+    int count = nb_samples / 2;
+    for (int channel = 0; channel < channels(); channel++)
+      skip_nibble_pairs<ALPNibble>(&c->status[channel], gb.buffer + channel,
+                                   count, channels());
+    bytestream2_skipu(&gb, count * channels());
+    return AV_OK;
+  }
 };
 
 class DecoderADPCM_IMA_CUNNING : public ADPCMDecoder {
@@ -1391,7 +2524,7 @@ class DecoderADPCM_IMA_OKI : public ADPCMDecoder {
 
     step = oki_step_table[c->step_index];
     step_index = c->step_index + ff_adpcm_index_table[(unsigned)nibble];
-    step_index = av_clip(step_index, 0, 48);
+    step_index = av_clip_step(step_index, 0, 48);
 
     sign = nibble & 8;
     delta = nibble & 7;
@@ -1416,6 +2549,23 @@ class DecoderADPCM_IMA_OKI : public ADPCMDecoder {
     }
     return AV_OK;
   }
+  /// Nibble model of adpcm_ima_oki_expand_nibble(): the predictor has 12
+  /// bits
+  struct OKINibble {
+    static constexpr int steps = 49;
+    static constexpr int min_predictor = -2048;
+    static constexpr int max_predictor = 2047;
+    static int diff(int step_index, int nibble) {
+      int diff = ((2 * (nibble & 7) + 1) * oki_step_table[step_index]) >> 3;
+      return nibble & 8 ? -diff : diff;
+    }
+  };
+
+  int skip_frame_impl(AVFrame *frame, int *got_frame_ptr,
+                      AVPacket *avpkt) override {
+    skip_nibble_frames<OKINibble>();
+    return AV_OK;
+  }
 };
 
 class DecoderADPCM_IMA_RAD : public ADPCMDecoder {
@@ -1967,7 +3117,7 @@ class DecoderADPCM_CT : public ADPCMDecoder {
     c->predictor = av_clip_int16(c->predictor);
     /* calculate new step and clamp it to range 511..32767 */
     new_step = (ff_adpcm_AdaptationTable[nibble & 7] * c->step) >> 8;
-    c->step = av_clip(new_step, 511, 32767);
+    c->step = av_clip_step(new_step, 511, 32767);
 
     return (int16_t)c->predictor;
   }
@@ -1980,6 +3130,39 @@ class DecoderADPCM_CT : public ADPCMDecoder {
     }
     return AV_OK;
   }
+  /// adpcm_ct_expand_nibble() with the state in registers
+  void ct_skip_nibble(int &predictor, int &step, int nibble) {
+    int diff = ((2 * (nibble & 7) + 1) * step) >> 3;
+    predictor = av_clip_int16(((predictor * 254) >> 8) +
+                              (nibble & 8 ? -diff : diff));
+    step = av_clip_step((ff_adpcm_AdaptationTable[nibble & 7] * step) >> 8,
+                        511, 32767);
+  }
+
+  int skip_frame_impl(AVFrame *frame, int *got_frame_ptr,
+                      AVPacket *avpkt) override {
+    const uint8_t *buf = gb.buffer;
+    int count = nb_samples >> (1 - st);
+    bytestream2_skipu(&gb, count);
+    int predictor0 = c->status[0].predictor, step0 = c->status[0].step;
+    int predictor1 = c->status[st].predictor, step1 = c->status[st].step;
+    if (st) {
+      for (int n = 0; n < count; n++) {
+        ct_skip_nibble(predictor0, step0, buf[n] >> 4);
+        ct_skip_nibble(predictor1, step1, buf[n] & 0x0F);
+      }
+      c->status[1].predictor = predictor1;
+      c->status[1].step = step1;
+    } else {
+      for (int n = 0; n < count; n++) {
+        ct_skip_nibble(predictor0, step0, buf[n] >> 4);
+        ct_skip_nibble(predictor0, step0, buf[n] & 0x0F);
+      }
+    }
+    c->status[0].predictor = predictor0;
+    c->status[0].step = step0;
+    return AV_OK;
+  }
 };
 
 class DecoderADPCM_SWF : public ADPCMDecoder {
@@ -1988,7 +3171,37 @@ class DecoderADPCM_SWF : public ADPCMDecoder {
     setCodecID(AV_CODEC_ID_ADPCM_SWF);
     sample_formats.push_back(AV_SAMPLE_FMT_S16);
   }
-  void adpcm_swf_decode(const uint8_t *buf, int buf_size, int16_t *samples) {
+  /// Decodes the packet using the vpdiff and step index tables of the
+  /// packet's code size. Multiple samples are extracted with a single
+  /// get_bits() call. At most max_samples are written: a packet with a
+  /// smaller code size than expected would overrun the frame.
+  void adpcm_swf_decode(const uint8_t *buf, int buf_size, int16_t *samples,
+                        int max_samples) {
+    GetBitContext gb;
+    init_get_bits(&gb, buf, buf_size * 8);
+
+    // read bits & initial values
+    int nb_bits = get_bits(&gb, 2) + 2;
+    switch (nb_bits) {
+      case 2:
+        swf_decode_blocks<2>(gb, samples, samples + max_samples);
+        break;
+      case 3:
+        swf_decode_blocks<3>(gb, samples, samples + max_samples);
+        break;
+      case 4:
+        swf_decode_blocks<4>(gb, samples, samples + max_samples);
+        break;
+      default:
+        swf_decode_blocks<5>(gb, samples, samples + max_samples);
+        break;
+    }
+  }
+
+  /// Bit-serial implementation: kept as reference for the table driven
+  /// adpcm_swf_decode()
+  void adpcm_swf_decode_reference(const uint8_t *buf, int buf_size,
+                                  int16_t *samples) {
     ADPCMDecodeContext *c = (ADPCMDecodeContext *)avctx.priv_data;
     GetBitContext gb;
     const int8_t *table;
@@ -2046,10 +3259,88 @@ class DecoderADPCM_SWF : public ADPCMDecoder {
     }
   }
   int decode_frame_impl(AVFrame *frame, int *got_frame_ptr, AVPacket *avpkt) {
-    adpcm_swf_decode(buf, buf_size, samples);
+    adpcm_swf_decode(buf, buf_size, samples,
+                     frameSize() * avctx.nb_channels);
     bytestream2_seek(&gb, 0, SEEK_END);
     return AV_OK;
   }
+
+ protected:
+  size_t objectSize() override { return sizeof(DecoderADPCM_SWF); }
+
+  /// vpdiff = (delta+0.5)*step/4 and the next step index for each step index
+  /// and delta magnitude of a code size. There is one shared instance per
+  /// code size, which is built by the first decoder that needs it.
+  template <int nb_bits>
+  struct SWFTable {
+    static constexpr int magnitudes = 1 << (nb_bits - 1);
+    uint16_t vpdiff[89][magnitudes];
+    uint8_t step_index[89][magnitudes];
+
+    SWFTable() {
+      const int8_t *table = swf_index_tables[nb_bits - 2];
+      for (int index = 0; index < 89; index++) {
+        for (int mag = 0; mag < magnitudes; mag++) {
+          int step = ff_adpcm_step_table[index];
+          int vpdiff = 0;
+          for (int k = magnitudes >> 1; k; k >>= 1) {
+            if (mag & k) vpdiff += step;
+            step >>= 1;
+          }
+          this->vpdiff[index][mag] = vpdiff + step;
+          step_index[index][mag] = av_clip(index + table[mag], 0, 88);
+        }
+      }
+    }
+
+    static const SWFTable &instance() {
+      static SWFTable swf_table;
+      return swf_table;
+    }
+  };
+
+  template <int nb_bits>
+  void swf_decode_blocks(GetBitContext &gb, int16_t *samples,
+                         int16_t *end) {
+    ADPCMDecodeContext *c = (ADPCMDecodeContext *)avctx.priv_data;
+    const SWFTable<nb_bits> &table = SWFTable<nb_bits>::instance();
+    const int signmask = 1 << (nb_bits - 1);
+    int channels = avctx.nb_channels;
+    int frame_bits = nb_bits * channels;
+    int size = gb.size_in_bits;
+    // number of sample frames which are read with one get_bits()
+    int group = 24 / frame_bits;
+    av_assert(group > 0);
+
+    while (get_bits_count(&gb) <= size - 22 * channels &&
+           end - samples >= channels) {
+      for (int i = 0; i < channels; i++) {
+        *samples++ = c->status[i].predictor = get_sbits(&gb, 16);
+        c->status[i].step_index = get_bits(&gb, 6);
+      }
+
+      int count = FFMIN(4095, (size - get_bits_count(&gb)) / frame_bits);
+      count = FFMIN(count, (int)(end - samples) / channels);
+      while (count > 0) {
+        int n = FFMIN(group, count);
+        unsigned bits = get_bits(&gb, n * frame_bits);
+        count -= n;
+        for (; n > 0; n--) {
+          for (int i = 0; i < channels; i++) {
+            ADPCMChannelStatus *cs = &c->status[i];
+            int mag = bits & (signmask - 1);
+            int vpdiff = table.vpdiff[cs->step_index][mag];
+            int predictor = (bits & signmask) ? cs->predictor - vpdiff
+                                              : cs->predictor + vpdiff;
+            bits >>= nb_bits;
+            cs->step_index = table.step_index[cs->step_index][mag];
+            cs->predictor = av_clip_int16(predictor);
+            *samples++ = cs->predictor;
+          }
+        }
+      }
+    }
+  }
 };
 
 class DecoderADPCM_YAMAHA : public ADPCMDecoder {
@@ -2066,6 +3357,46 @@ class DecoderADPCM_YAMAHA : public ADPCMDecoder {
     }
     return AV_OK;
   }
+  /// adpcm_yamaha_expand_nibble() with the state in registers: the step is
+  /// already initialized
+  void yamaha_skip_nibble(int &predictor, int &step, int nibble) {
+    predictor = av_clip_int16(predictor +
+                              (step * ff_adpcm_yamaha_difflookup[nibble]) / 8);
+    step = av_clip_step((step * ff_adpcm_yamaha_indexscale[nibble]) >> 8, 127,
+                        24576);
+  }
+
+  int skip_frame_impl(AVFrame *frame, int *got_frame_ptr,
+                      AVPacket *avpkt) override {
+    const uint8_t *buf = gb.buffer;
+    int count = nb_samples >> (1 - st);
+    if (count <= 0) return AV_OK;
+    bytestream2_skipu(&gb, count);
+    for (int ch = 0; ch <= st; ch++) {
+      if (!c->status[ch].step) {
+        c->status[ch].predictor = 0;
+        c->status[ch].step = 127;
+      }
+    }
+    int predictor0 = c->status[0].predictor, step0 = c->status[0].step;
+    int predictor1 = c->status[st].predictor, step1 = c->status[st].step;
+    if (st) {
+      for (int n = 0; n < count; n++) {
+        yamaha_skip_nibble(predictor0, step0, buf[n] & 0x0F);
+        yamaha_skip_nibble(predictor1, step1, buf[n] >> 4);
+      }
+      c->status[1].predictor = predictor1;
+      c->status[1].step = step1;
+    } else {
+      for (int n = 0; n < count; n++) {
+        yamaha_skip_nibble(predictor0, step0, buf[n] & 0x0F);
+        yamaha_skip_nibble(predictor0, step0, buf[n] >> 4);
+      }
+    }
+    c->status[0].predictor = predictor0;
+    c->status[0].step = step0;
+    return AV_OK;
+  }
 };
 
 class DecoderADPCM_AICA : public ADPCMDecoder {
@@ -2109,6 +3440,10 @@ class DecoderADPCM_AFC : public ADPCMDecoder {
       for (int channel = 0; channel < channels(); channel++) {
         int prev1 = c->status[channel].sample1;
         int prev2 = c->status[channel].sample2;
+        if (skipChannel(channel)) {
+          bytestream2_skipu(&gb, samples_per_block * 9);
+          continue;
+        }
 
         samples = samples_p[channel] + m * 16;
         /* Read in every sample for this channel.  */
@@ -2156,6 +3491,11 @@ class DecoderADPCM_DTK : public ADPCMDecoder {
   int decode_frame_impl(AVFrame *frame, int *got_frame_ptr, AVPacket *avpkt) {
     for (int channel = 0; channel < channels(); channel++) {
       samples = samples_p[channel];
+      // the second channel ends the packet
+      if (skipChannel(channel)) {
+        if (channel) bytestream2_skipu(&gb, nb_samples / 28 * 32);
+        continue;
+      }
 
       /* Read in every sample for this channel.  */
       for (int i = 0; i < nb_samples / 28; i++) {
@@ -2220,10 +3560,14 @@ class DecoderADPCM_PSX : public ADPCMDecoder {
       for (int channel = 0; channel < channels(); channel++) {
         samples = samples_p[channel] + block * nb_samples_per_block;
         av_assert((block + 1) * nb_samples_per_block <= nb_samples);
+        if (skipChannel(channel)) {
+          bytestream2_skipu(&gb, nb_samples_per_block / 28 * 16);
+          continue;
+        }
 
         /* Read in every sample for this channel.  */
         for (int i = 0; i < nb_samples_per_block / 28; i++) {
-          int filter, shift, flag, byte;
+          int filter, shift, flag, byte = 0;
 
           filter = bytestream2_get_byteu(&gb);
           shift = filter & 0xf;
@@ -2352,7 +3696,7 @@ class DecoderADPCM_ZORK : public ADPCMDecoder {
     sample = av_clip_int16(sample);
 
     index += zork_index_table[(nibble >> 4) & 7];
-    index = av_clip(index, 0, 88);
+    index = av_clip_step(index, 0, 88);
 
     c->predictor = sample;
     c->step_index = index;
@@ -2393,7 +3737,7 @@ class DecoderADPCM_SBPRO_X : public ADPCMDecoder {
   DecoderADPCM_SBPRO_X(AVCodecID id) {
     setCodecID(id);
     sample_formats.push_back(AV_SAMPLE_FMT_S16);
-    assert(id >= AV_CODEC_ID_ADPCM_SBPRO_2 && id <= AV_CODEC_ID_ADPCM_SBPRO_4);
+    assert(id >= AV_CODEC_ID_ADPCM_SBPRO_4 && id <= AV_CODEC_ID_ADPCM_SBPRO_2);
   }
   int16_t adpcm_sbpro_expand_nibble(ADPCMChannelStatus *c, int8_t nibble,
                                     int size, int shift) {
@@ -2472,7 +3816,7 @@ class DecoderADPCM_SBPRO_4 : public DecoderADPCM_SBPRO_X {
 
 class DecoderADPCM_THP : public ADPCMDecoder {
  public:
-  DecoderADPCM_THP() { DecoderADPCM_THP(AV_CODEC_ID_ADPCM_THP); }
+  DecoderADPCM_THP() : DecoderADPCM_THP(AV_CODEC_ID_ADPCM_THP) {}
   DecoderADPCM_THP(AVCodecID id) {
     setCodecID(id);
     assert(id == AV_CODEC_ID_ADPCM_THP || id == AV_CODEC_ID_ADPCM_THP_LE);
@@ -2515,6 +3859,14 @@ class DecoderADPCM_THP : public ADPCMDecoder {
 
     for (int ch = 0; ch < channels(); ch++) {
       samples = samples_p[ch];
+      if (skipChannel(ch)) {
+        // 8 bytes per 14 samples: a partial block has its header byte and
+        // one byte per 2 samples
+        int rest = nb_samples % 14;
+        bytestream2_skipu(&gb,
+                          nb_samples / 14 * 8 + (rest ? 1 + (rest + 1) / 2 : 0));
+        continue;
+      }
 
       /* Read in every sample for this channel.  */
       for (int i = 0; i < (nb_samples + 13) / 14; i++) {
@@ -2663,6 +4015,10 @@ class DecoderADPCM_EA_R3 : public DecoderADPCM_EA_RX {
 class ADPCMDecoderFactory {
  public:
   static ADPCMDecoder *create(AVCodecID id) {
+    if (!ADPCMDescriptors::hasDecoder(id)) {
+      av_log(avctx, AV_LOG_ERROR, "ERROR: decoder [%d] not supported\n", id);
+      return nullptr;
+    }
     switch (id) {
 #if ENABLE_BROKEN_CODECS
       case AV_CODEC_ID_ADPCM_IMA_QT:
@@ -0,0 +1,175 @@
+#pragma once
+#include "adpcm-ffmpeg/adpcm.h"
+
+namespace adpcm_ffmpeg {
+
+/// Layout of the per channel stream state (see ADPCMStreamState.h)
+enum ADPCMStateFamily {
+  ADPCM_STATE_FULL,
+  ADPCM_STATE_IMA,
+  ADPCM_STATE_STEP,
+  ADPCM_STATE_LPC
+};
+
+/// Formula which calculates the frame size or block align from the block size
+typedef int (*ADPCMSizeFormula)(int block_size, int channels);
+
+/**
+ * @brief Static properties of a codec which can be queried without creating
+ * an encoder or decoder.
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+struct ADPCMDescriptor {
+  AVCodecID id;
+  const char *name;
+  /// bits per coded sample (0 if not fixed)
+  int bits_per_sample;
+  /// the decoder provides the result as planar data
+  bool planar;
+  int min_channels;
+  int max_channels;
+  /// the encoder supports trellis quantization
+  bool trellis;
+  bool has_encoder;
+  bool has_decoder;
+  /// samples per channel in a block (nullptr if it depends on the content)
+  ADPCMSizeFormula frame_size;
+  /// bytes per block (nullptr if it depends on the content)
+  ADPCMSizeFormula block_align;
+  /// compact channel state which is sufficient for the codec
+  ADPCMStateFamily state_family;
+};
+
+// frame size and block align formulas
+inline int adpcm_fs_ima_wav(int bs, int ch) {
+  return (bs - 4 * ch) * 8 / (4 * ch) + 1;
+}
+inline int adpcm_fs_ima_qt(int /*bs*/, int /*ch*/) { return 64; }
+inline int adpcm_ba_ima_qt(int /*bs*/, int ch) { return 34 * ch; }
+inline int adpcm_fs_nibbles(int bs, int ch) { return bs * 2 / ch; }
+inline int adpcm_fs_header4(int bs, int ch) { return (bs - 4 * ch) * 2 / ch; }
+inline int adpcm_fs_ima_dk3(int bs, int ch) {
+  return ((bs - 16) * 2 / 3 * 4) / ch;
+}
+inline int adpcm_fs_ima_dk4(int bs, int ch) {
+  return 1 + (bs - 4 * ch) * 2 / ch;
+}
+inline int adpcm_fs_ms(int bs, int ch) { return (bs - 7 * ch) * 2 / ch + 2; }
+inline int adpcm_fs_mtaf(int bs, int ch) {
+  return (bs - 16 * (ch / 2)) * 2 / ch;
+}
+inline int adpcm_fs_swf(int /*bs*/, int /*ch*/) { return 4096; }
+inline int adpcm_ba_swf(int /*bs*/, int ch) {
+  return (2 + ch * (22 + 4 * 4095) + 7) / 8;
+}
+inline int adpcm_fs_amv(int bs, int /*ch*/) { return bs; }
+inline int adpcm_ba_amv(int bs, int /*ch*/) { return 8 + FFALIGN(bs, 2) / 2; }
+inline int adpcm_fs_argo(int /*bs*/, int /*ch*/) { return 32; }
+inline int adpcm_ba_argo(int /*bs*/, int ch) { return 17 * ch; }
+inline int adpcm_fs_ea_xas(int /*bs*/, int /*ch*/) { return 128; }
+inline int adpcm_ba_ea_xas(int /*bs*/, int ch) { return 76 * ch; }
+inline int adpcm_fs_ea_maxis_xa(int bs, int ch) { return (bs - ch) / ch * 2; }
+inline int adpcm_fs_xa(int bs, int ch) { return (bs / 128) * 224 / ch; }
+inline int adpcm_fs_xmd(int bs, int ch) { return bs / (21 * ch) * 32; }
+inline int adpcm_fs_psx(int bs, int ch) { return bs / (16 * ch) * 28; }
+inline int adpcm_fs_afc(int bs, int ch) { return bs / (9 * ch) * 16; }
+inline int adpcm_fs_zork(int bs, int ch) { return bs / ch; }
+inline int adpcm_ba_block_size(int bs, int /*ch*/) { return bs; }
+
+#if ENABLE_BROKEN_CODECS
+#define ADPCM_HAS_IMA_QT true
+#else
+#define ADPCM_HAS_IMA_QT false
+#endif
+
+// clang-format off
+static constexpr ADPCMDescriptor adpcm_descriptors[] = {
+  // id, name, bits, planar, min ch, max ch, trellis, encoder, decoder, frame size, block align, state
+  {AV_CODEC_ID_ADPCM_IMA_QT, "IMA_QT", 4, true, 1, 2, true, ADPCM_HAS_IMA_QT, ADPCM_HAS_IMA_QT, adpcm_fs_ima_qt, adpcm_ba_ima_qt, ADPCM_STATE_IMA},
+  {AV_CODEC_ID_ADPCM_IMA_WAV, "IMA_WAV", 4, true, 1, 2, true, true, true, adpcm_fs_ima_wav, adpcm_ba_block_size, ADPCM_STATE_IMA},
+  {AV_CODEC_ID_ADPCM_IMA_DK3, "IMA_DK3", 0, false, 1, 2, false, false, true, adpcm_fs_ima_dk3, adpcm_ba_block_size, ADPCM_STATE_IMA},
+  {AV_CODEC_ID_ADPCM_IMA_DK4, "IMA_DK4", 0, false, 1, 2, false, false, true, adpcm_fs_ima_dk4, adpcm_ba_block_size, ADPCM_STATE_IMA},
+  {AV_CODEC_ID_ADPCM_IMA_WS, "IMA_WS", 4, false, 1, 2, false, true, true, adpcm_fs_nibbles, adpcm_ba_block_size, ADPCM_STATE_IMA},
+  {AV_CODEC_ID_ADPCM_IMA_SMJPEG, "IMA_SMJPEG", 0, false, 1, 2, false, false, true, adpcm_fs_header4, adpcm_ba_block_size, ADPCM_STATE_IMA},
+  {AV_CODEC_ID_ADPCM_MS, "MS", 4, false, 1, 6, true, true, true, adpcm_fs_ms, adpcm_ba_block_size, ADPCM_STATE_LPC},
+  {AV_CODEC_ID_ADPCM_4XM, "4XM", 0, true, 1, 2, false, false, true, adpcm_fs_header4, adpcm_ba_block_size, ADPCM_STATE_IMA},
+  {AV_CODEC_ID_ADPCM_XA, "XA", 0, true, 1, 2, false, false, true, adpcm_fs_xa, adpcm_ba_block_size, ADPCM_STATE_LPC},
+  {AV_CODEC_ID_ADPCM_EA, "EA", 0, false, 2, 2, false, false, true, nullptr, nullptr, ADPCM_STATE_FULL},
+  {AV_CODEC_ID_ADPCM_CT, "CT", 4, false, 1, 2, false, false, true, adpcm_fs_nibbles, adpcm_ba_block_size, ADPCM_STATE_STEP},
+  {AV_CODEC_ID_ADPCM_SWF, "SWF", 4, false, 1, 2, true, true, true, adpcm_fs_swf, adpcm_ba_swf, ADPCM_STATE_IMA},
+  {AV_CODEC_ID_ADPCM_YAMAHA, "YAMAHA", 4, false, 1, 2, true, true, true, adpcm_fs_nibbles, adpcm_ba_block_size, ADPCM_STATE_STEP},
+  {AV_CODEC_ID_ADPCM_SBPRO_4, "SBPRO_4", 4, false, 1, 2, false, false, true, nullptr, nullptr, ADPCM_STATE_FULL},
+  {AV_CODEC_ID_ADPCM_SBPRO_3, "SBPRO_3", 3, false, 1, 2, false, false, true, nullptr, nullptr, ADPCM_STATE_FULL},
+  {AV_CODEC_ID_ADPCM_SBPRO_2, "SBPRO_2", 2, false, 1, 2, false, false, true, nullptr, nullptr, ADPCM_STATE_FULL},
+  {AV_CODEC_ID_ADPCM_THP, "THP", 0, true, 1, 14, false, false, true, nullptr, nullptr, ADPCM_STATE_FULL},
+  {AV_CODEC_ID_ADPCM_IMA_AMV, "IMA_AMV", 4, false, 1, 1, true, true, true, adpcm_fs_amv, adpcm_ba_amv, ADPCM_STATE_IMA},
+  {AV_CODEC_ID_ADPCM_EA_R1, "EA_R1", 0, true, 1, 6, false, false, true, nullptr, nullptr, ADPCM_STATE_FULL},
+  {AV_CODEC_ID_ADPCM_EA_R3, "EA_R3", 0, true, 1, 6, false, false, true, nullptr, nullptr, ADPCM_STATE_FULL},
+  {AV_CODEC_ID_ADPCM_EA_R2, "EA_R2", 0, true, 1, 6, false, false, true, nullptr, nullptr, ADPCM_STATE_FULL},
+  {AV_CODEC_ID_ADPCM_IMA_EA_SEAD, "IMA_EA_SEAD", 4, false, 1, 2, false, false, true, adpcm_fs_nibbles, adpcm_ba_block_size, ADPCM_STATE_IMA},
+  {AV_CODEC_ID_ADPCM_IMA_EA_EACS, "IMA_EA_EACS", 0, false, 1, 2, false, false, true, nullptr, nullptr, ADPCM_STATE_IMA},
+  {AV_CODEC_ID_ADPCM_EA_XAS, "EA_XAS", 0, true, 1, 6, false, false, true, adpcm_fs_ea_xas, adpcm_ba_ea_xas, ADPCM_STATE_FULL},
+  {AV_CODEC_ID_ADPCM_EA_MAXIS_XA, "EA_MAXIS_XA", 0, false, 1, 2, false, false, true, adpcm_fs_ea_maxis_xa, adpcm_ba_block_size, ADPCM_STATE_LPC},
+  {AV_CODEC_ID_ADPCM_IMA_ISS, "IMA_ISS", 0, false, 1, 2, false, false, true, adpcm_fs_header4, adpcm_ba_block_size, ADPCM_STATE_IMA},
+  {AV_CODEC_ID_ADPCM_G722, "G722", 4, false, 1, 2, false, false, false, nullptr, nullptr, ADPCM_STATE_FULL},
+  {AV_CODEC_ID_ADPCM_IMA_APC, "IMA_APC", 4, false, 1, 2, false, false, true, adpcm_fs_nibbles, adpcm_ba_block_size, ADPCM_STATE_FULL},
+  {AV_CODEC_ID_ADPCM_AFC, "AFC", 0, true, 1, 6, false, false, true, adpcm_fs_afc, adpcm_ba_block_size, ADPCM_STATE_FULL},
+  {AV_CODEC_ID_ADPCM_IMA_OKI, "IMA_OKI", 4, false, 1, 2, false, false, true, adpcm_fs_nibbles, adpcm_ba_block_size, ADPCM_STATE_IMA},
+  {AV_CODEC_ID_ADPCM_DTK, "DTK", 0, true, 2, 2, false, false, true, adpcm_fs_psx, adpcm_ba_block_size, ADPCM_STATE_FULL},
+  {AV_CODEC_ID_ADPCM_IMA_RAD, "IMA_RAD", 0, false, 1, 2, false, false, true, adpcm_fs_header4, adpcm_ba_block_size, ADPCM_STATE_IMA},
+  {AV_CODEC_ID_ADPCM_THP_LE, "THP_LE", 0, true, 1, 14, false, false, true, nullptr, nullptr, ADPCM_STATE_FULL},
+  {AV_CODEC_ID_ADPCM_PSX, "PSX", 0, true, 1, 8, false, false, true, adpcm_fs_psx, adpcm_ba_block_size, ADPCM_STATE_FULL},
+  {AV_CODEC_ID_ADPCM_AICA, "AICA", 4, true, 1, 2, false, false, true, adpcm_fs_nibbles, adpcm_ba_block_size, ADPCM_STATE_STEP},
+  {AV_CODEC_ID_ADPCM_IMA_DAT4, "IMA_DAT4", 0, false, 1, 14, false, false, true, adpcm_fs_header4, adpcm_ba_block_size, ADPCM_STATE_IMA},
+  {AV_CODEC_ID_ADPCM_MTAF, "MTAF", 0, true, 2, 8, false, false, true, adpcm_fs_mtaf, adpcm_ba_block_size, ADPCM_STATE_STEP},
+  {AV_CODEC_ID_ADPCM_AGM, "AGM", 0, false, 1, 2, false, false, true, adpcm_fs_header4, adpcm_ba_block_size, ADPCM_STATE_STEP},
+  {AV_CODEC_ID_ADPCM_ARGO, "ARGO", 4, true, 1, 2, false, true, true, adpcm_fs_argo, adpcm_ba_argo, ADPCM_STATE_LPC},
+  {AV_CODEC_ID_ADPCM_IMA_SSI, "IMA_SSI", 4, false, 1, 2, false, true, true, adpcm_fs_nibbles, adpcm_ba_block_size, ADPCM_STATE_IMA},
+  {AV_CODEC_ID_ADPCM_ZORK, "ZORK", 0, false, 1, 2, false, false, true, adpcm_fs_zork, adpcm_ba_block_size, ADPCM_STATE_IMA},
+  {AV_CODEC_ID_ADPCM_IMA_APM, "IMA_APM", 4, false, 1, 2, false, true, true, adpcm_fs_nibbles, adpcm_ba_block_size, ADPCM_STATE_FULL},
+  {AV_CODEC_ID_ADPCM_IMA_ALP, "IMA_ALP", 4, false, 1, 2, false, true, true, adpcm_fs_nibbles, adpcm_ba_block_size, ADPCM_STATE_IMA},
+  {AV_CODEC_ID_ADPCM_IMA_MTF, "IMA_MTF", 0, false, 1, 2, false, false, true, adpcm_fs_nibbles, adpcm_ba_block_size, ADPCM_STATE_IMA},
+  {AV_CODEC_ID_ADPCM_IMA_CUNNING, "IMA_CUNNING", 0, true, 1, 2, false, false, true, adpcm_fs_nibbles, adpcm_ba_block_size, ADPCM_STATE_IMA},
+  {AV_CODEC_ID_ADPCM_IMA_MOFLEX, "IMA_MOFLEX", 0, true, 1, 2, false, false, true, adpcm_fs_header4, adpcm_ba_block_size, ADPCM_STATE_IMA},
+  {AV_CODEC_ID_ADPCM_IMA_ACORN, "IMA_ACORN", 0, false, 1, 2, false, false, true, adpcm_fs_header4, adpcm_ba_block_size, ADPCM_STATE_IMA},
+  {AV_CODEC_ID_ADPCM_XMD, "XMD", 0, true, 1, 2, false, false, true, adpcm_fs_xmd, adpcm_ba_block_size, ADPCM_STATE_FULL},
+};
+// clang-format on
+
+/**
+ * @brief Access to the codec descriptors: e.g. to check the capabilities of
+ * a codec before creating it.
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+class ADPCMDescriptors {
+ public:
+  /// Provides the descriptor for the indicated codec (nullptr if not known)
+  static const ADPCMDescriptor *find(AVCodecID id) {
+    for (const ADPCMDescriptor &desc : adpcm_descriptors) {
+      if (desc.id == id) return &desc;
+    }
+    return nullptr;
+  }
+
+  /// Number of defined descriptors
+  static int count() {
+    return sizeof(adpcm_descriptors) / sizeof(adpcm_descriptors[0]);
+  }
+
+  /// Provides the descriptor at the indicated index
+  static const ADPCMDescriptor &get(int idx) { return adpcm_descriptors[idx]; }
+
+  static bool hasEncoder(AVCodecID id) {
+    const ADPCMDescriptor *desc = find(id);
+    return desc != nullptr && desc->has_encoder;
+  }
+
+  static bool hasDecoder(AVCodecID id) {
+    const ADPCMDescriptor *desc = find(id);
+    return desc != nullptr && desc->has_decoder;
+  }
+};
+
+}  // namespace adpcm_ffmpeg
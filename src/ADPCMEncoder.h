@@ -1,4 +1,5 @@
 #pragma once
+#include <math.h>
 #include "ADPCM.h"
 #include "ADPCMCodec.h"
 #include "adpcm-ffmpeg/put_bits.h"
@@ -19,17 +20,101 @@ class ADPCMEncoder : public ADPCMCodec {
     avctx.priv_data = (uint8_t *)&enc_ctx;
   }
 
+  /// Sets up the encoder and reserves all buffers: encode() does not
+  /// allocate any memory as long as it is called with at most frameSize()
+  /// samples per channel
   bool begin(int sampleRate, int channels) {
     avctx.sample_rate = sampleRate;
     avctx.nb_channels = channels;
     avctx.sample_fmt = sample_formats[0];
-    bool rc = adpcm_encode_init() == 0;
-    printf("frame_size: %d", frameSize());
-    return rc;
+    // release the buffers of a previous begin()
+    adpcm_encode_close();
+    if (adpcm_encode_init() != 0) return false;
+    reserveBuffers();
+    return true;
   }
 
   void end() { adpcm_encode_close(); }
 
+  /// Restores the initial stream state so that the encoder can be reused for
+  /// a new stream with the same parameters: the buffers are kept
+  void reset() { memset(enc_ctx.status, 0, sizeof(enc_ctx.status)); }
+
+  /// Sets up the state for a new stream. Note that the streams share the
+  /// encoder, so its own state is overwritten.
+  template <class S, int N>
+  bool initState(ADPCMStreamStateT<S, N> &state) {
+    if (!state.isSupported(descriptor(), channels())) {
+      av_log(avctx, AV_LOG_ERROR, "stream state not supported\n");
+      return false;
+    }
+    reset();
+    saveState(state);
+    state.resetStats();
+    return true;
+  }
+
+  /// Encodes the samples of the stream with the indicated state: the state is
+  /// updated. The packet belongs to the encoder and is overwritten by the
+  /// next call, so the encoder can only be shared by the streams of one
+  /// thread.
+  template <class S, int N, class T>
+  AVPacket &encode(ADPCMStreamStateT<S, N> &state, T *data,
+                   size_t sampleCount) {
+    if (!state.isSupported(descriptor(), channels())) {
+      result.size = 0;
+      return result;
+    }
+    loadState(state);
+    AVPacket &packet = encode(data, sampleCount);
+    saveState(state);
+    return packet;
+  }
+
+  /// Defines the sample format which is passed to encode():
+  /// AV_SAMPLE_FMT_S16 (default), AV_SAMPLE_FMT_FLT or AV_SAMPLE_FMT_S32 (also
+  /// for encode24()). This must be called before begin(), so that the planar
+  /// mono codecs reserve the buffer for the conversion: the other codecs
+  /// accept all formats without it.
+  bool setInputFormat(AVSampleFormat fmt) {
+    if (fmt != AV_SAMPLE_FMT_S16 && fmt != AV_SAMPLE_FMT_FLT &&
+        fmt != AV_SAMPLE_FMT_S32) {
+      av_log(avctx, AV_LOG_ERROR, "input format not supported\n");
+      return false;
+    }
+    input_format = fmt;
+    return true;
+  }
+
+  AVSampleFormat inputFormat() { return input_format; }
+
+  /// Activates TPDF dither for the conversion of float and int32 samples to
+  /// 16 bits
+  void setDither(bool active) { dither = active; }
+
+  bool isDither() { return dither; }
+
+  /// Encodes interleaved float samples in the range -1.0..1.0: they are
+  /// saturated and converted to 16 bits. The interleaved codecs convert in
+  /// their encode loops, the planar codecs while they split up the channels.
+  AVPacket &encode(const float *data, size_t sampleCount) {
+    frame.data[0] = (uint8_t *)data;
+    return encodeConverted(data, sampleCount);
+  }
+
+  /// Encodes interleaved left-justified int32 samples
+  AVPacket &encode(const int32_t *data, size_t sampleCount) {
+    frame.data[0] = (uint8_t *)data;
+    return encodeConverted(data, sampleCount);
+  }
+
+  /// Encodes interleaved packed 24 bit little endian samples (3 bytes per
+  /// sample)
+  AVPacket &encode24(const uint8_t *data, size_t sampleCount) {
+    frame.data[0] = (uint8_t *)data;
+    return encodeConverted(Packed24{data}, sampleCount);
+  }
+
   AVPacket &encode(int16_t *data, size_t sampleCount) {
     frame.nb_samples = sampleCount / avctx.nb_channels;
     // fill data
@@ -56,27 +141,225 @@ class ADPCMEncoder : public ADPCMCodec {
       }
     }
 
-    int got_packet_ptr = 0;
-    av_packet_data.resize(sampleCount);
-    result.data = &av_packet_data[0];
+    return encodeFrame(sampleCount);
+  }
 
-    int rc = adpcm_encode_frame(&result, &frame, &got_packet_ptr);
-    if (rc != 0 || !got_packet_ptr) {
-      result.size = 0;
+  ADPCMMemoryUsage memoryUsage() override {
+    ADPCMMemoryUsage result = ADPCMCodec::memoryUsage();
+    result.buffers += bufferSize(av_packet_data);
+    result.buffers += bufferSize(frame_extended_data_vectors);
+    if (enc_ctx.paths != nullptr) {
+      int frontier = enc_ctx.frontier;
+      result.trellis = frontier * FREEZE_INTERVAL * sizeof(TrellisPath) +
+                       2 * frontier * sizeof(TrellisNode) +
+                       2 * frontier * sizeof(TrellisNode *) + 65536;
     }
+    result.trellis += bufferSize(trellis_buffer);
+    if (avctx.extradata != nullptr)
+      result.extradata =
+          avctx.extradata_size + AV_INPUT_BUFFER_PADDING_SIZE;
     return result;
   }
 
   virtual bool is_trellis() { return false; }
 
+  /// Defines the trellis level: 0 = off, 1-16 = search 2^level paths. This
+  /// must be called before begin(). Returns false if the level is not
+  /// supported by the codec.
+  bool setTrellis(int level) {
+    if (level < 0 || level > 16) return false;
+    const ADPCMDescriptor *desc = descriptor();
+    if (level > 0 && (desc == nullptr || !desc->trellis)) return false;
+    avctx.trellis = level;
+    return true;
+  }
+
+  /// Provides the trellis level (0 = off)
+  int trellis() { return avctx.trellis; }
+
+  /// true if the settings which are defined before begin() have the values
+  /// of a new encoder
+  bool hasDefaultSettings() {
+    return blockSize() == ADAPCM_DEFAULT_BLOCK_SIZE && avctx.trellis == 0 &&
+           input_format == AV_SAMPLE_FMT_S16 && !dither;
+  }
+
   int blockAlign() { return avctx.block_align;}
 
  protected:
+  /// Access to packed 24 bit samples as left-justified int32
+  struct Packed24 {
+    const uint8_t *data;
+    int32_t operator[](ptrdiff_t index) const {
+      return (int32_t)(AV_RL24(data + 3 * index) << 8);
+    }
+    Packed24 operator+(ptrdiff_t n) const { return {data + 3 * n}; }
+    Packed24 &operator+=(ptrdiff_t n) {
+      data += 3 * n;
+      return *this;
+    }
+  };
+
+  /// Reads float, int32 or packed 24 bit input like an int16_t pointer: every
+  /// sample is converted (and dithered) when the encode loop reads it, so
+  /// each sample must be read only once.
+  template <class T>
+  struct ConvertedInput {
+    T data;
+    ADPCMEncoder *encoder;
+    int16_t operator[](ptrdiff_t index) const {
+      return encoder->toInt16(data[index]);
+    }
+    int16_t operator*() const { return encoder->toInt16(data[0]); }
+    ConvertedInput operator+(ptrdiff_t n) const {
+      return {data + n, encoder};
+    }
+    ConvertedInput &operator+=(ptrdiff_t n) {
+      data += n;
+      return *this;
+    }
+    ConvertedInput operator++(int) {
+      ConvertedInput result = *this;
+      data += 1;
+      return result;
+    }
+  };
+
   AVPacket result;
   AVFrame frame;
   int16_t *extended_data[2] = {0};
   ADPCMVector<uint8_t> av_packet_data;
   ADPCMVector<ADPCMVector<int16_t>> frame_extended_data_vectors;
+  // nibbles of the trellis search
+  ADPCMVector<uint8_t> trellis_buffer;
+  AVSampleFormat input_format = AV_SAMPLE_FMT_S16;
+  // input of the interleaved codecs which is converted in the encode loop
+  const ConvertedInput<const float *> *p_float_input = nullptr;
+  const ConvertedInput<const int32_t *> *p_s32_input = nullptr;
+  const ConvertedInput<Packed24> *p_packed24_input = nullptr;
+  bool dither = false;
+  uint32_t dither_seed = 1;
+
+  /// Converts the input to 16 bits: the planar codecs need it while the
+  /// channels are split up, the interleaved codecs read it through a
+  /// ConvertedInput
+  template <class T>
+  AVPacket &encodeConverted(const T &data, size_t sampleCount) {
+    int n = sampleCount / channels();
+    frame.nb_samples = n;
+    frame.extended_data = extended_data;
+    if (isPlanar()) {
+      frame_extended_data_vectors.resize(channels());
+      for (int ch = 0; ch < channels(); ch++) {
+        frame_extended_data_vectors[ch].resize(n);
+        extended_data[ch] = &frame_extended_data_vectors[ch][0];
+      }
+      for (int j = 0; j < n; j++) {
+        for (int ch = 0; ch < channels(); ch++) {
+          extended_data[ch][j] = toInt16(data[j * channels() + ch]);
+        }
+      }
+      frame.data[0] = (uint8_t *)extended_data[0];
+      return encodeFrame(sampleCount);
+    }
+    ConvertedInput<T> input{data, this};
+    extended_data[0] = nullptr;
+    setInput(&input);
+    AVPacket &packet = encodeFrame(sampleCount);
+    setInput((const ConvertedInput<const float *> *)nullptr);
+    return packet;
+  }
+
+  void setInput(const ConvertedInput<const float *> *input) {
+    p_float_input = input;
+    p_s32_input = nullptr;
+    p_packed24_input = nullptr;
+  }
+
+  void setInput(const ConvertedInput<const int32_t *> *input) {
+    p_float_input = nullptr;
+    p_s32_input = input;
+    p_packed24_input = nullptr;
+  }
+
+  void setInput(const ConvertedInput<Packed24> *input) {
+    p_float_input = nullptr;
+    p_s32_input = nullptr;
+    p_packed24_input = input;
+  }
+
+  /// Calls the encode loop of the codec with the converted input
+  template <class Codec>
+  int compressConverted(Codec &codec, const AVFrame *frame) {
+    if (p_float_input != nullptr) return codec.compress(frame, *p_float_input);
+    if (p_s32_input != nullptr) return codec.compress(frame, *p_s32_input);
+    return codec.compress(frame, *p_packed24_input);
+  }
+
+  /// Triangular dither in 1/65536 of the 16 bit LSB: the sum of two
+  /// uniform values
+  int tpdf() {
+    dither_seed = dither_seed * 1664525u + 1013904223u;
+    int r1 = (int)(dither_seed >> 16) - 32768;
+    dither_seed = dither_seed * 1664525u + 1013904223u;
+    int r2 = (int)(dither_seed >> 16) - 32768;
+    return r1 + r2;
+  }
+
+  int16_t toInt16(int32_t sample) {
+    int64_t value = (int64_t)sample + 0x8000;
+    if (dither) value += tpdf();
+    return av_clip_int16((int)(value >> 16));
+  }
+
+  int16_t toInt16(float sample) {
+    float value = sample * 32768.0f;
+    if (dither) value += tpdf() / 65536.0f;
+    // saturation: this also maps NaN to the minimum
+    if (!(value > -32768.0f)) return -32768;
+    if (value >= 32767.0f) return 32767;
+    return (int16_t)lrintf(value);
+  }
+
+  AVPacket &encodeFrame(size_t sampleCount) {
+    int got_packet_ptr = 0;
+    av_packet_data.resize(FFMAX((int)sampleCount, avctx.block_align));
+    result.data = &av_packet_data[0];
+
+    last_error = AV_OK;
+    int rc = adpcm_encode_frame(&result, &frame, &got_packet_ptr);
+    if (rc != 0 || !got_packet_ptr) {
+      result.size = 0;
+      last_error = rc != AV_OK ? (av_errors)rc : AVERROR_INVALIDDATA;
+      ADPCM_STATS_ADD(invalid_packets, 1);
+    } else {
+      ADPCM_STATS_ADD(frames, 1);
+      ADPCM_STATS_ADD(samples, frame.nb_samples);
+      ADPCM_STATS_ADD(bytes, result.size);
+    }
+    return result;
+  }
+
+  /// Allocates the buffers which are needed by encode() for a full frame
+  void reserveBuffers() {
+    int samples = frameSize() * channels();
+    av_packet_data.resize(FFMAX(samples, avctx.block_align));
+    if (isPlanar() && (channels() == 2 || input_format != AV_SAMPLE_FMT_S16)) {
+      frame_extended_data_vectors.resize(channels());
+      for (int ch = 0; ch < channels(); ch++)
+        frame_extended_data_vectors[ch].resize(frameSize());
+    }
+    if (avctx.trellis > 0) trellis_buffer.resize(2 * samples);
+    // the logger is set up here, so that logging does not need to initialize
+    // the static instance in encode()
+    ADPCMLogger::instance();
+  }
+
+  /// Provides the buffer for the trellis nibbles
+  uint8_t *trellisBuffer(int size) {
+    trellis_buffer.resize(size);
+    return trellis_buffer.data();
+  }
   // encoding data
   int st, pkt_size, ret;
   const int16_t *samples;
@@ -85,6 +368,22 @@ class ADPCMEncoder : public ADPCMCodec {
   ADPCMEncodeContext *c;
   ADPCMEncodeContext *s;
 
+  size_t objectSize() override { return sizeof(ADPCMEncoder); }
+
+  /// Loads the stream state: the counters are updated in the state until
+  /// saveState()
+  template <class S, int N>
+  void loadState(ADPCMStreamStateT<S, N> &state) {
+    state.load(enc_ctx.status, channels(), true);
+    selectStats(state.statsData());
+  }
+
+  template <class S, int N>
+  void saveState(ADPCMStreamStateT<S, N> &state) {
+    state.save(enc_ctx.status, channels(), true);
+    selectStats(nullptr);
+  }
+
   virtual int adpcm_encode_init_impl() = 0;
 
   virtual int adpcm_encode_init() {
@@ -132,6 +431,7 @@ class ADPCMEncoder : public ADPCMCodec {
           !FF_ALLOC_TYPED_ARRAY(TrellisNode **, s->nodep_buf, 2 * frontier) ||
           !FF_ALLOC_TYPED_ARRAY(uint8_t *, s->trellis_hash, 65536))
         return AVERROR(AVERROR_MEMORY);
+      s->frontier = frontier;
     }
 
     avctx.bits_per_coded_sample = av_get_bits_per_sample();
@@ -145,6 +445,9 @@ class ADPCMEncoder : public ADPCMCodec {
     av_freep(&s->node_buf);
     av_freep(&s->nodep_buf);
     av_freep(&s->trellis_hash);
+    s->frontier = 0;
+    av_freep(&avctx.extradata);
+    avctx.extradata_size = 0;
 
     return 0;
   }
@@ -159,7 +462,7 @@ class ADPCMEncoder : public ADPCMCodec {
                        8);
     c->prev_sample = av_clip_int16(c->prev_sample);
     c->step_index =
-        av_clip(c->step_index + ff_adpcm_index_table[nibble], 0, 88);
+        av_clip_step(c->step_index + ff_adpcm_index_table[nibble], 0, 88);
     return nibble;
   }
 
@@ -195,7 +498,7 @@ class ADPCMEncoder : public ADPCMCodec {
 
     c->prev_sample = av_clip_int16(c->prev_sample);
     c->step_index =
-        av_clip(c->step_index + ff_adpcm_index_table[nibble], 0, 88);
+        av_clip_step(c->step_index + ff_adpcm_index_table[nibble], 0, 88);
 
     return nibble;
   }
@@ -216,7 +519,7 @@ class ADPCMEncoder : public ADPCMCodec {
     c->predictor += ((c->step * ff_adpcm_yamaha_difflookup[nibble]) / 8);
     c->predictor = av_clip_int16(c->predictor);
     c->step = (c->step * ff_adpcm_yamaha_indexscale[nibble]) >> 8;
-    c->step = av_clip(c->step, 127, 24576);
+    c->step = av_clip_step(c->step, 127, 24576);
 
     return nibble;
   }
@@ -224,6 +527,22 @@ class ADPCMEncoder : public ADPCMCodec {
   virtual int adpcm_encode_frame_impl(AVPacket *avpkt, const AVFrame *frame,
                                       int *got_packet_ptr) = 0;
 
+  /// Encodes the input of encode(float/int32/24 bit): only needed by the
+  /// interleaved codecs
+  virtual int convert_frame_impl(AVPacket *avpkt, const AVFrame *frame,
+                                 int *got_packet_ptr) {
+    av_log(avctx, AV_LOG_ERROR, "converted input not supported\n");
+    return AVERROR(AVERROR_PATCHWELCOME);
+  }
+
+  int encode_frame_impl(AVPacket *avpkt, const AVFrame *frame,
+                        int *got_packet_ptr) {
+    if (p_float_input != nullptr || p_s32_input != nullptr ||
+        p_packed24_input != nullptr)
+      return convert_frame_impl(avpkt, frame, got_packet_ptr);
+    return adpcm_encode_frame_impl(avpkt, frame, got_packet_ptr);
+  }
+
   virtual int adpcm_encode_frame(AVPacket *avpkt, const AVFrame *frame,
                                  int *got_packet_ptr) {
     c = (ADPCMEncodeContext *)avctx.priv_data;
@@ -245,7 +564,13 @@ class ADPCMEncoder : public ADPCMCodec {
       return ret;
     dst = avpkt->data;
 
-    int rc = adpcm_encode_frame_impl(avpkt, frame, got_packet_ptr);
+#if ADPCM_STATS
+    uint64_t start = ADPCM_STATS_NS();
+    int rc = encode_frame_impl(avpkt, frame, got_packet_ptr);
+    p_stats->ns += ADPCM_STATS_NS() - start;
+#else
+    int rc = encode_frame_impl(avpkt, frame, got_packet_ptr);
+#endif
     if (rc != AV_OK) return rc;
 
     *got_packet_ptr = 1;
@@ -256,14 +581,15 @@ class ADPCMEncoder : public ADPCMCodec {
 class ADPCMEncoderTrellis : public ADPCMEncoder {
  public:
   bool is_trellis() { return avctx.trellis; }
-  void set_trellis(bool flag) { avctx.trellis = flag;}
+  void set_trellis(bool flag) { setTrellis(flag ? 1 : 0); }
   bool store_node(int STEP_INDEX) {
     int d;
     uint32_t ssd;
     int pos;
     TrellisNode *u;
     uint8_t *h;
-    dec_sample = av_clip_int16(dec_sample);
+    // the candidates of the search are not counted as clip events
+    dec_sample = adpcm_ffmpeg::av_clip_int16(dec_sample);
     d = sample - dec_sample;
     ssd = nodes[j]->ssd +
           d * (unsigned)d; /* Check for wraparound, skip such samples
@@ -319,7 +645,7 @@ class ADPCMEncoderTrellis : public ADPCMEncoder {
     return false;
   }
 
-  void loop_nodes(int16_t STEP_TABLE, int STEP_INDEX) {
+  void loop_nodes(int STEP_TABLE, int step) {
     const int predictor = nodes[j]->sample1;
     const int div = (sample - predictor) * 4 / STEP_TABLE;
     int nmin = av_clip(div - range, -7, 6);
@@ -327,15 +653,38 @@ class ADPCMEncoderTrellis : public ADPCMEncoder {
     if (nmin <= 0) nmin--; /* distinguish -0 from +0 */
     if (nmax < 0) nmax--;
     for (nidx = nmin; nidx <= nmax; nidx++) {
-      const int nibble = nidx < 0 ? 7 - nidx : nidx;
-      dec_sample =
-          predictor + (STEP_TABLE * ff_adpcm_yamaha_difflookup[nibble]) / 8;
-      store_node(STEP_INDEX);
+      // the stored path and the next step depend on the current nibble
+      nibble = nidx < 0 ? 7 - nidx : nidx;
+      dec_sample = predictor + expand_diff(STEP_TABLE, nibble);
+      store_node(next_step(step, nibble));
     }
   }
 
-  void adpcm_compress_trellis(const int16_t *samples, uint8_t *dst,
-                              ADPCMChannelStatus *c, int n, int stride) {
+  /// difference which the decoder adds for the nibble: IMA_QT and SWF sum up
+  /// the shifted steps, so the result is not the rounded (nibble + 0.5) * step
+  int expand_diff(int step, int nibble) {
+    if (version == AV_CODEC_ID_ADPCM_IMA_QT ||
+        version == AV_CODEC_ID_ADPCM_SWF) {
+      int diff = step >> 3;
+      if (nibble & 4) diff += step;
+      if (nibble & 2) diff += step >> 1;
+      if (nibble & 1) diff += step >> 2;
+      return nibble & 8 ? -diff : diff;
+    }
+    return (step * ff_adpcm_yamaha_difflookup[nibble]) / 8;
+  }
+
+  /// step index (IMA) or step size (Yamaha) after the nibble
+  int next_step(int step, int nibble) {
+    if (version == AV_CODEC_ID_ADPCM_YAMAHA)
+      return av_clip((step * ff_adpcm_yamaha_indexscale[nibble]) >> 8, 127,
+                     24576);
+    return av_clip(step + ff_adpcm_index_table[nibble], 0, 88);
+  }
+
+  template <class In>
+  void adpcm_compress_trellis(In samples, uint8_t *dst, ADPCMChannelStatus *c,
+                              int n, int stride) {
     // FIXME 6% faster if frontier is a compile-time constant
     s = (ADPCMEncodeContext *)avctx.priv_data;
     frontier = 1 << avctx.trellis;
@@ -393,19 +742,16 @@ class ADPCMEncoderTrellis : public ADPCMEncoder {
             nibble = nidx & 0xf;
             dec_sample = predictor + nidx * step;
 
-            while (store_node(
-                FFMAX(16, (ff_adpcm_AdaptationTable[nibble] * step) >> 8)));
+            store_node(
+                FFMAX(16, (ff_adpcm_AdaptationTable[nibble] * step) >> 8));
           }
         } else if (version == AV_CODEC_ID_ADPCM_IMA_WAV ||
                    version == AV_CODEC_ID_ADPCM_IMA_QT ||
                    version == AV_CODEC_ID_ADPCM_IMA_AMV ||
                    version == AV_CODEC_ID_ADPCM_SWF) {
-          loop_nodes(ff_adpcm_step_table[step],
-                     av_clip(step + ff_adpcm_index_table[nibble], 0, 88));
+          loop_nodes(ff_adpcm_step_table[step], step);
         } else {  // AV_CODEC_ID_ADPCM_YAMAHA
-          loop_nodes(step,
-                     av_clip((step * ff_adpcm_yamaha_indexscale[nibble]) >> 8,
-                             127, 24576));
+          loop_nodes(step, step);
         }
       }
 
@@ -475,6 +821,8 @@ class ADPCMEncoderTrellis : public ADPCMEncoder {
   int nidx;
   int range;
   int heap_pos;
+
+  size_t objectSize() override { return sizeof(ADPCMEncoderTrellis); }
 };
 
 class EncoderADPCM_IMA_WAV : public ADPCMEncoderTrellis {
@@ -509,9 +857,7 @@ class EncoderADPCM_IMA_WAV : public ADPCMEncoderTrellis {
 
     /* stereo: 4 bytes (8 samples) for left, 4 bytes for right */
     if (avctx.trellis > 0) {
-      uint8_t *buf;
-      if (!FF_ALLOC_TYPED_ARRAY(uint8_t *, buf, channels() *blocks * 8))
-        return AVERROR(AVERROR_MEMORY);
+      uint8_t *buf = trellisBuffer(channels() * blocks * 8);
       for (int ch = 0; ch < channels(); ch++) {
         adpcm_compress_trellis(&samples_p[ch][1], buf + ch * blocks * 8,
                                &c->status[ch], blocks * 8, 1);
@@ -522,7 +868,6 @@ class EncoderADPCM_IMA_WAV : public ADPCMEncoderTrellis {
           for (int j = 0; j < 8; j += 2) *dst++ = buf1[j] | (buf1[j + 1] << 4);
         }
       }
-      av_free(buf);
     } else {
       for (int i = 0; i < blocks; i++) {
         for (int ch = 0; ch < channels(); ch++) {
@@ -554,30 +899,31 @@ class EncoderADPCM_IMA_QT : public ADPCMEncoderTrellis {
 
   int adpcm_encode_frame_impl(AVPacket *avpkt, const AVFrame *frame,
                               int *got_packet_ptr) {
-    PutBitContext pb;
-    init_put_bits(&pb, dst, pkt_size);
+    PutNibbleContext pb;
+    init_put_nibbles(&pb, dst, pkt_size);
 
     for (int ch = 0; ch < channels(); ch++) {
       ADPCMChannelStatus *status = &c->status[ch];
-      put_bits(&pb, 9, (status->prev_sample & 0xFFFF) >> 7);
-      put_bits(&pb, 7, status->step_index);
+      /* big endian: 9 bits predictor followed by 7 bits step index */
+      int header = (status->prev_sample & 0xFF80) | status->step_index;
+      put_nibble_pair(&pb, (header >> 8) & 0x0F, (header >> 12) & 0x0F);
+      put_nibble_pair(&pb, header & 0x0F, (header >> 4) & 0x0F);
       if (avctx.trellis > 0) {
         uint8_t buf[64];
         adpcm_compress_trellis(&samples_p[ch][0], buf, status, 64, 1);
-        for (int i = 0; i < 64; i++) put_bits(&pb, 4, buf[i ^ 1]);
+        for (int i = 0; i < 64; i += 2) put_nibble_pair(&pb, buf[i], buf[i + 1]);
         status->prev_sample = status->predictor;
       } else {
         for (int i = 0; i < 64; i += 2) {
           int t1, t2;
           t1 = adpcm_ima_qt_compress_sample(status, samples_p[ch][i]);
           t2 = adpcm_ima_qt_compress_sample(status, samples_p[ch][i + 1]);
-          put_bits(&pb, 4, t2);
-          put_bits(&pb, 4, t1);
+          put_nibble_pair(&pb, t1, t2);
         }
       }
     }
 
-    flush_put_bits(&pb);
+    flush_put_nibbles(&pb);
     return AV_OK;
   }
 };
@@ -596,19 +942,32 @@ class EncoderADPCM_IMA_SSI : public ADPCMEncoder {
 
   int adpcm_encode_frame_impl(AVPacket *avpkt, const AVFrame *frame,
                               int *got_packet_ptr) {
-    PutBitContext pb;
-    init_put_bits(&pb, dst, pkt_size);
+    return compress(frame, samples);
+  }
+
+  int convert_frame_impl(AVPacket *avpkt, const AVFrame *frame,
+                         int *got_packet_ptr) {
+    return compressConverted(*this, frame);
+  }
+
+  template <class In>
+  int compress(const AVFrame *frame, In samples) {
+    PutNibbleContext pb;
+    init_put_nibbles(&pb, dst, pkt_size);
 
     av_assert(avctx.trellis == 0);
 
-    for (int i = 0; i < frame->nb_samples; i++) {
-      for (int ch = 0; ch < channels(); ch++) {
-        put_bits(&pb, 4,
-                 adpcm_ima_qt_compress_sample(c->status + ch, *samples++));
-      }
+    /* the first nibble of a byte is stored in the high bits */
+    int count = frame->nb_samples * channels();
+    for (int i = 0; i < count; i += 2) {
+      int t1 = adpcm_ima_qt_compress_sample(c->status + (i & st), *samples++);
+      int t2 = i + 1 < count ? adpcm_ima_qt_compress_sample(
+                                   c->status + ((i + 1) & st), *samples++)
+                             : 0;
+      put_nibble_pair(&pb, t2, t1);
     }
 
-    flush_put_bits(&pb);
+    flush_put_nibbles(&pb);
     return AV_OK;
   }
 };
@@ -640,28 +999,37 @@ class EncoderADPCM_IMA_ALP : public ADPCMEncoder {
     c->prev_sample += diff;
     c->prev_sample = av_clip_int16(c->prev_sample);
     c->step_index =
-        av_clip(c->step_index + ff_adpcm_index_table[nibble], 0, 88);
+        av_clip_step(c->step_index + ff_adpcm_index_table[nibble], 0, 88);
     return nibble;
   }
 
   int adpcm_encode_frame_impl(AVPacket *avpkt, const AVFrame *frame,
                               int *got_packet_ptr) {
-    PutBitContext pb;
-    init_put_bits(&pb, dst, pkt_size);
+    return compress(frame, samples);
+  }
+
+  int convert_frame_impl(AVPacket *avpkt, const AVFrame *frame,
+                         int *got_packet_ptr) {
+    return compressConverted(*this, frame);
+  }
+
+  template <class In>
+  int compress(const AVFrame *frame, In samples) {
+    PutNibbleContext pb;
+    init_put_nibbles(&pb, dst, pkt_size);
 
     av_assert(avctx.trellis == 0);
 
     for (int n = frame->nb_samples / 2; n > 0; n--) {
       for (int ch = 0; ch < channels(); ch++) {
-        put_bits(&pb, 4,
-                 adpcm_ima_alp_compress_sample(c->status + ch, *samples++));
-        put_bits(&pb, 4,
-                 adpcm_ima_alp_compress_sample(c->status + ch, samples[st]));
+        int t1 = adpcm_ima_alp_compress_sample(c->status + ch, *samples++);
+        int t2 = adpcm_ima_alp_compress_sample(c->status + ch, samples[st]);
+        put_nibble_pair(&pb, t2, t1);
       }
       samples += channels();
     }
 
-    flush_put_bits(&pb);
+    flush_put_nibbles(&pb);
     return AV_OK;
   }
 };
@@ -715,13 +1083,26 @@ class EncoderADPCM_MS : public ADPCMEncoderTrellis {
     c->sample1 = av_clip_int16(predictor);
 
     c->idelta = (ff_adpcm_AdaptationTable[nibble] * c->idelta) >> 8;
-    if (c->idelta < 16) c->idelta = 16;
+    if (c->idelta <= 16) {
+      c->idelta = 16;
+      ADPCM_STATS_ADD(step_floor, 1);
+    }
 
     return nibble;
   }
 
   int adpcm_encode_frame_impl(AVPacket *avpkt, const AVFrame *frame,
                               int *got_packet_ptr) {
+    return compress(frame, samples);
+  }
+
+  int convert_frame_impl(AVPacket *avpkt, const AVFrame *frame,
+                         int *got_packet_ptr) {
+    return compressConverted(*this, frame);
+  }
+
+  template <class In>
+  int compress(const AVFrame *frame, In samples) {
     for (int i = 0; i < channels(); i++) {
       int predictor = 0;
       *dst++ = predictor;
@@ -741,9 +1122,9 @@ class EncoderADPCM_MS : public ADPCMEncoderTrellis {
       bytestream_put_le16(&dst, c->status[i].sample2);
 
     if (avctx.trellis > 0) {
-      const int n = avctx.block_align - 7 * channels();
-      uint8_t *buf = (uint8_t *)av_malloc(2 * n);
-      if (!buf) return AVERROR(AVERROR_MEMORY);
+      // samples per channel after the two header samples
+      const int n = avctx.frame_size - 2;
+      uint8_t *buf = trellisBuffer(2 * n);
       if (channels() == 1) {
         adpcm_compress_trellis(samples, buf, &c->status[0], n, channels());
         for (int i = 0; i < n; i += 2) *dst++ = (buf[i] << 4) | buf[i + 1];
@@ -753,7 +1134,6 @@ class EncoderADPCM_MS : public ADPCMEncoderTrellis {
                                channels());
         for (int i = 0; i < n; i++) *dst++ = (buf[i] << 4) | buf[n + i];
       }
-      av_free(buf);
     } else {
       for (int i = 7 * channels(); i < avctx.block_align; i++) {
         int nibble;
@@ -788,6 +1168,16 @@ class EncoderADPCM_SWF : public ADPCMEncoderTrellis {
 
   int adpcm_encode_frame_impl(AVPacket *avpkt, const AVFrame *frame,
                               int *got_packet_ptr) {
+    return compress(frame, samples);
+  }
+
+  int convert_frame_impl(AVPacket *avpkt, const AVFrame *frame,
+                         int *got_packet_ptr) {
+    return compressConverted(*this, frame);
+  }
+
+  template <class In>
+  int compress(const AVFrame *frame, In samples) {
     const int n = frame->nb_samples - 1;
     PutBitContext pb;
     init_put_bits(&pb, dst, pkt_size);
@@ -802,9 +1192,10 @@ class EncoderADPCM_SWF : public ADPCMEncoderTrellis {
     for (int i = 0; i < channels(); i++) {
       // clip step so it fits 6 bits
       c->status[i].step_index = av_clip_uintp2(c->status[i].step_index, 6);
-      put_sbits(&pb, 16, samples[i]);
+      int16_t sample = samples[i];
+      put_sbits(&pb, 16, sample);
       put_bits(&pb, 6, c->status[i].step_index);
-      c->status[i].prev_sample = samples[i];
+      c->status[i].prev_sample = sample;
     }
 
     if (avctx.trellis > 0) {
@@ -848,10 +1239,19 @@ class EncoderADPCM_YAMAHA : public ADPCMEncoderTrellis {
 
   int adpcm_encode_frame_impl(AVPacket *avpkt, const AVFrame *frame,
                               int *got_packet_ptr) {
+    return compress(frame, samples);
+  }
+
+  int convert_frame_impl(AVPacket *avpkt, const AVFrame *frame,
+                         int *got_packet_ptr) {
+    return compressConverted(*this, frame);
+  }
+
+  template <class In>
+  int compress(const AVFrame *frame, In samples) {
     int n = frame->nb_samples / 2;
     if (avctx.trellis > 0) {
-      uint8_t *buf = (uint8_t *)av_malloc(2 * n * 2);
-      if (!buf) return AVERROR(AVERROR_MEMORY);
+      uint8_t *buf = trellisBuffer(2 * n * 2);
       n *= 2;
       if (channels() == 1) {
         adpcm_compress_trellis(samples, buf, &c->status[0], n, channels());
@@ -862,7 +1262,6 @@ class EncoderADPCM_YAMAHA : public ADPCMEncoderTrellis {
                                channels());
         for (int i = 0; i < n; i++) *dst++ = buf[i] | (buf[n + i] << 4);
       }
-      av_free(buf);
     } else
       for (n *= channels(); n > 0; n--) {
         int nibble;
@@ -893,22 +1292,31 @@ class EncoderADPCM_IMA_APM : public ADPCMEncoder {
 
   int adpcm_encode_frame_impl(AVPacket *avpkt, const AVFrame *frame,
                               int *got_packet_ptr) {
-    PutBitContext pb;
-    init_put_bits(&pb, dst, pkt_size);
+    return compress(frame, samples);
+  }
+
+  int convert_frame_impl(AVPacket *avpkt, const AVFrame *frame,
+                         int *got_packet_ptr) {
+    return compressConverted(*this, frame);
+  }
+
+  template <class In>
+  int compress(const AVFrame *frame, In samples) {
+    PutNibbleContext pb;
+    init_put_nibbles(&pb, dst, pkt_size);
 
     av_assert(avctx.trellis == 0);
 
     for (int n = frame->nb_samples / 2; n > 0; n--) {
       for (int ch = 0; ch < channels(); ch++) {
-        put_bits(&pb, 4,
-                 adpcm_ima_qt_compress_sample(c->status + ch, *samples++));
-        put_bits(&pb, 4,
-                 adpcm_ima_qt_compress_sample(c->status + ch, samples[st]));
+        int t1 = adpcm_ima_qt_compress_sample(c->status + ch, *samples++);
+        int t2 = adpcm_ima_qt_compress_sample(c->status + ch, samples[st]);
+        put_nibble_pair(&pb, t2, t1);
       }
       samples += channels();
     }
 
-    flush_put_bits(&pb);
+    flush_put_nibbles(&pb);
     return AV_OK;
   }
 };
@@ -937,6 +1345,16 @@ class EncoderADPCM_IMA_AMV : public ADPCMEncoderTrellis {
 
   int adpcm_encode_frame_impl(AVPacket *avpkt, const AVFrame *frame,
                               int *got_packet_ptr) {
+    return compress(frame, samples);
+  }
+
+  int convert_frame_impl(AVPacket *avpkt, const AVFrame *frame,
+                         int *got_packet_ptr) {
+    return compressConverted(*this, frame);
+  }
+
+  template <class In>
+  int compress(const AVFrame *frame, In samples) {
     av_assert(channels() == 1);
 
     c->status[0].prev_sample = *samples;
@@ -947,16 +1365,13 @@ class EncoderADPCM_IMA_AMV : public ADPCMEncoderTrellis {
 
     if (avctx.trellis > 0) {
       const int n = frame->nb_samples >> 1;
-      uint8_t *buf = (uint8_t *)av_malloc(2 * n);
-
-      if (!buf) return AVERROR(AVERROR_MEMORY);
+      uint8_t *buf = trellisBuffer(2 * n);
 
       adpcm_compress_trellis(samples, buf, &c->status[0], 2 * n, channels());
       for (int i = 0; i < n; i++)
         bytestream_put_byte(&dst, (buf[2 * i] << 4) | buf[2 * i + 1]);
 
       samples += 2 * n;
-      av_free(buf);
     } else
       for (int n = frame->nb_samples >> 1; n > 0; n--) {
         int nibble;
@@ -1014,16 +1429,15 @@ class EncoderADPCM_ARGO : public ADPCMEncoder {
     return sample;
   }
 
-  int64_t adpcm_argo_compress_block(ADPCMChannelStatus *cs, PutBitContext *pb,
+  int64_t adpcm_argo_compress_block(ADPCMChannelStatus *cs,
+                                    PutNibbleContext *pb,
                                     const int16_t *samples, int nsamples,
                                     int shift, int flag) {
     int64_t error = 0;
 
     if (pb) {
-      put_bits(pb, 4, shift - 2);
-      put_bits(pb, 1, 0);
-      put_bits(pb, 1, !!flag);
-      put_bits(pb, 2, 0);
+      /* shift - 2, one reserved bit, the decoder flag and 2 reserved bits */
+      put_nibble_pair(pb, shift - 2, (!!flag) << 1);
     }
 
     for (int n = 0; n < nsamples; n++) {
@@ -1034,7 +1448,7 @@ class EncoderADPCM_ARGO : public ADPCMEncoder {
 
       error += abs(samples[n] - sample);
 
-      if (pb) put_bits(pb, 4, nibble);
+      if (pb) put_nibble(pb, nibble);
     }
 
     return error;
@@ -1042,8 +1456,8 @@ class EncoderADPCM_ARGO : public ADPCMEncoder {
 
   int adpcm_encode_frame_impl(AVPacket *avpkt, const AVFrame *frame,
                               int *got_packet_ptr) {
-    PutBitContext pb;
-    init_put_bits(&pb, dst, pkt_size);
+    PutNibbleContext pb;
+    init_put_nibbles(&pb, dst, pkt_size);
 
     av_assert(frame->nb_samples == 32);
 
@@ -1076,7 +1490,7 @@ class EncoderADPCM_ARGO : public ADPCMEncoder {
                                 frame->nb_samples, shift, flag);
     }
 
-    flush_put_bits(&pb);
+    flush_put_nibbles(&pb);
     return AV_OK;
   }
 };
@@ -1096,8 +1510,18 @@ class EncoderADPCM_IMA_WS : public ADPCMEncoder {
 
   int adpcm_encode_frame_impl(AVPacket *avpkt, const AVFrame *frame,
                               int *got_packet_ptr) {
-    PutBitContext pb;
-    init_put_bits(&pb, dst, pkt_size);
+    return compress(frame, samples);
+  }
+
+  int convert_frame_impl(AVPacket *avpkt, const AVFrame *frame,
+                         int *got_packet_ptr) {
+    return compressConverted(*this, frame);
+  }
+
+  template <class In>
+  int compress(const AVFrame *frame, In samples) {
+    PutNibbleContext pb;
+    init_put_nibbles(&pb, dst, pkt_size);
 
     av_assert(avctx.trellis == 0);
     for (int n = frame->nb_samples / 2; n > 0; n--) {
@@ -1106,12 +1530,11 @@ class EncoderADPCM_IMA_WS : public ADPCMEncoder {
         int t1, t2;
         t1 = adpcm_ima_compress_sample(&c->status[ch], *samples++);
         t2 = adpcm_ima_compress_sample(&c->status[ch], samples[st]);
-        put_bits(&pb, 4, t2);
-        put_bits(&pb, 4, t1);
+        put_nibble_pair(&pb, t1, t2);
       }
       samples += channels();
     }
-    flush_put_bits(&pb);
+    flush_put_nibbles(&pb);
     return AV_OK;
   }
 };
@@ -1119,6 +1542,10 @@ class EncoderADPCM_IMA_WS : public ADPCMEncoder {
 class ADPCMEncoderFactory {
  public:
   static ADPCMEncoder *create(AVCodecID id) {
+    if (!ADPCMDescriptors::hasEncoder(id)) {
+      av_log(avctx, AV_LOG_ERROR, "ERROR: encoder [%d] not supported\n", id);
+      return nullptr;
+    }
     switch (id) {
       case AV_CODEC_ID_ADPCM_IMA_WAV:
         return new EncoderADPCM_IMA_WAV();
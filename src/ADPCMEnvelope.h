@@ -0,0 +1,273 @@
+#pragma once
+#include <math.h>
+#include <stdint.h>
+#include "ADPCMVector.h"
+
+namespace adpcm_ffmpeg {
+
+/**
+ * @brief Minimum, maximum and energy of the samples of a channel in a bucket
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+struct ADPCMEnvelopeBucket {
+  int16_t min = 32767;
+  int16_t max = -32768;
+  /// number of samples which were added
+  uint32_t count = 0;
+  uint64_t sum_squares = 0;
+
+  /// Root mean square of the samples (0 if the bucket is empty)
+  float rms() const {
+    return count == 0 ? 0.0f : sqrtf((float)sum_squares / count);
+  }
+
+  void add(int16_t sample) {
+    if (sample < min) min = sample;
+    if (sample > max) max = sample;
+    sum_squares += sample * sample;
+    count++;
+  }
+
+  void merge(const ADPCMEnvelopeBucket &other) {
+    if (other.count == 0) return;
+    if (other.min < min) min = other.min;
+    if (other.max > max) max = other.max;
+    sum_squares += other.sum_squares;
+    count += other.count;
+  }
+};
+
+/**
+ * @brief Waveform overview: the samples of each channel are summarized in
+ * buckets of a fixed number of samples, e.g. one bucket per pixel. It is
+ * filled with ADPCMDecoder::summarize() or ADPCMWavReader::summarize(), so
+ * that the decoded audio is never stored. Envelopes which were filled from
+ * different parts of the stream (e.g. in separate threads) can be combined
+ * with merge().
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+class ADPCMEnvelope {
+ public:
+  ADPCMEnvelope() = default;
+  ADPCMEnvelope(const ADPCMEnvelope &) = delete;
+  ADPCMEnvelope &operator=(const ADPCMEnvelope &) = delete;
+
+  /// Reserves the buckets for totalSamples samples per channel: if the
+  /// length is not known (0) the buckets are added while summarizing
+  bool begin(int bucketSamples, int channels, uint64_t totalSamples = 0) {
+    if (bucketSamples <= 0 || channels <= 0) return false;
+    bucket_samples = bucketSamples;
+    channel_count = channels;
+    buckets.resize((totalSamples + bucketSamples - 1) / bucketSamples *
+                   channels);
+    clear();
+    setPosition(0);
+    return true;
+  }
+
+  /// Releases the buckets
+  void end() {
+    buckets.resize(0);
+    bucket_samples = channel_count = 0;
+  }
+
+  /// Resets all buckets to empty
+  void clear() {
+    for (int j = 0; j < buckets.size(); j++)
+      buckets[j] = ADPCMEnvelopeBucket();
+  }
+
+  /// Defines the sample (per channel) of the stream which is added next
+  void setPosition(uint64_t sample) {
+    if (bucket_samples == 0) return;
+    bucket_index = sample / bucket_samples;
+    remaining = bucket_samples - sample % bucket_samples;
+    channel = 0;
+  }
+
+  /// Adds the next interleaved sample
+  void add(int16_t sample) {
+    size_t index = bucket_index * channel_count + channel;
+    if (index >= (size_t)buckets.size()) grow(index);
+    buckets[index].add(sample);
+    if (++channel == channel_count) {
+      channel = 0;
+      if (--remaining == 0) {
+        bucket_index++;
+        remaining = bucket_samples;
+      }
+    }
+  }
+
+  /// Moves the position by n samples per channel
+  void advance(int n) {
+    setPosition(bucket_index * bucket_samples + bucket_samples - remaining + n);
+  }
+
+  /// Combines the buckets with an envelope of the same layout
+  bool merge(ADPCMEnvelope &other) {
+    if (other.bucket_samples != bucket_samples ||
+        other.channel_count != channel_count)
+      return false;
+    if (other.buckets.size() > buckets.size())
+      grow(other.buckets.size() - 1);
+    for (int j = 0; j < other.buckets.size(); j++)
+      buckets[j].merge(other.buckets[j]);
+    return true;
+  }
+
+  /// Number of buckets per channel
+  int count() {
+    return channel_count == 0 ? 0 : buckets.size() / channel_count;
+  }
+
+  int bucketSamples() { return bucket_samples; }
+
+  int channels() { return channel_count; }
+
+  const ADPCMEnvelopeBucket &bucket(int index, int channel) {
+    return buckets[index * channel_count + channel];
+  }
+
+ protected:
+  friend class ADPCMEnvelopeCollector;
+  ADPCMVector<ADPCMEnvelopeBucket> buckets;
+  int bucket_samples = 0;
+  int channel_count = 0;
+  // position of the next sample
+  uint64_t bucket_index = 0;
+  int remaining = 0;
+  int channel = 0;
+
+  /// Adds the buckets up to the index: the capacity is doubled, so that
+  /// add() rarely needs to allocate
+  void grow(size_t index) {
+    int size = buckets.size();
+    int new_size = (index / channel_count + 1) * channel_count;
+    if (new_size > buckets.capacity())
+      buckets.resize(new_size > 2 * size ? new_size : 2 * size);
+    buckets.resize(new_size);
+    for (int j = size; j < new_size; j++) buckets[j] = ADPCMEnvelopeBucket();
+  }
+};
+
+/**
+ * @brief Receives the samples of a decoded frame from the decoder kernel and
+ * accumulates them per channel and bucket of an envelope, so that the frame
+ * does not need to be stored. The samples of each channel must be provided
+ * in increasing order. The result is only added to the envelope by
+ * commit(), so that an invalid packet leaves the envelope unchanged.
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+class ADPCMEnvelopeCollector {
+ public:
+  static constexpr int max_channels = 2;
+  /// buckets which a frame can span
+  static constexpr int max_buckets = 8;
+
+  /// Collects at most maxSamples samples per frame for the envelope
+  ADPCMEnvelopeCollector(ADPCMEnvelope &envelope, int maxSamples)
+      : envelope(envelope), max_samples(maxSamples) {}
+
+  /// Prepares the collection of the frame at the position of the envelope:
+  /// returns false if the frame spans too many buckets or channels
+  bool begin(int frameSize) {
+    channel_count = envelope.channels();
+    bucket_samples = envelope.bucketSamples();
+    limit = frameSize < max_samples ? frameSize : max_samples;
+    first_samples = envelope.remaining;
+    int spanned = 1;
+    if (limit > first_samples)
+      spanned += (limit - first_samples + bucket_samples - 1) / bucket_samples;
+    active = channel_count <= max_channels && bucket_samples > 0 &&
+             spanned <= max_buckets;
+    for (int ch = 0; active && ch < channel_count; ch++) {
+      Channel &c = channels[ch];
+      c.bucket = 0;
+      c.end = first_samples < limit ? first_samples : limit;
+      c.lo = 32767;
+      c.hi = -32768;
+      c.sum = 0;
+    }
+    return active;
+  }
+
+  /// true if the samples of the last frame were collected
+  bool isActive() { return active; }
+
+  /// Adds the sample with the index in the frame to the channel
+  inline void put(int channel, int index, int sample) {
+    Channel &c = channels[channel];
+    if (index >= c.end) next(c);
+    c.lo = sample < c.lo ? sample : c.lo;
+    c.hi = sample > c.hi ? sample : c.hi;
+    c.sum += (uint32_t)(sample * sample);
+  }
+
+  /// Adds the first n samples per channel to the envelope and moves its
+  /// position
+  void commit(int n) {
+    for (int ch = 0; ch < channel_count; ch++) {
+      Channel &c = channels[ch];
+      store(c);
+      for (int b = 0; b < max_buckets; b++) {
+        int start = b == 0 ? 0 : first_samples + (b - 1) * bucket_samples;
+        int end = b == 0 ? first_samples : start + bucket_samples;
+        int count = (end < n ? end : n) - start;
+        if (count <= 0) break;
+        ADPCMEnvelopeBucket &bucket = c.pending[b];
+        bucket.count = count;
+        size_t pos = (envelope.bucket_index + b) * channel_count + ch;
+        if (pos >= (size_t)envelope.buckets.size()) envelope.grow(pos);
+        envelope.buckets[pos].merge(bucket);
+      }
+    }
+    envelope.advance(n);
+  }
+
+ protected:
+  struct Channel {
+    int lo, hi;
+    uint64_t sum;
+    // index which starts the next bucket
+    int end;
+    int bucket;
+    // the last entry collects the samples after the limit
+    ADPCMEnvelopeBucket pending[max_buckets + 1];
+  };
+  Channel channels[max_channels];
+  ADPCMEnvelope &envelope;
+  int max_samples;
+  bool active = false;
+  int channel_count = 0;
+  int bucket_samples = 0;
+  int first_samples = 0;
+  int limit = 0;
+
+  void store(Channel &c) {
+    ADPCMEnvelopeBucket &bucket = c.pending[c.bucket];
+    bucket.min = c.lo;
+    bucket.max = c.hi;
+    bucket.sum_squares = c.sum;
+  }
+
+  void next(Channel &c) {
+    store(c);
+    c.lo = 32767;
+    c.hi = -32768;
+    c.sum = 0;
+    if (c.end >= limit) {
+      c.bucket = max_buckets;
+      c.end = INT32_MAX;
+      return;
+    }
+    c.bucket++;
+    c.end += bucket_samples;
+    if (c.end > limit) c.end = limit;
+  }
+};
+
+}  // namespace adpcm_ffmpeg
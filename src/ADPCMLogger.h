@@ -0,0 +1,162 @@
+#pragma once
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "adpcm-ffmpeg/config-adpcm.h"
+#ifdef ARDUINO
+#include "Arduino.h"
+#else
+#include <atomic>
+#include <chrono>
+#endif
+
+// Log levels used by av_log(): messages with a level above ADPCM_LOG_LEVEL
+// are removed at compile time
+#define AV_LOG_QUIET -8
+#define AV_LOG_ERROR 16
+#define AV_LOG_WARNING 24
+#define AV_LOG_INFO 32
+#define AV_LOG_DEBUG 48
+
+namespace adpcm_ffmpeg {
+
+/**
+ * @brief Receives the messages of av_log() and avpriv_request_sample(). The
+ * number of messages is limited per time period, so that a corrupt stream
+ * can not flood the output. The default implementation does no I/O: the
+ * messages are kept in a fixed queue of ADPCM_LOG_QUEUE_SIZE entries which
+ * is drained with read() or flush() outside of the audio thread. If the
+ * queue is full, new messages are dropped. Subclass it and override write()
+ * to redirect the messages, and register the instance with setInstance().
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+class ADPCMLogger {
+ public:
+  virtual ~ADPCMLogger() = default;
+
+  /// Formats and forwards the message if it is within the rate limit
+  void log(int level, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    vlog(level, fmt, args);
+    va_end(args);
+  }
+
+  void vlog(int level, const char *fmt, va_list args) {
+    if (!isWithinRateLimit()) {
+      suppressed_count++;
+      return;
+    }
+    char msg[ADPCM_LOG_BUFFER_SIZE];
+    vsnprintf(msg, sizeof(msg), fmt, args);
+    write(level, msg);
+  }
+
+  /// Defines the max number of messages per period: 0 messages suppresses
+  /// all output
+  void setRateLimit(int messages, uint32_t periodMs) {
+    max_messages = messages;
+    period_ms = periodMs;
+    count = 0;
+  }
+
+  /// Number of messages which were dropped because of the rate limit or
+  /// because the queue was full
+  uint32_t suppressedCount() { return suppressed_count; }
+
+  /// Number of queued messages
+  int available() { return (uint16_t)(write_pos - read_pos); }
+
+  /// Removes the oldest queued message: returns false if there is none
+  bool read(char *msg, size_t len, int *level = nullptr) {
+    if (available() == 0) return false;
+    Entry &entry = queue[read_pos % ADPCM_LOG_QUEUE_SIZE];
+    if (level != nullptr) *level = entry.level;
+    if (msg != nullptr && len > 0) snprintf(msg, len, "%s", entry.msg);
+    read_pos = read_pos + 1;
+    return true;
+  }
+
+  /// Writes the queued messages to stderr: call it outside of the audio
+  /// thread
+  void flush() {
+    char msg[ADPCM_LOG_BUFFER_SIZE];
+    while (read(msg, sizeof(msg))) fputs(msg, stderr);
+  }
+
+  /// Provides the active logger
+  static ADPCMLogger &instance() { return *active(); }
+
+  /// Defines the active logger: nullptr restores the default
+  static void setInstance(ADPCMLogger *logger) {
+    active() = logger != nullptr ? logger : &defaultInstance();
+  }
+
+ protected:
+  int max_messages = 10;
+  uint32_t period_ms = 1000;
+  uint32_t period_start = 0;
+  int count = 0;
+  uint32_t suppressed_count = 0;
+  static_assert((ADPCM_LOG_QUEUE_SIZE & (ADPCM_LOG_QUEUE_SIZE - 1)) == 0,
+                "ADPCM_LOG_QUEUE_SIZE must be a power of 2");
+  struct Entry {
+    int level;
+    char msg[ADPCM_LOG_BUFFER_SIZE];
+  } queue[ADPCM_LOG_QUEUE_SIZE];
+  // single producer (write) and single consumer (read)
+#ifdef ARDUINO
+  volatile uint16_t write_pos = 0;
+  volatile uint16_t read_pos = 0;
+#else
+  std::atomic<uint16_t> write_pos{0};
+  std::atomic<uint16_t> read_pos{0};
+#endif
+
+  /// Output of a formatted message: the default queues it
+  virtual void write(int level, const char *msg) {
+    if (available() >= ADPCM_LOG_QUEUE_SIZE) {
+      suppressed_count++;
+      return;
+    }
+    Entry &entry = queue[write_pos % ADPCM_LOG_QUEUE_SIZE];
+    entry.level = level;
+    snprintf(entry.msg, sizeof(entry.msg), "%s", msg);
+    write_pos = write_pos + 1;
+  }
+
+  /// Time in milliseconds used for the rate limit
+  virtual uint32_t timeMs() {
+#ifdef ARDUINO
+    return millis();
+#else
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+#endif
+  }
+
+  bool isWithinRateLimit() {
+    uint32_t now = timeMs();
+    if (count == 0 || now - period_start >= period_ms) {
+      period_start = now;
+      count = 0;
+    }
+    if (count >= max_messages) return false;
+    count++;
+    return true;
+  }
+
+  static ADPCMLogger &defaultInstance() {
+    static ADPCMLogger logger;
+    return logger;
+  }
+
+  static ADPCMLogger *&active() {
+    static ADPCMLogger *p_logger = &defaultInstance();
+    return p_logger;
+  }
+};
+
+}  // namespace adpcm_ffmpeg
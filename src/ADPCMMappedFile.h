@@ -0,0 +1,98 @@
+#pragma once
+#include <stdio.h>
+#include "adpcm-ffmpeg/adpcm.h"
+#include "ADPCMVector.h"
+#if ADPCM_WAV_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace adpcm_ffmpeg {
+
+/**
+ * @brief Read only access to the content of a file: the file is mapped into
+ * memory with mmap() if ADPCM_WAV_MMAP is active, otherwise it is read into
+ * a buffer.
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+class ADPCMMappedFile {
+ public:
+  ADPCMMappedFile() = default;
+  ADPCMMappedFile(const ADPCMMappedFile &) = delete;
+  ADPCMMappedFile &operator=(const ADPCMMappedFile &) = delete;
+
+  ~ADPCMMappedFile() { close(); }
+
+  /// Provides the content of the file: sequential is a hint for the access
+  /// pattern
+  bool open(const char *path, bool sequential = true) {
+    close();
+#if ADPCM_WAV_MMAP
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) {
+      av_log(NULL, AV_LOG_ERROR, "could not open %s\n", path);
+      return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+      ::close(fd);
+      return false;
+    }
+    void *map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) {
+      av_log(NULL, AV_LOG_ERROR, "could not map %s\n", path);
+      return false;
+    }
+    madvise(map, st.st_size, sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+    p_data = (const uint8_t *)map;
+    data_size = st.st_size;
+    return true;
+#else
+    FILE *file = fopen(path, "rb");
+    if (file == nullptr) {
+      av_log(NULL, AV_LOG_ERROR, "could not open %s\n", path);
+      return false;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    if (size > 0) {
+      content.resize(size);
+      size = fread(&content[0], 1, size, file);
+    }
+    fclose(file);
+    if (size <= 0) {
+      content.resize(0);
+      return false;
+    }
+    p_data = &content[0];
+    data_size = size;
+    return true;
+#endif
+  }
+
+  /// Releases the mapping or the buffer
+  void close() {
+#if ADPCM_WAV_MMAP
+    if (p_data != nullptr) munmap((void *)p_data, data_size);
+#endif
+    content.resize(0);
+    p_data = nullptr;
+    data_size = 0;
+  }
+
+  const uint8_t *data() { return p_data; }
+
+  size_t size() { return data_size; }
+
+ protected:
+  const uint8_t *p_data = nullptr;
+  size_t data_size = 0;
+  ADPCMVector<uint8_t> content{0};
+};
+
+}  // namespace adpcm_ffmpeg
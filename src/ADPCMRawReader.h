@@ -0,0 +1,58 @@
+#pragma once
+#include "ADPCMWav.h"
+
+namespace adpcm_ffmpeg {
+
+/**
+ * @brief Reads a raw ADPCM stream without container, e.g. of the IMA_SSI,
+ * IMA_APM, IMA_ALP, IMA_WS or IMA_OKI codecs: the stream is split into
+ * packets of a fixed size, which are decoded, summarized, indexed and seeked
+ * like the blocks of a WAV file. The stream must start at a packet boundary
+ * and only the last packet can be shorter. The codec must derive the frame
+ * size from the packet size.
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+class ADPCMRawReader : public ADPCMWavReader {
+ public:
+  /// Maps the file into memory: the packet size is used as block size of
+  /// the decoder
+  bool open(const char *path, AVCodecID id, int sampleRate, int channels,
+            int packetSize) {
+    end();
+    return file.open(path) && describe(file.data(), file.size(), id,
+                                       sampleRate, channels, packetSize);
+  }
+
+  /// Defines a stream which is already in memory: the memory must stay
+  /// valid until end()
+  bool begin(const uint8_t *data, size_t size, AVCodecID id, int sampleRate,
+             int channels, int packetSize) {
+    end();
+    return describe(data, size, id, sampleRate, channels, packetSize);
+  }
+
+ protected:
+  bool describe(const uint8_t *data, size_t size, AVCodecID id,
+                int sampleRate, int channels, int packetSize) {
+    const ADPCMDescriptor *desc = ADPCMDescriptors::find(id);
+    if (desc == nullptr || !desc->has_decoder || desc->frame_size == nullptr ||
+        channels < desc->min_channels || channels > desc->max_channels ||
+        sampleRate <= 0 || packetSize <= 0 || data == nullptr) {
+      av_log(NULL, AV_LOG_ERROR, "raw stream not supported\n");
+      return false;
+    }
+    p_buffer = data;
+    buffer_size = size;
+    wav_info.codec_id = id;
+    wav_info.channels = channels;
+    wav_info.sample_rate = sampleRate;
+    wav_info.block_align = packetSize;
+    wav_info.samples_per_block = desc->frame_size(packetSize, channels);
+    wav_info.data = data;
+    wav_info.data_size = size;
+    return true;
+  }
+};
+
+}  // namespace adpcm_ffmpeg
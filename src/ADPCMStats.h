@@ -0,0 +1,52 @@
+#pragma once
+#include <stdint.h>
+#include "adpcm-ffmpeg/config-adpcm.h"
+
+#if ADPCM_STATS && !defined(ADPCM_STATS_NS)
+#include <chrono>
+/// Monotonic time in nanoseconds which is used to measure the processing time
+#define ADPCM_STATS_NS()                                     \
+  ((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>( \
+       std::chrono::steady_clock::now().time_since_epoch())  \
+       .count())
+#endif
+
+/// Updates a counter of the active stream: this is removed if ADPCM_STATS is
+/// not active
+#if ADPCM_STATS
+#define ADPCM_STATS_ADD(field, value) (p_stats->field += (value))
+#else
+#define ADPCM_STATS_ADD(field, value)
+#endif
+
+namespace adpcm_ffmpeg {
+
+/**
+ * @brief Counters which are collected by an encoder or decoder if
+ * ADPCM_STATS is active. The decoder counts the consumed bytes and the
+ * decoded samples, the encoder the encoded samples and the produced bytes.
+ * The calls with an ADPCMStreamState count in the stream state, the other
+ * calls in the codec.
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+struct ADPCMStats {
+  /// number of processed frames
+  uint32_t frames = 0;
+  /// number of processed samples per channel
+  uint64_t samples = 0;
+  /// number of consumed (decoder) or produced (encoder) bytes
+  uint64_t bytes = 0;
+  /// samples which were saturated to the 16 bit range
+  uint32_t clips = 0;
+  /// packets or frames which were rejected with an error
+  uint32_t invalid_packets = 0;
+  /// step index or step size updates which ended at the lower limit
+  uint32_t step_floor = 0;
+  /// step index or step size updates which ended at the upper limit
+  uint32_t step_ceiling = 0;
+  /// time spent in decode_frame_impl or adpcm_encode_frame_impl
+  uint64_t ns = 0;
+};
+
+}  // namespace adpcm_ffmpeg
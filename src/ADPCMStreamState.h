@@ -0,0 +1,174 @@
+#pragma once
+#include "adpcm-ffmpeg/adpcm.h"
+#include "ADPCMDescriptor.h"
+#include "ADPCMStats.h"
+#include "string.h"
+
+namespace adpcm_ffmpeg {
+
+/**
+ * @brief Channel state of the IMA codecs: the predictor (decoder) or the
+ * previous sample (encoder) and the step index.
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+struct ADPCMChannelStateIMA {
+  static const ADPCMStateFamily family = ADPCM_STATE_IMA;
+  int16_t sample;
+  int16_t step_index;
+
+  void load(ADPCMChannelStatus &cs, bool isEncoder) const {
+    if (isEncoder)
+      cs.prev_sample = sample;
+    else
+      cs.predictor = sample;
+    cs.step_index = step_index;
+  }
+
+  void save(const ADPCMChannelStatus &cs, bool isEncoder) {
+    sample = isEncoder ? cs.prev_sample : cs.predictor;
+    step_index = cs.step_index;
+  }
+};
+
+/**
+ * @brief Channel state of the codecs with an adaptive step size (Yamaha, CT,
+ * AGM, MTAF)
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+struct ADPCMChannelStateStep {
+  static const ADPCMStateFamily family = ADPCM_STATE_STEP;
+  int16_t predictor;
+  int16_t step;
+
+  void load(ADPCMChannelStatus &cs, bool /*isEncoder*/) const {
+    cs.predictor = predictor;
+    cs.step = step;
+  }
+
+  void save(const ADPCMChannelStatus &cs, bool /*isEncoder*/) {
+    predictor = cs.predictor;
+    step = cs.step;
+  }
+};
+
+/**
+ * @brief Channel state of the 2-tap LPC codecs (MS, XA, ARGO): the last two
+ * samples and the adaptive delta
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+struct ADPCMChannelStateLPC {
+  static const ADPCMStateFamily family = ADPCM_STATE_LPC;
+  int16_t sample1;
+  int16_t sample2;
+  int32_t idelta;
+
+  void load(ADPCMChannelStatus &cs, bool /*isEncoder*/) const {
+    cs.sample1 = sample1;
+    cs.sample2 = sample2;
+    cs.idelta = idelta;
+  }
+
+  void save(const ADPCMChannelStatus &cs, bool /*isEncoder*/) {
+    sample1 = cs.sample1;
+    sample2 = cs.sample2;
+    idelta = cs.idelta;
+  }
+};
+
+/**
+ * @brief Complete channel state: can be used with all codecs
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+struct ADPCMChannelStateFull {
+  static const ADPCMStateFamily family = ADPCM_STATE_FULL;
+  ADPCMChannelStatus status;
+
+  void load(ADPCMChannelStatus &cs, bool /*isEncoder*/) const { cs = status; }
+
+  void save(const ADPCMChannelStatus &cs, bool /*isEncoder*/) { status = cs; }
+};
+
+/**
+ * @brief State of an individual stream: A single encoder or decoder can
+ * process many streams one after the other if each of them provides its own
+ * state. The codec still holds the buffers and the scratch variables of the
+ * call, so it is not const and must not be used by several threads at the
+ * same time: use one codec per thread, which serves the streams of that
+ * thread. The channel state type must match the
+ * ADPCMDescriptor::state_family of the codec or be ADPCMChannelStateFull.
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+template <class S, int N = ADPCM_STREAM_MAX_CHANNELS>
+struct ADPCMStreamStateT {
+  static const int max_channels = N;
+  S channel[N];
+  uint8_t vqa_version;
+  uint8_t has_status;
+#if ADPCM_STATS
+  ADPCMStats stats_data;
+#endif
+
+  /// Checks if the state can be used with the indicated codec
+  static bool isSupported(const ADPCMDescriptor *desc, int channels) {
+    if (desc == nullptr || channels > N) return false;
+    return S::family == ADPCM_STATE_FULL || S::family == desc->state_family;
+  }
+
+  /// Copies the state into the codec's channel status
+  void load(ADPCMChannelStatus *status, int channels, bool isEncoder) const {
+    for (int ch = 0; ch < channels; ch++) {
+      memset(&status[ch], 0, sizeof(ADPCMChannelStatus));
+      channel[ch].load(status[ch], isEncoder);
+    }
+  }
+
+  /// Stores the codec's channel status: the counters are kept
+  void save(const ADPCMChannelStatus *status, int channels, bool isEncoder) {
+    memset(channel, 0, sizeof(channel));
+    vqa_version = has_status = 0;
+    for (int ch = 0; ch < channels; ch++) channel[ch].save(status[ch], isEncoder);
+  }
+
+  /// Provides a snapshot of the counters of the stream: they are only
+  /// collected if ADPCM_STATS is active, otherwise all values are 0
+  ADPCMStats stats() const {
+#if ADPCM_STATS
+    return stats_data;
+#else
+    return ADPCMStats();
+#endif
+  }
+
+  /// Sets all counters of the stream to 0
+  void resetStats() {
+#if ADPCM_STATS
+    stats_data = ADPCMStats();
+#endif
+  }
+
+  /// Counters which are updated while the stream is processed (nullptr if
+  /// ADPCM_STATS is not active)
+  ADPCMStats *statsData() {
+#if ADPCM_STATS
+    return &stats_data;
+#else
+    return nullptr;
+#endif
+  }
+};
+
+/// Stream state which can be used with all codecs
+using ADPCMStreamState = ADPCMStreamStateT<ADPCMChannelStateFull>;
+/// 4 bytes per channel
+using ADPCMStreamStateIMA = ADPCMStreamStateT<ADPCMChannelStateIMA>;
+/// 4 bytes per channel
+using ADPCMStreamStateStep = ADPCMStreamStateT<ADPCMChannelStateStep>;
+/// 8 bytes per channel
+using ADPCMStreamStateLPC = ADPCMStreamStateT<ADPCMChannelStateLPC>;
+
+}  // namespace adpcm_ffmpeg
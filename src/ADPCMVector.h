@@ -3,6 +3,9 @@
 #include "InitializerList.h"
 #endif
 #include <assert.h>
+#include <string.h>
+#include <new>
+#include "ADPCMAllocator.h"
 
 namespace adpcm_ffmpeg {
 
@@ -330,13 +333,13 @@ class ADPCMVector {
 
   void reset() {
     clear();
-    shrink_to_fit();
-    deleteArray(p_data, size());  // delete [] this->p_data;
+    deleteArray(p_data, bufferLen);
     p_data = nullptr;
+    bufferLen = 0;
   }
 
   void clearContent(){
-    memset(p_data, 0, size());
+    memset((void *)p_data, 0, size() * sizeof(T));
   }
 
  protected:
@@ -359,25 +362,36 @@ class ADPCMVector {
           // clear to prevent double release
           memset((void*)oldData, 0, len * sizeof(T));
         }
-        if (shrink) {
-          cleanup(oldData, newSize, oldBufferLen);
-        }
-        deleteArray(oldData, oldBufferLen);  // delete [] oldData;
+        deleteArray(oldData, oldBufferLen);
       }
     }
   }
 
+  /// Allocates the array with the active ADPCMAllocator
   T *newArray(int newSize) {
-    T *data;
-    data = new T[newSize];
+#if defined(NO_INPLACE_INIT_SUPPORT)
+    return new T[newSize];
+#else
+    T *data =
+        (T *)ADPCMAllocator::instance().allocate(newSize * sizeof(T));
+    if (data == nullptr) return nullptr;
+    for (int j = 0; j < newSize; j++) {
+      new (&data[j]) T();
+    }
     return data;
+#endif
   }
 
   void deleteArray(T *oldData, int oldBufferLen) {
+    if (oldData == nullptr) return;
+#if defined(NO_INPLACE_INIT_SUPPORT)
     delete[] oldData;
+#else
+    cleanup(oldData, 0, oldBufferLen);
+    ADPCMAllocator::instance().release(oldData);
+#endif
   }
 
-
   void cleanup(T *data, int from, int to) {
     for (int j = from; j < to; j++) {
       data[j].~T();
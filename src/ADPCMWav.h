@@ -0,0 +1,580 @@
+#pragma once
+#include <stdio.h>
+#include <string.h>
+#include "ADPCMCheckpointIndex.h"
+#include "ADPCMDecoder.h"
+#include "ADPCMEncoder.h"
+#include "ADPCMEnvelope.h"
+#include "ADPCMMappedFile.h"
+#include "ADPCMVector.h"
+
+namespace adpcm_ffmpeg {
+
+/// WAVE format tag of a codec
+struct ADPCMWavFormatTag {
+  uint16_t tag;
+  AVCodecID id;
+};
+
+static constexpr ADPCMWavFormatTag adpcm_wav_format_tags[] = {
+    {0x0002, AV_CODEC_ID_ADPCM_MS},      {0x0011, AV_CODEC_ID_ADPCM_IMA_WAV},
+    {0x0020, AV_CODEC_ID_ADPCM_YAMAHA},  {0x0061, AV_CODEC_ID_ADPCM_IMA_DK4},
+    {0x0062, AV_CODEC_ID_ADPCM_IMA_DK3}, {0x0200, AV_CODEC_ID_ADPCM_CT},
+    {0x5346, AV_CODEC_ID_ADPCM_SWF},
+};
+
+#define ADPCM_WAV_FORMAT_EXTENSIBLE 0xFFFE
+
+/**
+ * @brief Properties of a WAV file which were parsed from the fmt, fact and
+ * data chunks. The pointers refer to the memory of the file.
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+struct ADPCMWavInfo {
+  uint16_t format_tag = 0;
+  /// AV_CODEC_ID_NONE if the format is not supported
+  AVCodecID codec_id = AV_CODEC_ID_NONE;
+  int channels = 0;
+  int sample_rate = 0;
+  int block_align = 0;
+  int bits_per_sample = 0;
+  /// samples per channel in a block (from the extradata, 0 if not defined)
+  int samples_per_block = 0;
+  /// samples per channel from the fact chunk (0 if not defined)
+  uint32_t total_samples = 0;
+  /// codec specific bytes which follow the WAVEFORMATEX
+  const uint8_t *extradata = nullptr;
+  int extradata_size = 0;
+  /// content of the data chunk
+  const uint8_t *data = nullptr;
+  size_t data_size = 0;
+};
+
+/**
+ * @brief Reads an ADPCM WAV file: the file is mapped into memory and the
+ * blocks are passed to the decoder without copying them. Only the last block
+ * is copied if the file does not provide the AV_INPUT_BUFFER_PADDING_SIZE
+ * bytes which the bitstream readers may read past the end of the packet.
+ * seekToSample() decodes just the block which contains the sample if the
+ * codec has independent blocks, otherwise it starts at the preceding
+ * checkpoint of an ADPCMCheckpointIndex.
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+class ADPCMWavReader {
+ public:
+  ADPCMWavReader() {
+    memset(&empty_frame, 0, sizeof(empty_frame));
+    memset(&seek_frame, 0, sizeof(seek_frame));
+  }
+  ADPCMWavReader(const ADPCMWavReader &) = delete;
+  ADPCMWavReader &operator=(const ADPCMWavReader &) = delete;
+
+  ~ADPCMWavReader() { end(); }
+
+  /// Maps the file into memory and parses the header
+  bool open(const char *path) {
+    end();
+    return file.open(path) && parse(file.data(), file.size());
+  }
+
+  /// Parses a WAV file which is already in memory: the memory must stay
+  /// valid until end()
+  bool begin(const uint8_t *data, size_t size) {
+    end();
+    return parse(data, size);
+  }
+
+  /// Releases the mapping
+  void end() {
+    file.close();
+    p_buffer = nullptr;
+    buffer_size = 0;
+    wav_info = ADPCMWavInfo();
+    next_block = 0;
+    p_index = nullptr;
+  }
+
+  const ADPCMWavInfo &info() { return wav_info; }
+
+  /// Provides the codec of a WAVE format tag (AV_CODEC_ID_NONE if not
+  /// supported)
+  static AVCodecID codecID(uint16_t formatTag) {
+    for (const ADPCMWavFormatTag &entry : adpcm_wav_format_tags)
+      if (entry.tag == formatTag) return entry.id;
+    return AV_CODEC_ID_NONE;
+  }
+
+  /// Provides the WAVE format tag of a codec (0 if not supported)
+  static uint16_t formatTag(AVCodecID id) {
+    for (const ADPCMWavFormatTag &entry : adpcm_wav_format_tags)
+      if (entry.id == id) return entry.tag;
+    return 0;
+  }
+
+  /// Number of blocks in the data chunk: the last block might be incomplete
+  int blockCount() {
+    if (wav_info.block_align <= 0) return 0;
+    return (wav_info.data_size + wav_info.block_align - 1) /
+           wav_info.block_align;
+  }
+
+  /// Configures the decoder from the header and calls begin(): the decoder
+  /// refers to the extradata of the file, so the reader must stay open while
+  /// it is used
+  bool setupDecoder(ADPCMDecoder &decoder) {
+    if (wav_info.codec_id == AV_CODEC_ID_NONE ||
+        decoder.codecID() != wav_info.codec_id) {
+      av_log(NULL, AV_LOG_ERROR, "decoder does not match the WAV format\n");
+      return false;
+    }
+    AVCodecContext &ctx = decoder.ctx();
+    ctx.block_align = wav_info.block_align;
+    ctx.extradata = (uint8_t *)wav_info.extradata;
+    ctx.extradata_size = wav_info.extradata_size;
+    decoder.setBlockSize(wav_info.block_align);
+    decoder.setBitsPerCodedSample(wav_info.bits_per_sample);
+    decoder.setFrameSize(wav_info.samples_per_block);
+    // buffer for a last block without padding: decoding does not allocate
+    tail.resize(wav_info.block_align + AV_INPUT_BUFFER_PADDING_SIZE);
+    next_block = 0;
+    return decoder.begin(wav_info.sample_rate, wav_info.channels);
+  }
+
+  /// Creates and configures the decoder for the file (nullptr if the format
+  /// is not supported)
+  ADPCMDecoder *createDecoder() {
+    ADPCMDecoder *decoder = ADPCMDecoderFactory::create(wav_info.codec_id);
+    if (decoder == nullptr) return nullptr;
+    if (!setupDecoder(*decoder)) {
+      delete decoder;
+      return nullptr;
+    }
+    return decoder;
+  }
+
+  /// Provides the block with the indicated index: the packet points into the
+  /// file
+  bool readBlock(int index, AVPacket &packet) {
+    if (index < 0 || index >= blockCount()) return false;
+    size_t offset = (size_t)index * wav_info.block_align;
+    int size = FFMIN((size_t)wav_info.block_align, wav_info.data_size - offset);
+    const uint8_t *block = wav_info.data + offset;
+    if (block + size + AV_INPUT_BUFFER_PADDING_SIZE > p_buffer + buffer_size) {
+      if (tail.size() < size + AV_INPUT_BUFFER_PADDING_SIZE)
+        tail.resize(size + AV_INPUT_BUFFER_PADDING_SIZE);
+      memcpy(&tail[0], block, size);
+      memset(&tail[size], 0, AV_INPUT_BUFFER_PADDING_SIZE);
+      block = &tail[0];
+    }
+    packet.data = (uint8_t *)block;
+    packet.size = size;
+    return true;
+  }
+
+  /// Decodes the block with the indicated index. The samples of the last
+  /// block are limited to the sample count of the fact chunk.
+  AVFrame &decodeBlock(ADPCMDecoder &decoder, int index) {
+    AVPacket packet;
+    if (!readBlock(index, packet)) return empty_frame;
+    next_block = index + 1;
+    AVFrame &frame = decoder.decode(packet);
+    int64_t start = (int64_t)index * decoder.frameSize();
+    if (wav_info.total_samples > 0 &&
+        start + frame.nb_samples > wav_info.total_samples)
+      frame.nb_samples = FFMAX(0, (int64_t)wav_info.total_samples - start);
+    return frame;
+  }
+
+  /// Decodes the whole stream and records the decoder state every
+  /// intervalBytes (rounded to full blocks). The decoder must have been
+  /// configured with setupDecoder(): it is reset afterwards.
+  bool buildIndex(ADPCMDecoder &decoder, ADPCMCheckpointIndex &index,
+                  size_t intervalBytes) {
+    int interval = FFMAX(1, (int)(intervalBytes / wav_info.block_align));
+    ADPCMStreamState state;
+    if (blockCount() == 0 || !decoder.initState(state)) return false;
+    index.begin(wav_info.codec_id, wav_info.channels, wav_info.block_align,
+                wav_info.data_size, interval);
+    AVPacket packet;
+    for (int j = 0; j < blockCount(); j++) {
+      if (j % interval == 0) index.add(j, state);
+      readBlock(j, packet);
+      decoder.skip(state, packet);
+    }
+    decoder.reset();
+    next_block = 0;
+    return true;
+  }
+
+  /// Defines the index which is used by seekToSample(): returns false if it
+  /// was not created for this file
+  bool setIndex(const ADPCMCheckpointIndex *index) {
+    if (index != nullptr &&
+        !index->matches(wav_info.codec_id, wav_info.channels,
+                        wav_info.block_align, wav_info.data_size)) {
+      av_log(NULL, AV_LOG_ERROR, "index does not match the WAV file\n");
+      p_index = nullptr;
+      return false;
+    }
+    p_index = index;
+    return true;
+  }
+
+  /// Decodes the block which follows the last decoded block
+  AVFrame &decodeNext(ADPCMDecoder &decoder) {
+    return decodeBlock(decoder, next_block);
+  }
+
+  /// Summarizes the indicated blocks into the envelope, which must have been
+  /// started with the outputChannels() of the decoder: blocks < 0 continues
+  /// to the end. The samples are not stored. If the codec has independent
+  /// blocks, disjoint ranges can be summarized in parallel, each with its own
+  /// decoder and envelope: the envelopes are then combined with
+  /// ADPCMEnvelope::merge().
+  bool summarize(ADPCMDecoder &decoder, ADPCMEnvelope &envelope,
+                 int firstBlock = 0, int blocks = -1) {
+    int frame_size = decoder.frameSize();
+    if (frame_size <= 0 || firstBlock < 0 || firstBlock > blockCount())
+      return false;
+    int last = blocks < 0 ? blockCount()
+                          : FFMIN(blockCount(), firstBlock + blocks);
+    bool independent = decoder.hasIndependentBlocks();
+    if (!independent) prepareBlock(decoder, firstBlock);
+    envelope.setPosition((uint64_t)firstBlock * frame_size);
+    AVPacket packet;
+    for (int j = firstBlock; j < last; j++) {
+      readBlock(j, packet);
+      // the last block is limited to the sample count of the fact chunk
+      int64_t available =
+          (int64_t)wav_info.total_samples - (int64_t)j * frame_size;
+      int max_samples = wav_info.total_samples > 0
+                            ? (int)FFMAX(0, FFMIN(available, frame_size))
+                            : frame_size;
+      decoder.summarize(packet, envelope, max_samples);
+    }
+    if (!independent) next_block = last;
+    return true;
+  }
+
+  /// Decodes the block which contains the indicated sample (per channel):
+  /// the result starts at the sample and decodeNext() continues with the
+  /// following block. Only data[0] of the result is valid. If the blocks
+  /// of the codec depend on their predecessors, the blocks are decoded from
+  /// the preceding checkpoint of the index (see setIndex()) or from the
+  /// start, or from the current position if this is closer.
+  AVFrame &seekToSample(ADPCMDecoder &decoder, uint64_t sample) {
+    int frame_size = decoder.frameSize();
+    if (frame_size <= 0) return empty_frame;
+    uint64_t block = sample / frame_size;
+    if (block >= (uint64_t)blockCount()) return empty_frame;
+    prepareBlock(decoder, block);
+    AVFrame *frame = &decodeBlock(decoder, block);
+    int skip = FFMIN((int)(sample % frame_size), frame->nb_samples);
+    seek_frame = *frame;
+    seek_frame.data[0] = frame->data[0] +
+                        skip * decoder.outputChannels() *
+                            decoder.outputSampleSize();
+    seek_frame.extended_data = nullptr;
+    seek_frame.nb_samples = frame->nb_samples - skip;
+    return seek_frame;
+  }
+
+ protected:
+  ADPCMWavInfo wav_info;
+  const uint8_t *p_buffer = nullptr;
+  size_t buffer_size = 0;
+  ADPCMMappedFile file;
+  ADPCMVector<uint8_t> tail{0};
+  AVFrame empty_frame;
+  AVFrame seek_frame;
+  int next_block = 0;
+  const ADPCMCheckpointIndex *p_index = nullptr;
+
+
+  /// Sets up the state of a codec with dependent blocks for the decoding of
+  /// the block: the state is restored from the preceding checkpoint of the
+  /// index or from the start, unless the current position is closer. The
+  /// blocks in between only update the state.
+  void prepareBlock(ADPCMDecoder &decoder, int block) {
+    if (decoder.hasIndependentBlocks()) return;
+    const ADPCMCheckpoint *checkpoint =
+        p_index != nullptr ? p_index->find(block) : nullptr;
+    int start = checkpoint != nullptr ? checkpoint->block : 0;
+    if (block < next_block || start > next_block) {
+      if (checkpoint != nullptr) {
+        ADPCMStreamState state = checkpoint->state;
+        decoder.restoreState(state);
+      } else {
+        decoder.reset();
+      }
+      next_block = start;
+    }
+    AVPacket packet;
+    for (; next_block < block; next_block++) {
+      readBlock(next_block, packet);
+      decoder.skip(packet);
+    }
+  }
+
+  bool parse(const uint8_t *data, size_t size) {
+    p_buffer = data;
+    buffer_size = size;
+    if (size < 12 || memcmp(data, "RIFF", 4) != 0 ||
+        memcmp(data + 8, "WAVE", 4) != 0) {
+      av_log(NULL, AV_LOG_ERROR, "not a WAV file\n");
+      return false;
+    }
+    bool has_fmt = false;
+    size_t pos = 12;
+    while (pos + 8 <= size) {
+      const uint8_t *chunk = data + pos;
+      size_t chunk_size = AV_RL32(chunk + 4);
+      size_t available = size - pos - 8;
+      // streamed files might not define the size of the data chunk
+      if (chunk_size > available) chunk_size = available;
+      if (memcmp(chunk, "fmt ", 4) == 0) {
+        if (!parseFormat(chunk + 8, chunk_size)) return false;
+        has_fmt = true;
+      } else if (memcmp(chunk, "fact", 4) == 0 && chunk_size >= 4) {
+        wav_info.total_samples = AV_RL32(chunk + 8);
+      } else if (memcmp(chunk, "data", 4) == 0) {
+        wav_info.data = chunk + 8;
+        wav_info.data_size = chunk_size;
+      }
+      // chunks are word aligned
+      pos += 8 + chunk_size + (chunk_size & 1);
+    }
+    if (!has_fmt || wav_info.data == nullptr) {
+      av_log(NULL, AV_LOG_ERROR, "fmt or data chunk is missing\n");
+      return false;
+    }
+    return true;
+  }
+
+  bool parseFormat(const uint8_t *fmt, size_t size) {
+    if (size < 16) return false;
+    wav_info.format_tag = AV_RL16(fmt);
+    wav_info.channels = AV_RL16(fmt + 2);
+    wav_info.sample_rate = AV_RL32(fmt + 4);
+    wav_info.block_align = AV_RL16(fmt + 12);
+    wav_info.bits_per_sample = AV_RL16(fmt + 14);
+    if (size >= 18) {
+      int cb_size = FFMIN((size_t)AV_RL16(fmt + 16), size - 18);
+      wav_info.extradata = cb_size > 0 ? fmt + 18 : nullptr;
+      wav_info.extradata_size = cb_size;
+    }
+    // WAVEFORMATEXTENSIBLE: the format tag is the start of the sub format
+    if (wav_info.format_tag == ADPCM_WAV_FORMAT_EXTENSIBLE &&
+        wav_info.extradata_size >= 22) {
+      wav_info.format_tag = AV_RL16(wav_info.extradata + 6);
+      wav_info.extradata_size -= 22;
+      wav_info.extradata =
+          wav_info.extradata_size > 0 ? wav_info.extradata + 22 : nullptr;
+    }
+    wav_info.codec_id = codecID(wav_info.format_tag);
+    if (wav_info.codec_id == AV_CODEC_ID_NONE) {
+      av_log(NULL, AV_LOG_ERROR, "format 0x%04x not supported\n",
+             wav_info.format_tag);
+      return false;
+    }
+    if (wav_info.channels <= 0 || wav_info.block_align <= 0) return false;
+
+    switch (wav_info.codec_id) {
+      case AV_CODEC_ID_ADPCM_IMA_WAV:
+        if (wav_info.extradata_size >= 2)
+          wav_info.samples_per_block = AV_RL16(wav_info.extradata);
+        break;
+      case AV_CODEC_ID_ADPCM_MS:
+        if (wav_info.extradata_size >= 2)
+          wav_info.samples_per_block = AV_RL16(wav_info.extradata);
+        return isStandardCoefficients();
+      default:
+        break;
+    }
+    return true;
+  }
+
+  /// The MS decoder only supports the 7 standard predictor coefficients
+  bool isStandardCoefficients() {
+    const uint8_t *extradata = wav_info.extradata;
+    if (wav_info.extradata_size < 4) return true;
+    int num_coef = AV_RL16(extradata + 2);
+    if (wav_info.extradata_size < 4 + 4 * num_coef) return false;
+    bool ok = num_coef >= 7;
+    for (int i = 0; ok && i < 7; i++) {
+      ok = (int16_t)AV_RL16(extradata + 4 + 4 * i) ==
+               ff_adpcm_AdaptCoeff1[i] * 4 &&
+           (int16_t)AV_RL16(extradata + 6 + 4 * i) ==
+               ff_adpcm_AdaptCoeff2[i] * 4;
+    }
+    if (!ok)
+      av_log(NULL, AV_LOG_ERROR, "MS coefficients not supported\n");
+    return ok;
+  }
+
+};
+
+/**
+ * @brief Writes the packets of an encoder as WAV file: the fmt chunk
+ * contains the extradata of the encoder. The samples can be provided in any
+ * size: incomplete frames are collected and the last frame is filled with
+ * silence. If the file is seekable the chunk sizes are updated by end(),
+ * otherwise they stay at 0xFFFFFFFF.
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+class ADPCMWavWriter {
+ public:
+  ADPCMWavWriter() = default;
+  ADPCMWavWriter(const ADPCMWavWriter &) = delete;
+  ADPCMWavWriter &operator=(const ADPCMWavWriter &) = delete;
+
+  /// Writes the header: the encoder must have been started with begin()
+  bool begin(ADPCMEncoder &encoder, FILE *file) {
+    uint16_t tag = ADPCMWavReader::formatTag(encoder.codecID());
+    if (tag == 0 || file == nullptr || encoder.frameSize() <= 0) {
+      av_log(NULL, AV_LOG_ERROR, "codec not supported in WAV files\n");
+      return false;
+    }
+    p_encoder = &encoder;
+    p_file = file;
+    data_size = 0;
+    total_samples = 0;
+    buffered = 0;
+    frame_samples = encoder.frameSize() * encoder.channels();
+    pcm.resize(frame_samples);
+    return writeHeader(tag);
+  }
+
+  /// Encodes the interleaved samples: returns the number of processed
+  /// samples
+  size_t write(const int16_t *data, size_t sampleCount) {
+    if (p_encoder == nullptr) return 0;
+    size_t result = 0;
+    while (result < sampleCount) {
+      size_t n = FFMIN(sampleCount - result, (size_t)(frame_samples - buffered));
+      memcpy(&pcm[buffered], data + result, n * sizeof(int16_t));
+      buffered += n;
+      result += n;
+      if (buffered == frame_samples && !writeFrame()) break;
+    }
+    return result;
+  }
+
+  /// Encodes the buffered samples and updates the chunk sizes
+  bool end() {
+    if (p_encoder == nullptr) return false;
+    bool ok = true;
+    if (buffered > 0) {
+      int samples = buffered;
+      memset(&pcm[buffered], 0, (frame_samples - buffered) * sizeof(int16_t));
+      buffered = frame_samples;
+      ok = writeFrame();
+      total_samples -= (frame_samples - samples) / p_encoder->channels();
+    }
+    if (data_size & 1) fputc(0, p_file);
+    ok = updateSizes() && ok;
+    p_encoder = nullptr;
+    return ok;
+  }
+
+  /// Number of written samples per channel
+  uint32_t totalSamples() { return total_samples; }
+
+ protected:
+  ADPCMEncoder *p_encoder = nullptr;
+  FILE *p_file = nullptr;
+  ADPCMVector<int16_t> pcm{0};
+  int frame_samples = 0;
+  int buffered = 0;
+  uint32_t data_size = 0;
+  uint32_t total_samples = 0;
+  long riff_pos = 0;
+  long fact_pos = 0;
+  long data_pos = 0;
+
+  bool writeFrame() {
+    AVPacket &packet = p_encoder->encode(&pcm[0], frame_samples);
+    buffered = 0;
+    if (packet.size <= 0) return false;
+    if (fwrite(packet.data, 1, packet.size, p_file) != (size_t)packet.size)
+      return false;
+    data_size += packet.size;
+    total_samples += frame_samples / p_encoder->channels();
+    return true;
+  }
+
+  bool writeHeader(uint16_t tag) {
+    AVCodecContext &ctx = p_encoder->ctx();
+    // IMA_WAV stores the samples per block
+    uint8_t ima_extradata[2];
+    const uint8_t *extradata = ctx.extradata;
+    int extradata_size = ctx.extradata != nullptr ? ctx.extradata_size : 0;
+    if (extradata == nullptr && ctx.codec_id == AV_CODEC_ID_ADPCM_IMA_WAV) {
+      uint8_t *out = ima_extradata;
+      bytestream_put_le16(&out, ctx.frame_size);
+      extradata = ima_extradata;
+      extradata_size = sizeof(ima_extradata);
+    }
+    int fmt_size = 18 + extradata_size;
+    uint32_t byte_rate =
+        (uint64_t)ctx.sample_rate * ctx.block_align / ctx.frame_size;
+
+    uint8_t header[20 + 18];
+    uint8_t *out = header;
+    riff_pos = ftell(p_file);
+    bytestream_put_buffer(&out, (const uint8_t *)"RIFF", 4);
+    bytestream_put_le32(&out, 0xFFFFFFFF);
+    bytestream_put_buffer(&out, (const uint8_t *)"WAVEfmt ", 8);
+    bytestream_put_le32(&out, fmt_size + (fmt_size & 1));
+    bytestream_put_le16(&out, tag);
+    bytestream_put_le16(&out, ctx.nb_channels);
+    bytestream_put_le32(&out, ctx.sample_rate);
+    bytestream_put_le32(&out, byte_rate);
+    bytestream_put_le16(&out, ctx.block_align);
+    bytestream_put_le16(&out, ctx.bits_per_coded_sample);
+    bytestream_put_le16(&out, extradata_size);
+    if (fwrite(header, 1, out - header, p_file) != (size_t)(out - header))
+      return false;
+    if (extradata_size > 0 &&
+        fwrite(extradata, 1, extradata_size, p_file) != (size_t)extradata_size)
+      return false;
+    if (fmt_size & 1) fputc(0, p_file);
+
+    // fact and data chunk: the sizes are updated by end(), readers limit the
+    // undefined sizes to the file size
+    out = header;
+    bytestream_put_buffer(&out, (const uint8_t *)"fact", 4);
+    bytestream_put_le32(&out, 4);
+    bytestream_put_le32(&out, 0);
+    bytestream_put_buffer(&out, (const uint8_t *)"data", 4);
+    bytestream_put_le32(&out, 0xFFFFFFFF);
+    fact_pos = ftell(p_file) + 8;
+    data_pos = fact_pos + 8;
+    return fwrite(header, 1, out - header, p_file) == (size_t)(out - header);
+  }
+
+  bool updateSizes() {
+    long end_pos = ftell(p_file);
+    if (end_pos < 0 || riff_pos < 0) return fflush(p_file) == 0;
+    uint8_t value[4];
+    uint8_t *out = value;
+    bytestream_put_le32(&out, end_pos - riff_pos - 8);
+    bool ok = fseek(p_file, riff_pos + 4, SEEK_SET) == 0 &&
+              fwrite(value, 1, 4, p_file) == 4;
+    out = value;
+    bytestream_put_le32(&out, total_samples);
+    ok = ok && fseek(p_file, fact_pos, SEEK_SET) == 0 &&
+         fwrite(value, 1, 4, p_file) == 4;
+    out = value;
+    bytestream_put_le32(&out, data_size);
+    ok = ok && fseek(p_file, data_pos, SEEK_SET) == 0 &&
+         fwrite(value, 1, 4, p_file) == 4;
+    ok = ok && fseek(p_file, end_pos, SEEK_SET) == 0;
+    return fflush(p_file) == 0 && ok;
+  }
+};
+
+}  // namespace adpcm_ffmpeg
@@ -7,6 +7,8 @@
 #include <string.h>
 #include <limits.h>
 #include "config-adpcm.h"
+#include "../ADPCMAllocator.h"
+#include "../ADPCMLogger.h"
 
 // define some qulifiers used by the code base
 
@@ -26,12 +28,12 @@
 
 #define AVERROR(X) X
 
-// Some define used by logging
-#define AV_LOG_ERROR 16
-#define AV_LOG_WARNING 24
-#define AV_LOG_INFO 32
-
-#define av_log(A, B, ...) printf(__VA_ARGS__);
+// logging via the ADPCMLogger: the level is filtered at compile time
+#define av_log(A, B, ...)                                              \
+  do {                                                                 \
+    if ((B) <= ADPCM_LOG_LEVEL)                                        \
+      adpcm_ffmpeg::ADPCMLogger::instance().log((B), __VA_ARGS__);     \
+  } while (0)
 
 #define FF_ALLOC_TYPED_ARRAY(T, p, nelem) (p = (T) av_malloc_array(nelem, sizeof(*p)))
 #define FF_ARRAY_ELEMS(a) (sizeof(a) / sizeof((a)[0]))
@@ -43,6 +45,7 @@
  * @enum Supported Codec IDs
  */
 enum AVCodecID {
+  AV_CODEC_ID_NONE = 0,
   /* various ADPCM codecs */
   AV_CODEC_ID_ADPCM_IMA_QT = 0x11000,  ///< IMA_QT
   AV_CODEC_ID_ADPCM_IMA_WAV,           ///< IMA_WAV
@@ -227,6 +230,7 @@ struct ADPCMEncodeContext {
   TrellisNode *node_buf;
   TrellisNode **nodep_buf;
   uint8_t *trellis_hash;
+  int frontier;
 };
 
 /**
@@ -977,14 +981,12 @@ av_always_inline av_const int av_clip(int a, int amin, int amax) {
     return a;
 }
 
-void *av_malloc(size_t size) { return malloc(size); }
+void *av_malloc(size_t size) {
+  return ADPCMAllocator::instance().allocate(size);
+}
 
 void av_free(void *ptr) {
-#if HAVE_ALIGNED_MALLOC
-  _aligned_free(ptr);
-#else
-  free(ptr);
-#endif
+  if (ptr) ADPCMAllocator::instance().release(ptr);
 }
 
 void av_freep(void *arg) {
@@ -1050,6 +1052,18 @@ av_always_inline av_const int16_t av_clip_int16(int a) {
     return a;
 }
 
+/**
+ * Clip a signed 64-bit integer value into the -2147483648,2147483647 range.
+ * @param a value to clip
+ * @return clipped value
+ */
+av_always_inline av_const int32_t av_clipl_int32(int64_t a) {
+  if ((a + 0x80000000u) & ~UINT64_C(0xFFFFFFFF))
+    return (int32_t)((a >> 63) ^ 0x7FFFFFFF);
+  else
+    return (int32_t)a;
+}
+
 /**
  * Clip a signed integer into the -(2^p),(2^p-1) range.
  * @param  a value to clip
@@ -1,7 +1,11 @@
 #pragma once
 
 #define av_cold
+#if defined(__GNUC__)
+#define av_always_inline __attribute__((always_inline)) inline
+#else
 #define av_always_inline inline
+#endif
 #define av_const const
 #define av_unused
 #define av_alias
@@ -28,3 +32,50 @@
 #define ADPCM_ADD_NAMESPACE false
 
 
+
+/// Max number of channels which can be stored in an ADPCMStreamState
+#ifndef ADPCM_STREAM_MAX_CHANNELS
+#define ADPCM_STREAM_MAX_CHANNELS 2
+#endif
+
+/// Collect the ADPCMStats counters in the encoders and decoders
+#ifndef ADPCM_STATS
+#define ADPCM_STATS false
+#endif
+
+/// Messages with a higher level are removed at compile time: 16 = errors,
+/// 24 = warnings, 32 = info, -8 = no messages (see ADPCMLogger.h)
+#ifndef ADPCM_LOG_LEVEL
+#define ADPCM_LOG_LEVEL 24
+#endif
+
+/// Max length of a formatted log message
+#ifndef ADPCM_LOG_BUFFER_SIZE
+#define ADPCM_LOG_BUFFER_SIZE 128
+#endif
+
+/// Number of messages the default logger keeps until they are drained (a
+/// power of 2)
+#ifndef ADPCM_LOG_QUEUE_SIZE
+#define ADPCM_LOG_QUEUE_SIZE 8
+#endif
+
+/// ADPCMMappedFile maps the files into memory with mmap(): otherwise
+/// the file is read into a buffer
+#ifndef ADPCM_WAV_MMAP
+#if defined(__unix__) || defined(__APPLE__)
+#define ADPCM_WAV_MMAP true
+#else
+#define ADPCM_WAV_MMAP false
+#endif
+#endif
+
+/// Default thresholds of the ADPCMActivityDetector: blocks with a mean
+/// quantizer step (IMA step or MS idelta) from this value are active
+#ifndef ADPCM_ACTIVITY_IMA_THRESHOLD
+#define ADPCM_ACTIVITY_IMA_THRESHOLD 25
+#endif
+
+#ifndef ADPCM_ACTIVITY_MS_THRESHOLD
+#define ADPCM_ACTIVITY_MS_THRESHOLD 17
+#endif
@@ -423,6 +423,87 @@ static inline void align_put_bits(PutBitContext *s)
     put_bits(s, s->bit_left & 7, 0);
 }
 
+/**
+ * Nibble writer for the 4-bit ADPCM encoders: 16 nibbles are collected in a
+ * 64 bit word which is stored with a single write. The resulting layout is
+ * identical to put_bits(s, 4, value) with BITSTREAM_WRITER_LE: the first
+ * nibble ends up in the low bits of the first byte.
+ */
+typedef struct PutNibbleContext {
+    uint64_t nibble_buf;
+    int nibble_count;
+    uint8_t *buf, *buf_ptr, *buf_end;
+} PutNibbleContext;
+
+/**
+ * Initialize the PutNibbleContext s.
+ *
+ * @param buffer the buffer where to put the nibbles
+ * @param buffer_size the size in bytes of buffer
+ */
+static inline void init_put_nibbles(PutNibbleContext *s, uint8_t *buffer,
+                                    int buffer_size)
+{
+    if (buffer_size < 0) {
+        buffer_size = 0;
+        buffer      = NULL;
+    }
+
+    s->buf          = buffer;
+    s->buf_end      = s->buf + buffer_size;
+    s->buf_ptr      = s->buf;
+    s->nibble_buf   = 0;
+    s->nibble_count = 0;
+}
+
+static inline void put_nibble_word(PutNibbleContext *s)
+{
+    av_assert(s->buf_end - s->buf_ptr >= 8);
+    AV_WL64(s->buf_ptr, s->nibble_buf);
+    s->buf_ptr     += 8;
+    s->nibble_buf   = 0;
+    s->nibble_count = 0;
+}
+
+/**
+ * Write a single 4 bit value.
+ */
+static inline void put_nibble(PutNibbleContext *s, unsigned value)
+{
+    av_assert(value < 16);
+    s->nibble_buf |= (uint64_t)value << (4 * s->nibble_count);
+    if (++s->nibble_count == 16)
+        put_nibble_word(s);
+}
+
+/**
+ * Write 2 nibbles at once: lo is written first. May only be used when an
+ * even number of nibbles has been written so far.
+ */
+static inline void put_nibble_pair(PutNibbleContext *s, unsigned lo,
+                                   unsigned hi)
+{
+    av_assert(lo < 16 && hi < 16 && !(s->nibble_count & 1));
+    s->nibble_buf |= (uint64_t)(lo | (hi << 4)) << (4 * s->nibble_count);
+    s->nibble_count += 2;
+    if (s->nibble_count == 16)
+        put_nibble_word(s);
+}
+
+/**
+ * Store the pending nibbles; an odd nibble count is padded with zero.
+ */
+static inline void flush_put_nibbles(PutNibbleContext *s)
+{
+    for (int i = 0; i < s->nibble_count; i += 2) {
+        av_assert(s->buf_ptr < s->buf_end);
+        *s->buf_ptr++   = s->nibble_buf;
+        s->nibble_buf >>= 8;
+    }
+    s->nibble_buf   = 0;
+    s->nibble_count = 0;
+}
+
 #undef AV_WBBUF
 #undef AV_WLBUF
 
@@ -0,0 +1,245 @@
+/**
+ * Compressed domain activity detection: a speech like signal with gaps of
+ * low level noise and sections at different levels is encoded with IMA_WAV
+ * and MS. Each block is classified by the ADPCMActivityDetector from the
+ * block header and with the state scan and compared with the RMS of the
+ * decoded block (active if above -40 dBFS). We report the accuracy, the false
+ * positives and negatives, and the time compared to a full decode. The
+ * thresholds were calibrated with this signal, so the detector is also
+ * validated with held out audio: tests/test-data/original.wav at different
+ * levels with inserted gaps of silence and noise. The state scan must be
+ * correct for 95% of the blocks of both signals.
+ *
+ * Usage: activity [threshold-ima threshold-ms]
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include "ADPCM.h"
+#include "ADPCMActivity.h"
+#include "../benchmark/SignalGenerator.h"
+
+using namespace adpcm_ffmpeg;
+
+const int sample_rate = 44100;
+const int block_size = 1024;
+const int seconds = 60;
+// -40 dBFS
+const float active_rms = 328.0f;
+const AVCodecID codecs[] = {AV_CODEC_ID_ADPCM_IMA_WAV, AV_CODEC_ID_ADPCM_MS};
+const char *methods[] = {"header", "scan"};
+
+ADPCMVector<int16_t> pcm;
+ADPCMVector<uint8_t> packets;
+ADPCMVector<bool> truth;
+int packet_size = 0;
+int packet_count = 0;
+int thresholds[] = {0, 0};
+int failures = 0;
+// interleaved 16 bit samples of original.wav
+ADPCMVector<int16_t> original;
+int original_channels = 0;
+
+uint64_t now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// alternates speech at different levels with low level noise
+void createSignal(int channels) {
+  const float speech_levels[] = {20000.0f, 4000.0f, 1000.0f};
+  const float noise_levels[] = {0.0f, 30.0f, 150.0f};
+  int segment = sample_rate / 2;
+  pcm.resize(seconds * sample_rate * channels);
+  SignalGenerator speech(Speech, sample_rate, channels);
+  SignalGenerator noise(Noise, sample_rate, channels, 1.0f);
+  for (int j = 0; j < seconds * 2; j++) {
+    int16_t *data = &pcm[j * segment * channels];
+    SignalGenerator &gen = j % 2 == 0 ? speech : noise;
+    float gain = j % 2 == 0 ? speech_levels[(j / 2) % 3] / 20000.0f
+                            : noise_levels[(j / 2) % 3];
+    gen.fill(data, segment);
+    for (int i = 0; i < segment * channels; i++)
+      data[i] = (int16_t)(data[i] * gain);
+  }
+}
+
+// the original is PCM: we just locate the data chunk
+bool loadOriginal(const char *path) {
+  FILE *file = fopen(path, "rb");
+  if (file == nullptr) return false;
+  ADPCMVector<uint8_t> content;
+  fseek(file, 0, SEEK_END);
+  content.resize(ftell(file));
+  fseek(file, 0, SEEK_SET);
+  size_t size = fread(&content[0], 1, content.size(), file);
+  fclose(file);
+  for (size_t pos = 12; pos + 8 <= size;) {
+    uint32_t chunk_size = AV_RL32(&content[pos + 4]);
+    if (memcmp(&content[pos], "fmt ", 4) == 0)
+      original_channels = AV_RL16(&content[pos + 10]);
+    if (memcmp(&content[pos], "data", 4) == 0) {
+      int n = FFMIN(chunk_size, size - pos - 8) / 2;
+      original.resize(n);
+      memcpy(&original[0], &content[pos + 8], n * sizeof(int16_t));
+      return original_channels > 0 && n >= original_channels;
+    }
+    pos += 8 + chunk_size + (chunk_size & 1);
+  }
+  return false;
+}
+
+// the original at different levels (the last one is below -40 dBFS) with
+// gaps of different lengths, which do not end at block boundaries
+void createHeldOut(int channels) {
+  const float levels[] = {1.0f, 0.2f, 0.05f, 0.01f};
+  const float noise_levels[] = {0.0f, 30.0f, 100.0f};
+  const float gap_seconds[] = {0.13f, 0.31f, 0.77f};
+  int frames = original.size() / original_channels;
+  SignalGenerator noise(Noise, sample_rate, channels, 1.0f);
+  ADPCMVector<int16_t> gap;
+  pcm.resize(0);
+  for (int j = 0, src = 0; pcm.size() < seconds * sample_rate * channels;
+       j++) {
+    int pos = pcm.size();
+    int segment = sample_rate / 2;
+    pcm.resize(pos + segment * channels);
+    for (int i = 0; i < segment; i++, src = (src + 1) % frames) {
+      for (int ch = 0; ch < channels; ch++)
+        pcm[pos + i * channels + ch] = (int16_t)(
+            original[src * original_channels + ch % original_channels] *
+            levels[j % 4]);
+    }
+    int gap_samples = gap_seconds[j % 3] * sample_rate;
+    gap.resize(gap_samples * channels);
+    noise.fill(&gap[0], gap_samples);
+    pos = pcm.size();
+    pcm.resize(pos + gap_samples * channels);
+    for (int i = 0; i < gap_samples * channels; i++)
+      pcm[pos + i] = (int16_t)(gap[i] * noise_levels[j % 3]);
+  }
+}
+
+bool encode(AVCodecID id, int channels) {
+  ADPCMEncoder *encoder = ADPCMEncoderFactory::create(id);
+  encoder->setBlockSize(block_size);
+  bool ok = encoder->begin(sample_rate, channels);
+  if (ok) {
+    int frame = encoder->frameSize() * channels;
+    packet_count = pcm.size() / frame;
+    packets.resize(0);
+    for (int j = 0; j < packet_count && ok; j++) {
+      AVPacket &packet = encoder->encode(&pcm[j * frame], frame);
+      packet_size = packet.size;
+      ok = packet.size > 0;
+      int pos = packets.size();
+      packets.resize(pos + packet.size);
+      memcpy(&packets[pos], packet.data, packet.size);
+    }
+  }
+  encoder->end();
+  delete encoder;
+  return ok;
+}
+
+// decodes all blocks and determines the activity from the decoded energy
+uint64_t decode(AVCodecID id, int channels) {
+  ADPCMDecoder *decoder = ADPCMDecoderFactory::create(id);
+  decoder->setBlockSize(block_size);
+  decoder->begin(sample_rate, channels);
+  truth.resize(packet_count);
+  uint64_t ns = 0;
+  for (int j = 0; j < packet_count; j++) {
+    uint64_t start = now();
+    AVFrame &frame = decoder->decode(&packets[j * packet_size], packet_size);
+    ns += now() - start;
+    int16_t *data = (int16_t *)frame.data[0];
+    int n = frame.nb_samples * channels;
+    float max_rms = 0.0f;
+    for (int ch = 0; ch < channels; ch++) {
+      double sum = 0;
+      for (int i = ch; i < n; i += channels) sum += data[i] * data[i];
+      float rms = n == 0 ? 0.0f : sqrtf(sum * channels / n);
+      if (rms > max_rms) max_rms = rms;
+    }
+    truth[j] = max_rms > active_rms;
+  }
+  decoder->end();
+  delete decoder;
+  return ns;
+}
+
+void detect(AVCodecID id, int channels, ADPCMActivityDetector::Method method,
+            uint64_t decodeNs) {
+  ADPCMActivityDetector detector;
+  if (!detector.begin(id, channels, packet_size, method)) {
+    failures++;
+    return;
+  }
+  int index = id == AV_CODEC_ID_ADPCM_MS ? 1 : 0;
+  if (thresholds[index] > 0) detector.setThreshold(thresholds[index]);
+  int correct = 0, false_pos = 0, false_neg = 0, active = 0;
+  uint64_t start = now();
+  for (int j = 0; j < packet_count; j++) {
+    bool result = detector.isActive(&packets[j * packet_size], packet_size);
+    if (result == truth[j])
+      correct++;
+    else if (result)
+      false_pos++;
+    else
+      false_neg++;
+    if (truth[j]) active++;
+  }
+  uint64_t ns = now() - start;
+  float accuracy = 100.0f * correct / packet_count;
+  printf("%-8s %2d %-6s | %6d %6d | %6.2f %5d %5d | %8.3f %8.3f %7.1fx\n",
+         index == 1 ? "ms" : "ima_wav", channels, methods[method],
+         packet_count, active, accuracy, false_pos, false_neg, ns / 1e6,
+         decodeNs / 1e6, (double)decodeNs / (ns > 0 ? ns : 1));
+  // the scan follows the whole block
+  if (method == ADPCMActivityDetector::StateScan && accuracy < 95.0f)
+    failures++;
+}
+
+// classifies the signal which create(channels) provides in mono and stereo
+void check(const char *title, void (*create)(int)) {
+  printf("%s\n", title);
+  for (int channels = 1; channels <= 2; channels++) {
+    create(channels);
+    for (AVCodecID id : codecs) {
+      if (!encode(id, channels)) {
+        failures++;
+        continue;
+      }
+      uint64_t decode_ns = decode(id, channels);
+      detect(id, channels, ADPCMActivityDetector::BlockHeader, decode_ns);
+      detect(id, channels, ADPCMActivityDetector::StateScan, decode_ns);
+    }
+  }
+  printf("\n");
+}
+
+int main(int argc, char **argv) {
+  if (argc > 2) {
+    thresholds[0] = atoi(argv[1]);
+    thresholds[1] = atoi(argv[2]);
+  }
+  printf("%d s, block size %d, active above %.0f rms, times in ms\n\n",
+         seconds, block_size, active_rms);
+  printf("%-8s %2s %-6s | %6s %6s | %6s %5s %5s | %8s %8s %8s\n", "codec",
+         "ch", "method", "blocks", "active", "acc %", "fp", "fn", "detect",
+         "decode", "speedup");
+  check("speech with gaps (calibration)", createSignal);
+  if (loadOriginal(TEST_DATA "/original.wav")) {
+    check("original.wav with gaps (held out)", createHeldOut);
+  } else {
+    printf("original.wav not found\n");
+    failures++;
+  }
+  printf("%s\n", failures == 0 ? "OK" : "FAILED");
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <stdlib.h>
+#include <new>
+#include "ADPCMAllocator.h"
+
+/**
+ * Counts the allocations of the tests: operator new is routed to malloc()
+ * and, like the CountingAllocator which can be registered as ADPCMAllocator,
+ * increments allocation_count. The operators are not inlined, so that the
+ * compiler does not pair the free() with the new expressions
+ * (-Wmismatched-new-delete).
+ */
+
+static long allocation_count = 0;
+
+__attribute__((noinline)) void *operator new(size_t size) {
+  allocation_count++;
+  void *result = malloc(size);
+  if (result == nullptr) throw std::bad_alloc();
+  return result;
+}
+__attribute__((noinline)) void *operator new[](size_t size) {
+  return operator new(size);
+}
+__attribute__((noinline)) void operator delete(void *ptr) noexcept {
+  free(ptr);
+}
+__attribute__((noinline)) void operator delete[](void *ptr) noexcept {
+  free(ptr);
+}
+__attribute__((noinline)) void operator delete(void *ptr, size_t) noexcept {
+  free(ptr);
+}
+__attribute__((noinline)) void operator delete[](void *ptr, size_t) noexcept {
+  free(ptr);
+}
+
+/// av_malloc and ADPCMVector allocate via the ADPCMAllocator
+class CountingAllocator : public adpcm_ffmpeg::ADPCMAllocator {
+ public:
+  void *allocate(size_t size) override {
+    allocation_count++;
+    return ADPCMAllocator::allocate(size);
+  }
+};
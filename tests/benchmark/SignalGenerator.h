@@ -0,0 +1,118 @@
+#pragma once
+#include <math.h>
+#include <stdint.h>
+
+/// Test signals which are used by the benchmarks
+enum SignalType { Sine, Noise, Chirp, Silence, Speech };
+
+inline constexpr const char *signal_names[] = {"sine", "noise", "chirp",
+                                               "silence", "speech"};
+inline constexpr int signal_count = 5;
+
+/**
+ * Generates deterministic 16 bit test signals: a 440 Hz sine, white noise,
+ * a logarithmic chirp from 20 Hz to 20 kHz, silence and a speech like signal
+ * (a pulse train with a varying pitch through two formant resonators with a
+ * syllable envelope). Each channel gets a slightly different signal.
+ */
+class SignalGenerator {
+ public:
+  SignalGenerator(SignalType type, int sampleRate, int channels,
+                  float amplitude = 20000.0f) {
+    this->type = type;
+    sample_rate = sampleRate;
+    this->channels = channels;
+    this->amplitude = amplitude;
+    for (int ch = 0; ch < max_channels; ch++) {
+      state[ch].seed = 12345u + 7919u * ch;
+    }
+    formant1.setup(500.0f, 0.97f, sampleRate);
+    formant2.setup(1500.0f, 0.95f, sampleRate);
+  }
+
+  /// Fills the interleaved frames
+  void fill(int16_t *data, int frames) {
+    for (int j = 0; j < frames; j++) {
+      for (int ch = 0; ch < channels; ch++) {
+        data[j * channels + ch] = clip(nextSample(ch));
+      }
+      pos++;
+    }
+  }
+
+ protected:
+  static const int max_channels = 8;
+  struct Resonator {
+    float a1, a2, gain;
+    void setup(float freq, float r, int rate) {
+      a1 = 2.0f * r * cosf(2.0f * (float)M_PI * freq / rate);
+      a2 = -r * r;
+      gain = 1.0f - r;
+    }
+  };
+  struct ChannelState {
+    uint32_t seed;
+    double phase = 0.0;
+    float y1[2] = {0}, y2[2] = {0};
+  } state[max_channels];
+  SignalType type;
+  int sample_rate;
+  int channels;
+  float amplitude;
+  long pos = 0;
+  Resonator formant1, formant2;
+
+  static int16_t clip(float value) {
+    if (value > 32767.0f) return 32767;
+    if (value < -32768.0f) return -32768;
+    return (int16_t)value;
+  }
+
+  float noise(ChannelState &cs) {
+    cs.seed = cs.seed * 1664525u + 1013904223u;
+    return ((int32_t)cs.seed) / 2147483648.0f;
+  }
+
+  float nextSample(int ch) {
+    ChannelState &cs = state[ch];
+    double t = (double)pos / sample_rate;
+    switch (type) {
+      case Sine:
+        return amplitude * sin(2.0 * M_PI * 440.0 * t + ch * 0.5);
+      case Noise:
+        return amplitude * noise(cs);
+      case Chirp: {
+        // sweeps from 20 Hz to 20 kHz in 2 seconds and starts again
+        const double f0 = 20.0, f1 = 20000.0, len = 2.0;
+        double k = log(f1 / f0) / len;
+        double tc = fmod(t, len);
+        return amplitude * sin(2.0 * M_PI * f0 * (exp(k * tc) - 1.0) / k);
+      }
+      case Silence:
+        return 0.0f;
+      case Speech: {
+        // pitch between 100 and 140 Hz
+        double f0 = 120.0 + 20.0 * sin(2.0 * M_PI * 0.7 * t) + ch * 5.0;
+        cs.phase += f0 / sample_rate;
+        float excitation = 0.1f * noise(cs);
+        if (cs.phase >= 1.0) {
+          cs.phase -= 1.0;
+          excitation += 1.0f;
+        }
+        float v = resonate(formant1, cs, 0, excitation);
+        v = resonate(formant2, cs, 1, v);
+        // 4 syllables per second
+        float env = sinf(2.0f * (float)M_PI * 2.0f * t);
+        return 2.0f * amplitude * v * env * env;
+      }
+    }
+    return 0.0f;
+  }
+
+  float resonate(Resonator &r, ChannelState &cs, int idx, float in) {
+    float out = r.gain * in + r.a1 * cs.y1[idx] + r.a2 * cs.y2[idx];
+    cs.y2[idx] = cs.y1[idx];
+    cs.y1[idx] = out;
+    return out;
+  }
+};
@@ -0,0 +1,211 @@
+/**
+ * Throughput benchmark: encodes and decodes one second of audio with every
+ * codec for mono and stereo, different block sizes and signal types and
+ * reports the samples/s (per channel) and the PCM MB/s of the fastest of
+ * several runs. The results are printed as table and are written as CSV and
+ * JSON.
+ *
+ * Usage: benchmark [csv-file] [json-file]
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include "ADPCM.h"
+#include "SignalGenerator.h"
+
+using namespace adpcm_ffmpeg;
+
+const int sample_rate = 44100;
+const int seconds = 1;
+const int block_sizes[] = {256, 1024, 4096};
+// the fastest of the repeated runs is reported
+const int repeats = 5;
+
+struct Result {
+  const char *codec;
+  int channels;
+  int block_size;
+  const char *signal;
+  double enc_samples_per_sec = 0;
+  double dec_samples_per_sec = 0;
+};
+
+ADPCMVector<Result> results;
+ADPCMVector<int16_t> pcm;
+ADPCMVector<uint8_t> packets;
+ADPCMVector<int> packet_sizes;
+
+double elapsed(std::chrono::steady_clock::time_point start) {
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double>(end - start).count();
+}
+
+// encodes the pcm data: the packets are kept for the decoder
+bool encode(ADPCMEncoder &encoder, int channels, Result &result) {
+  int frame = encoder.frameSize() * channels;
+  int frames = pcm.size() / frame;
+  packets.resize(0);
+  packet_sizes.resize(0);
+  double best = 0;
+  for (int r = 0; r < repeats; r++) {
+    auto start = std::chrono::steady_clock::now();
+    for (int j = 0; j < frames; j++) {
+      AVPacket &packet = encoder.encode(&pcm[j * frame], frame);
+      if (packet.size <= 0) return false;
+      if (r > 0) continue;
+      int pos = packets.size();
+      packets.resize(pos + packet.size);
+      memcpy(&packets[pos], packet.data, packet.size);
+      packet_sizes.push_back(packet.size);
+    }
+    double time = elapsed(start);
+    if (r == 0 || time < best) best = time;
+  }
+  result.enc_samples_per_sec = (double)frames * frame / channels / best;
+  return true;
+}
+
+// decodes the packets of the encoder or blocks of zeros
+void decode(ADPCMDecoder &decoder, int channels, Result &result) {
+  if (packet_sizes.size() == 0) {
+    int block = decoder.ctx().block_align > 0 ? decoder.ctx().block_align : 1024;
+    int count = sample_rate * seconds * channels / 2 / block + 1;
+    packets.resize(block * count);
+    memset(&packets[0], 0, packets.size());
+    for (int j = 0; j < count; j++) packet_sizes.push_back(block);
+  }
+  long samples = 0;
+  double best = 0;
+  for (int r = 0; r < repeats; r++) {
+    int pos = 0;
+    samples = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int j = 0; j < packet_sizes.size(); j++) {
+      AVFrame &frame = decoder.decode(&packets[pos], packet_sizes[j]);
+      samples += frame.nb_samples;
+      pos += packet_sizes[j];
+    }
+    double time = elapsed(start);
+    if (r == 0 || time < best) best = time;
+  }
+  result.dec_samples_per_sec = samples / best;
+}
+
+bool run(const ADPCMDescriptor &desc, int channels, int blockSize,
+         SignalType signal) {
+  Result result;
+  result.codec = desc.name;
+  result.channels = channels;
+  result.block_size = blockSize;
+  result.signal = desc.has_encoder ? signal_names[signal] : "zeros";
+  packet_sizes.resize(0);
+
+  if (desc.has_encoder) {
+    ADPCMEncoder *encoder = ADPCMEncoderFactory::create(desc.id);
+    encoder->setBlockSize(blockSize);
+    bool ok = encoder->begin(sample_rate, channels);
+    if (ok) {
+      SignalGenerator generator(signal, sample_rate, channels);
+      pcm.resize(sample_rate * seconds * channels);
+      generator.fill(&pcm[0], sample_rate * seconds);
+      ok = encode(*encoder, channels, result);
+    }
+    encoder->end();
+    delete encoder;
+    if (!ok) return false;
+  }
+
+  if (desc.has_decoder) {
+    ADPCMDecoder *decoder = ADPCMDecoderFactory::create(desc.id);
+    decoder->setBlockSize(blockSize);
+    if (decoder->begin(sample_rate, channels)) {
+      decode(*decoder, channels, result);
+    }
+    decoder->end();
+    delete decoder;
+  }
+
+  results.push_back(result);
+  return true;
+}
+
+double mbPerSec(double samplesPerSec, int channels) {
+  return samplesPerSec * channels * sizeof(int16_t) / 1000000.0;
+}
+
+void printTable() {
+  printf("\n%-16s %2s %5s %-7s | %12s %8s | %12s %8s\n", "codec", "ch",
+         "block", "signal", "enc smpl/s", "enc MB/s", "dec smpl/s",
+         "dec MB/s");
+  for (int j = 0; j < results.size(); j++) {
+    Result &r = results[j];
+    printf("%-16s %2d %5d %-7s | %12.0f %8.2f | %12.0f %8.2f\n", r.codec,
+           r.channels, r.block_size, r.signal, r.enc_samples_per_sec,
+           mbPerSec(r.enc_samples_per_sec, r.channels),
+           r.dec_samples_per_sec, mbPerSec(r.dec_samples_per_sec, r.channels));
+  }
+}
+
+void writeCSV(const char *fileName) {
+  FILE *file = fopen(fileName, "w");
+  if (file == nullptr) return;
+  fprintf(file,
+          "codec,channels,block_size,signal,encode_samples_per_sec,"
+          "encode_mb_per_sec,decode_samples_per_sec,decode_mb_per_sec\n");
+  for (int j = 0; j < results.size(); j++) {
+    Result &r = results[j];
+    fprintf(file, "%s,%d,%d,%s,%.0f,%.3f,%.0f,%.3f\n", r.codec, r.channels,
+            r.block_size, r.signal, r.enc_samples_per_sec,
+            mbPerSec(r.enc_samples_per_sec, r.channels),
+            r.dec_samples_per_sec, mbPerSec(r.dec_samples_per_sec, r.channels));
+  }
+  fclose(file);
+}
+
+void writeJSON(const char *fileName) {
+  FILE *file = fopen(fileName, "w");
+  if (file == nullptr) return;
+  fprintf(file, "[\n");
+  for (int j = 0; j < results.size(); j++) {
+    Result &r = results[j];
+    fprintf(file,
+            "  {\"codec\": \"%s\", \"channels\": %d, \"block_size\": %d, "
+            "\"signal\": \"%s\", \"encode_samples_per_sec\": %.0f, "
+            "\"encode_mb_per_sec\": %.3f, \"decode_samples_per_sec\": %.0f, "
+            "\"decode_mb_per_sec\": %.3f}%s\n",
+            r.codec, r.channels, r.block_size, r.signal,
+            r.enc_samples_per_sec, mbPerSec(r.enc_samples_per_sec, r.channels),
+            r.dec_samples_per_sec, mbPerSec(r.dec_samples_per_sec, r.channels),
+            j + 1 < results.size() ? "," : "");
+  }
+  fprintf(file, "]\n");
+  fclose(file);
+}
+
+int main(int argc, char **argv) {
+  const char *csv = argc > 1 ? argv[1] : "benchmark.csv";
+  const char *json = argc > 2 ? argv[2] : "benchmark.json";
+
+  for (int j = 0; j < ADPCMDescriptors::count(); j++) {
+    const ADPCMDescriptor &desc = ADPCMDescriptors::get(j);
+    // the frame size of the other codecs depends on the content
+    if (desc.frame_size == nullptr) continue;
+    for (int ch = 1; ch <= 2; ch++) {
+      if (ch < desc.min_channels || ch > desc.max_channels) continue;
+      for (int blockSize : block_sizes) {
+        // without encoder we can only decode silence
+        int signals = desc.has_encoder ? signal_count : 1;
+        for (int s = 0; s < signals; s++) {
+          run(desc, ch, blockSize, (SignalType)s);
+        }
+      }
+    }
+  }
+
+  printTable();
+  writeCSV(csv);
+  writeJSON(json);
+  printf("\n%d results written to %s and %s\n", results.size(), csv, json);
+  return 0;
+}
@@ -0,0 +1,161 @@
+/**
+ * Stream churn benchmark: many short lived streams which are encoded and
+ * decoded with codecs from a ADPCMCodecPool compared to creating a new
+ * encoder and decoder for each stream. We count the allocations and measure
+ * the time to set up and release the codecs per stream: after the warm up
+ * the pool must not allocate and must be faster than new/delete. Codecs
+ * which were released with other settings must not be handed out again.
+ */
+
+#include <stdlib.h>
+#include <chrono>
+#include "ADPCM.h"
+#include "ADPCMCodecPool.h"
+#include "../sine/SineGenerator.h"
+#include "../benchmark/AllocationCounter.h"
+
+using namespace adpcm_ffmpeg;
+
+const AVCodecID codec = AV_CODEC_ID_ADPCM_IMA_WAV;
+const int sample_rate = 44100;
+const int channels = 2;
+const int streams = 10000;
+const int packets_per_stream = 4;
+const double required_streams_per_sec = 10000.0;
+
+CountingAllocator counting_allocator;
+
+ADPCMVector<int16_t> samples;
+
+// encodes and decodes a short stream
+void processStream(ADPCMEncoder &encoder, ADPCMDecoder &decoder) {
+  for (int j = 0; j < packets_per_stream; j++) {
+    AVPacket &packet = encoder.encode(&samples[0], samples.size());
+    decoder.decode(packet);
+  }
+}
+
+// measures the streams per second, the allocations and the time which is
+// spent to set up and release the codecs
+struct Result {
+  double streams_per_sec = 0;
+  long allocations = 0;
+  double lifecycle_ns = 0;
+
+  void print(const char *name) {
+    printf("%-11s %7.0f streams/s, %5.2f allocations and %6.0f ns per stream "
+           "for setup and release\n",
+           name, streams_per_sec, (double)allocations / streams,
+           lifecycle_ns / streams);
+  }
+};
+
+uint64_t now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+Result runNew() {
+  Result result;
+  long start_count = allocation_count;
+  uint64_t start = now();
+  for (int j = 0; j < streams; j++) {
+    uint64_t setup = now();
+    ADPCMEncoder *encoder = ADPCMEncoderFactory::create(codec);
+    ADPCMDecoder *decoder = ADPCMDecoderFactory::create(codec);
+    encoder->begin(sample_rate, channels);
+    decoder->begin(sample_rate, channels);
+    result.lifecycle_ns += now() - setup;
+    processStream(*encoder, *decoder);
+    uint64_t release = now();
+    encoder->end();
+    decoder->end();
+    delete encoder;
+    delete decoder;
+    result.lifecycle_ns += now() - release;
+  }
+  result.streams_per_sec = streams * 1e9 / (now() - start);
+  result.allocations = allocation_count - start_count;
+  return result;
+}
+
+Result runPool() {
+  Result result;
+  ADPCMEncoderPool encoders;
+  ADPCMDecoderPool decoders;
+  // warm up: a single stream is active at a time
+  ADPCMEncoder *encoder = encoders.acquire(codec, sample_rate, channels);
+  ADPCMDecoder *decoder = decoders.acquire(codec, sample_rate, channels);
+  processStream(*encoder, *decoder);
+  encoders.release(encoder);
+  decoders.release(decoder);
+
+  long start_count = allocation_count;
+  uint64_t start = now();
+  for (int j = 0; j < streams; j++) {
+    uint64_t setup = now();
+    encoder = encoders.acquire(codec, sample_rate, channels);
+    decoder = decoders.acquire(codec, sample_rate, channels);
+    result.lifecycle_ns += now() - setup;
+    processStream(*encoder, *decoder);
+    uint64_t release = now();
+    encoders.release(encoder);
+    decoders.release(decoder);
+    result.lifecycle_ns += now() - release;
+  }
+  result.streams_per_sec = streams * 1e9 / (now() - start);
+  result.allocations = allocation_count - start_count;
+  return result;
+}
+
+// released codecs with changed settings are not kept
+bool checkSettings() {
+  ADPCMEncoderPool encoders;
+  ADPCMDecoderPool decoders;
+  ADPCMEncoder *encoder = encoders.acquire(codec, sample_rate, channels);
+  encoder->setTrellis(2);
+  encoders.release(encoder);
+  ADPCMDecoder *decoder = decoders.acquire(codec, sample_rate, channels);
+  decoder->setBlockSize(512);
+  decoders.release(decoder);
+  decoder = decoders.acquire(codec, sample_rate, channels);
+  decoder->setOutputFormat(AV_SAMPLE_FMT_FLT);
+  decoders.release(decoder);
+  bool ok = encoders.idleCount() == 0 && decoders.idleCount() == 0;
+  // the defaults are kept
+  decoders.release(decoders.acquire(codec, sample_rate, channels));
+  return ok && decoders.idleCount() == 1;
+}
+
+int main() {
+  ADPCMAllocator::setInstance(&counting_allocator);
+  // one packet of sine samples
+  ADPCMEncoder *tmp = ADPCMEncoderFactory::create(codec);
+  tmp->begin(sample_rate, channels);
+  int frame_size = tmp->frameSize() * channels;
+  tmp->end();
+  delete tmp;
+  SineWaveGenerator<int16_t> sine{20000.0};
+  sine.begin(sample_rate, 440);
+  samples.resize(frame_size);
+  for (int j = 0; j < frame_size; j++) samples[j] = sine.nextSample();
+
+  Result with_new = runNew();
+  Result with_pool = runPool();
+
+  printf("\n");
+  with_new.print("new/delete:");
+  with_pool.print("pool:");
+
+  // the pool must not allocate after the warm up and must save the
+  // allocations and part of the setup time of new/delete
+  bool ok = with_pool.allocations == 0 && with_new.allocations > 0 &&
+            with_pool.lifecycle_ns < with_new.lifecycle_ns &&
+            with_pool.streams_per_sec >= required_streams_per_sec;
+  bool settings = checkSettings();
+  printf("changed settings are %s\n", settings ? "not pooled" : "pooled");
+  ok = ok && settings;
+  printf("%s\n", ok ? "OK" : "FAILED");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,152 @@
+/**
+ * Prints the memory footprint of the encoder and decoder of every codec for
+ * mono and stereo and different block sizes. The heap memory reported by
+ * memoryUsage() is cross checked against the bytes which are allocated via
+ * the ADPCMAllocator.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "ADPCM.h"
+#include "../sine/SineGenerator.h"
+
+using namespace adpcm_ffmpeg;
+
+const int sample_rate = 44100;
+const int block_sizes[] = {256, 1024, 4096};
+const int trellis_level = 8;
+// preallocated, so that the buffers of the test do not count
+const int max_samples = 1 << 16;
+
+// keeps track of the allocated bytes with the help of a header
+class TrackingAllocator : public ADPCMAllocator {
+ public:
+  size_t allocated = 0;
+
+  void *allocate(size_t size) override {
+    size_t *ptr = (size_t *)ADPCMAllocator::allocate(size + header);
+    if (ptr == nullptr) return nullptr;
+    *ptr = size;
+    allocated += size;
+    return (uint8_t *)ptr + header;
+  }
+
+  void release(void *ptr) override {
+    size_t *p_size = (size_t *)((uint8_t *)ptr - header);
+    allocated -= *p_size;
+    ADPCMAllocator::release(p_size);
+  }
+
+ protected:
+  static const size_t header = 16;
+} tracking_allocator;
+
+ADPCMVector<int16_t> samples;
+ADPCMVector<uint8_t> packet;
+int errors = 0;
+
+size_t heap(ADPCMMemoryUsage usage) {
+  return usage.buffers + usage.trellis + usage.extradata;
+}
+
+// encodes a frame: the packet is kept for the decoder
+ADPCMMemoryUsage encoderUsage(const ADPCMDescriptor &desc, int channels,
+                              int blockSize) {
+  ADPCMMemoryUsage result;
+  packet.resize(0);
+  if (!desc.has_encoder) return result;
+  size_t start = tracking_allocator.allocated;
+  ADPCMEncoder *encoder = ADPCMEncoderFactory::create(desc.id);
+  encoder->setBlockSize(blockSize);
+  if (encoder->begin(sample_rate, channels)) {
+    int count = encoder->frameSize() * channels;
+    SineWaveGenerator<int16_t> sine{20000.0};
+    sine.begin(sample_rate, 440);
+    samples.resize(count);
+    for (int j = 0; j < count; j++) samples[j] = sine.nextSample();
+    AVPacket &pkt = encoder->encode(&samples[0], count);
+    packet.resize(pkt.size);
+    if (pkt.size > 0) memcpy(&packet[0], pkt.data, pkt.size);
+    result = encoder->memoryUsage();
+    if (heap(result) != tracking_allocator.allocated - start) {
+      printf("%s: encoder reports %zu heap bytes but %zu are allocated\n",
+             desc.name, heap(result), tracking_allocator.allocated - start);
+      errors++;
+    }
+  }
+  encoder->end();
+  delete encoder;
+  return result;
+}
+
+// trellis memory: allocated in begin()
+size_t trellisUsage(const ADPCMDescriptor &desc, int channels,
+                    int blockSize) {
+  if (!desc.has_encoder || !desc.trellis) return 0;
+  ADPCMEncoder *encoder = ADPCMEncoderFactory::create(desc.id);
+  encoder->setBlockSize(blockSize);
+  encoder->ctx().trellis = trellis_level;
+  size_t result = 0;
+  if (encoder->begin(sample_rate, channels))
+    result = encoder->memoryUsage().trellis;
+  encoder->end();
+  delete encoder;
+  return result;
+}
+
+// decodes the encoded packet or a silent block
+ADPCMMemoryUsage decoderUsage(const ADPCMDescriptor &desc, int channels,
+                              int blockSize) {
+  ADPCMMemoryUsage result;
+  if (!desc.has_decoder) return result;
+  size_t start = tracking_allocator.allocated;
+  ADPCMDecoder *decoder = ADPCMDecoderFactory::create(desc.id);
+  decoder->setBlockSize(blockSize);
+  if (decoder->begin(sample_rate, channels)) {
+    if (packet.size() == 0) {
+      packet.resize(blockSize);
+      memset(&packet[0], 0, blockSize);
+    }
+    decoder->decode(&packet[0], packet.size());
+    result = decoder->memoryUsage();
+    if (heap(result) != tracking_allocator.allocated - start) {
+      printf("%s: decoder reports %zu heap bytes but %zu are allocated\n",
+             desc.name, heap(result), tracking_allocator.allocated - start);
+      errors++;
+    }
+  }
+  decoder->end();
+  delete decoder;
+  return result;
+}
+
+int main() {
+  ADPCMAllocator::setInstance(&tracking_allocator);
+  samples.resize(max_samples);
+  packet.resize(max_samples);
+
+  printf("%-20s %2s %5s | %7s %7s %7s %7s | %8s | %7s %7s %7s\n", "codec",
+         "ch", "block", "enc obj", "buffers", "extra", "total", "trellis",
+         "dec obj", "buffers", "total");
+  for (int j = 0; j < ADPCMDescriptors::count(); j++) {
+    const ADPCMDescriptor &desc = ADPCMDescriptors::get(j);
+    for (int ch = 1; ch <= 2; ch++) {
+      if (ch < desc.min_channels || ch > desc.max_channels) continue;
+      for (int blockSize : block_sizes) {
+        ADPCMMemoryUsage enc = encoderUsage(desc, ch, blockSize);
+        size_t trellis = trellisUsage(desc, ch, blockSize);
+        ADPCMMemoryUsage dec = decoderUsage(desc, ch, blockSize);
+        printf("%-20s %2d %5d | %7zu %7zu %7zu %7zu | %8zu | %7zu %7zu %7zu\n",
+               desc.name, ch, blockSize, enc.object, enc.buffers,
+               enc.extradata, enc.total(), trellis, dec.object, dec.buffers,
+               dec.total());
+      }
+    }
+  }
+
+  samples.reset();
+  packet.reset();
+  ADPCMAllocator::setInstance(nullptr);
+  printf("%s\n", errors == 0 ? "OK" : "FAILED");
+  return errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * HDR style histogram for latencies in nanoseconds: the values are grouped by
+ * their power of 2 and each power of 2 is split into 32 linear sub buckets,
+ * so the relative error is below 3% over the whole range. Recording does not
+ * allocate any memory.
+ */
+class LatencyHistogram {
+ public:
+  LatencyHistogram() { reset(); }
+
+  void reset() {
+    memset(counts, 0, sizeof(counts));
+    total = 0;
+    max_value = 0;
+  }
+
+  void record(uint64_t value) {
+    counts[index(value)]++;
+    total++;
+    if (value > max_value) max_value = value;
+  }
+
+  /// Provides the value at the percentile (0-100): the upper limit of the
+  /// bucket is reported
+  uint64_t percentile(double pct) const {
+    if (total == 0) return 0;
+    uint64_t rank = (uint64_t)(pct / 100.0 * total + 0.5);
+    if (rank < 1) rank = 1;
+    uint64_t sum = 0;
+    for (int j = 0; j < bucket_count; j++) {
+      sum += counts[j];
+      if (sum >= rank) {
+        uint64_t limit = upperLimit(j);
+        return limit < max_value ? limit : max_value;
+      }
+    }
+    return max_value;
+  }
+
+  uint64_t max() const { return max_value; }
+
+  uint64_t count() const { return total; }
+
+ protected:
+  // values below 2 * sub_count are recorded exactly
+  static const int sub_bits = 5;
+  static const int sub_count = 1 << sub_bits;
+  static const int bucket_count = 2 * sub_count + (63 - sub_bits) * sub_count;
+  uint64_t counts[bucket_count];
+  uint64_t total;
+  uint64_t max_value;
+
+  static int index(uint64_t value) {
+    if (value < 2 * sub_count) return (int)value;
+    int shift = 63 - __builtin_clzll(value) - sub_bits;
+    int top = (int)(value >> shift);  // sub_count .. 2 * sub_count - 1
+    return 2 * sub_count + (shift - 1) * sub_count + (top - sub_count);
+  }
+
+  static uint64_t upperLimit(int idx) {
+    if (idx < 2 * sub_count) return idx;
+    int shift = (idx - 2 * sub_count) / sub_count + 1;
+    int top = (idx - 2 * sub_count) % sub_count + sub_count;
+    return (((uint64_t)top + 1) << shift) - 1;
+  }
+};
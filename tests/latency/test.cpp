@@ -0,0 +1,195 @@
+/**
+ * Latency harness: drives every codec with the block sizes which result in
+ * real time callback sizes of 64 to 512 samples and records the duration of
+ * each encode() and decode() call in a histogram. We report p50, p99, p99.9
+ * and the max in microseconds, the number of calls which allocated memory
+ * and if p99.9 stays within the deadline: on a host without real time
+ * scheduling the max is dominated by preemptions. The first call is reported
+ * separately. Codecs without encoder decode blocks of zeros and codecs where
+ * the frame size depends on the content are not covered.
+ *
+ * Usage: latency [deadline-us] [calls]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include "ADPCM.h"
+#include "LatencyHistogram.h"
+#include "../benchmark/SignalGenerator.h"
+#include "../benchmark/AllocationCounter.h"
+
+using namespace adpcm_ffmpeg;
+
+int sample_rate = 44100;
+const int min_callback = 64;
+const int max_callback = 512;
+const int block_sizes[] = {32, 64, 128, 256, 512, 1024, 2048};
+
+CountingAllocator counting_allocator;
+
+struct Measurement {
+  LatencyHistogram histogram;
+  // the first call warms up the caches and is reported separately
+  uint64_t first_ns = 0;
+  bool first_allocates = false;
+  // later calls which allocated memory
+  int allocating_calls = 0;
+
+  void reset() {
+    histogram.reset();
+    first_ns = 0;
+    first_allocates = false;
+    allocating_calls = 0;
+  }
+};
+
+ADPCMVector<int16_t> pcm;
+ADPCMVector<uint8_t> packets;
+ADPCMVector<int> packet_sizes;
+Measurement enc_result, dec_result;
+long deadline_ns = 1000000;
+int calls = 5000;
+int misses = 0;
+// codecs with a fixed frame size ignore the block size
+int last_samples = 0;
+
+uint64_t now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+void record(Measurement &m, int call, uint64_t ns, long allocations) {
+  if (call == 0) {
+    m.first_ns = ns;
+    m.first_allocates = allocations > 0;
+    return;
+  }
+  m.histogram.record(ns);
+  if (allocations > 0) m.allocating_calls++;
+}
+
+// encodes the signal in callback sized frames: the packets are kept
+bool encode(ADPCMEncoder &encoder, int channels) {
+  int frame = encoder.frameSize() * channels;
+  int frames = pcm.size() / frame;
+  packets.resize(0);
+  packet_sizes.resize(0);
+  for (int j = 0; j < calls; j++) {
+    int16_t *data = &pcm[(j % frames) * frame];
+    long allocations = allocation_count;
+    uint64_t start = now();
+    AVPacket &packet = encoder.encode(data, frame);
+    uint64_t ns = now() - start;
+    record(enc_result, j, ns, allocation_count - allocations);
+    if (packet.size <= 0) return false;
+    int pos = packets.size();
+    packets.resize(pos + packet.size);
+    memcpy(&packets[pos], packet.data, packet.size);
+    packet_sizes.push_back(packet.size);
+  }
+  return true;
+}
+
+void decode(ADPCMDecoder &decoder) {
+  int pos = 0;
+  for (int j = 0; j < packet_sizes.size(); j++) {
+    long allocations = allocation_count;
+    uint64_t start = now();
+    decoder.decode(&packets[pos], packet_sizes[j]);
+    uint64_t ns = now() - start;
+    record(dec_result, j, ns, allocation_count - allocations);
+    pos += packet_sizes[j];
+  }
+}
+
+// packets of zeros for the codecs without encoder
+void zeroPackets(ADPCMDecoder &decoder) {
+  int block = decoder.ctx().block_align;
+  packets.resize(block * calls);
+  memset(&packets[0], 0, packets.size());
+  packet_sizes.resize(0);
+  for (int j = 0; j < calls; j++) packet_sizes.push_back(block);
+}
+
+void print(const char *name, int channels, int samples, const char *op,
+           Measurement &m) {
+  const LatencyHistogram &h = m.histogram;
+  bool ok = h.percentile(99.9) <= deadline_ns;
+  if (!ok) misses++;
+  printf("%-12s %2d %5d %-3s | %8.2f %8.2f %8.2f %8.2f | %8.2f %5s | %6d | %s\n",
+         name, channels, samples, op, h.percentile(50) / 1000.0,
+         h.percentile(99) / 1000.0, h.percentile(99.9) / 1000.0,
+         h.max() / 1000.0, m.first_ns / 1000.0,
+         m.first_allocates ? "alloc" : "", m.allocating_calls,
+         ok ? "ok" : "MISS");
+}
+
+void run(const ADPCMDescriptor &desc, int channels, int blockSize) {
+  // the frame size must be known to get the callback size
+  if (desc.frame_size == nullptr) return;
+  int samples = desc.frame_size(blockSize, channels);
+  if (samples < min_callback || samples > max_callback) return;
+  if (samples == last_samples) return;
+  last_samples = samples;
+  enc_result.reset();
+  dec_result.reset();
+
+  if (desc.has_encoder) {
+    ADPCMEncoder *encoder = ADPCMEncoderFactory::create(desc.id);
+    encoder->setBlockSize(blockSize);
+    bool ok = encoder->begin(sample_rate, channels) &&
+              encode(*encoder, channels);
+    encoder->end();
+    delete encoder;
+    if (!ok) return;
+  }
+
+  if (!desc.has_decoder) {
+    print(desc.name, channels, samples, "enc", enc_result);
+    return;
+  }
+  ADPCMDecoder *decoder = ADPCMDecoderFactory::create(desc.id);
+  decoder->setBlockSize(blockSize);
+  if (decoder->begin(sample_rate, channels)) {
+    if (!desc.has_encoder) zeroPackets(*decoder);
+    if (packet_sizes.size() > 0) {
+      decode(*decoder);
+      if (desc.has_encoder)
+        print(desc.name, channels, samples, "enc", enc_result);
+      print(desc.name, channels, samples, "dec", dec_result);
+    }
+  }
+  decoder->end();
+  delete decoder;
+}
+
+int main(int argc, char **argv) {
+  if (argc > 1) deadline_ns = atol(argv[1]) * 1000;
+  if (argc > 2) calls = atoi(argv[2]);
+  ADPCMAllocator::setInstance(&counting_allocator);
+
+  printf("%d calls per case, deadline %ld us, times in us\n\n", calls,
+         deadline_ns / 1000);
+  printf("%-12s %2s %5s %-3s | %8s %8s %8s %8s | %14s | %6s | %s\n", "codec",
+         "ch", "smpl", "op", "p50", "p99", "p99.9", "max", "first call",
+         "allocs", "deadline");
+  for (int j = 0; j < ADPCMDescriptors::count(); j++) {
+    const ADPCMDescriptor &desc = ADPCMDescriptors::get(j);
+    for (int ch = 1; ch <= 2; ch++) {
+      if (ch < desc.min_channels || ch > desc.max_channels) continue;
+      // AMV uses the sample rate of the video
+      sample_rate = desc.id == AV_CODEC_ID_ADPCM_IMA_AMV ? 22050 : 44100;
+      // one second of speech which is repeated
+      SignalGenerator generator(Speech, sample_rate, ch);
+      pcm.resize(sample_rate * ch);
+      generator.fill(&pcm[0], sample_rate);
+      last_samples = 0;
+      for (int blockSize : block_sizes) run(desc, ch, blockSize);
+    }
+  }
+  printf("\n%d cases exceeded the deadline\n", misses);
+  return 0;
+}
@@ -0,0 +1,93 @@
+/**
+ * Nibble order of the encoders without header (IMA_SSI, IMA_ALP, IMA_APM and
+ * IMA_WS): the input alternates between a large positive and a large negative
+ * value, so the sign bit of each nibble tells which sample it encodes. The
+ * first bytes of the packet must place the nibbles where the decoder reads
+ * them, and the decoded samples must have the sign of the input.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "ADPCM.h"
+
+using namespace adpcm_ffmpeg;
+
+// byte layout which is read by the decoder
+struct Layout {
+  AVCodecID id;
+  // the first sample of a byte is in the high nibble
+  bool high_first;
+  // a byte holds two samples of one channel (else two interleaved samples)
+  bool channel_pairs;
+};
+
+const Layout layouts[] = {
+    {AV_CODEC_ID_ADPCM_IMA_SSI, true, false},
+    {AV_CODEC_ID_ADPCM_IMA_ALP, true, true},
+    {AV_CODEC_ID_ADPCM_IMA_APM, true, true},
+    {AV_CODEC_ID_ADPCM_IMA_WS, false, true},
+};
+// the step size stays below the amplitude in the checked bytes
+const int checked_bytes = 8;
+const int amplitude = 20000;
+int failures = 0;
+
+// input sample with the interleaved index k
+int16_t input(int k, int channels) {
+  int t = k / channels, ch = k % channels;
+  return (t + ch) % 2 == 0 ? amplitude : -amplitude;
+}
+
+bool check(const Layout &layout, int channels) {
+  ADPCMEncoder *encoder = ADPCMEncoderFactory::create(layout.id);
+  ADPCMDecoder *decoder = ADPCMDecoderFactory::create(layout.id);
+  encoder->setBlockSize(256);
+  decoder->setBlockSize(256);
+  bool ok = encoder->begin(44100, channels) && decoder->begin(44100, channels);
+  int count = encoder->frameSize() * channels;
+  ADPCMVector<int16_t> pcm;
+  pcm.resize(count);
+  for (int k = 0; k < count; k++) pcm[k] = input(k, channels);
+
+  AVPacket &packet = encoder->encode(&pcm[0], count);
+  ok = ok && packet.size >= checked_bytes;
+  for (int b = 0; ok && b < checked_bytes; b++) {
+    // interleaved index of the first and the second sample of the byte
+    int first = 2 * b, second = 2 * b + 1;
+    if (layout.channel_pairs) {
+      int n = b / channels, ch = b % channels;
+      first = 2 * n * channels + ch;
+      second = (2 * n + 1) * channels + ch;
+    }
+    int high = packet.data[b] >> 4, low = packet.data[b] & 0x0F;
+    int first_nibble = layout.high_first ? high : low;
+    int second_nibble = layout.high_first ? low : high;
+    ok = ((first_nibble & 8) != 0) == (input(first, channels) < 0) &&
+         ((second_nibble & 8) != 0) == (input(second, channels) < 0);
+  }
+
+  ADPCMVector<uint8_t> data;
+  data.resize(packet.size);
+  if (ok) memcpy(&data[0], packet.data, packet.size);
+  AVFrame &frame = decoder->decode(&data[0], data.size());
+  ok = ok && frame.nb_samples * channels == count;
+  const int16_t *decoded = ok ? (const int16_t *)frame.data[0] : NULL;
+  for (int k = 0; ok && k < 2 * checked_bytes; k++)
+    ok = (decoded[k] < 0) == (input(k, channels) < 0);
+
+  printf("%-12s %d %s\n", ADPCMDescriptors::find(layout.id)->name, channels,
+         ok ? "ok" : "FAILED");
+  encoder->end();
+  decoder->end();
+  delete encoder;
+  delete decoder;
+  return ok;
+}
+
+int main() {
+  for (const Layout &layout : layouts)
+    for (int channels = 1; channels <= 2; channels++)
+      if (!check(layout, channels)) failures++;
+  printf("%s\n", failures == 0 ? "OK" : "FAILED");
+  return failures == 0 ? 0 : 1;
+}
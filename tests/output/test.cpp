@@ -0,0 +1,332 @@
+/**
+ * Output path benchmark: encodes a stereo speech signal with IMA_WAV, MS and
+ * IMA_QT (planar) and compares the time to decode all packets with the
+ * output paths of the decoder against the way the caller would do it
+ * without them: the float output against the 16 bit decoding followed by a
+ * separate conversion, summarize() against the 16 bit decoding followed by a
+ * separate envelope of the frame, decodeMix() against the 16 bit decoding
+ * followed by a separate mix into the bus and the mono downmix against the
+ * 16 bit decoding followed by a separate downmix. We report the fastest of
+ * several runs, the median of the run by run time relative to the path which
+ * is replaced and the buffer memory of the decoder. A path fails if it is
+ * slower than the path which it replaces. summarize() and the downmix are also compared with
+ * decode() alone, the selection of one channel fails if it is slower than
+ * decode().
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include "ADPCM.h"
+#include "../benchmark/SignalGenerator.h"
+
+using namespace adpcm_ffmpeg;
+
+const AVCodecID codecs[] = {AV_CODEC_ID_ADPCM_IMA_WAV, AV_CODEC_ID_ADPCM_MS,
+                            AV_CODEC_ID_ADPCM_IMA_QT};
+const int sample_rate = 44100;
+const int channels = 2;
+const int seconds = 20;
+const int repeats = 20;
+int failed = 0;
+
+ADPCMVector<uint8_t> packets;
+int packet_size = 0;
+int packet_count = 0;
+ADPCMVector<float> output;
+
+// encodes the signal into packets of the same size
+bool encode(AVCodecID id) {
+  ADPCMEncoder *encoder = ADPCMEncoderFactory::create(id);
+  encoder->setBlockSize(1024);
+  bool ok = encoder->begin(sample_rate, channels);
+  int frame = encoder->frameSize() * channels;
+  packet_count = sample_rate * seconds / encoder->frameSize();
+  ADPCMVector<int16_t> pcm;
+  pcm.resize(frame * packet_count);
+  SignalGenerator generator(Speech, sample_rate, channels);
+  generator.fill(&pcm[0], pcm.size() / channels);
+  packets.resize(0);
+  for (int j = 0; ok && j < packet_count; j++) {
+    AVPacket &packet = encoder->encode(&pcm[j * frame], frame);
+    packet_size = packet.size;
+    packets.resize((j + 1) * packet_size);
+    memcpy(&packets[j * packet_size], packet.data, packet_size);
+  }
+  encoder->end();
+  delete encoder;
+  return ok && packet_size > 0;
+}
+
+// decodes all packets with op(decoder, data, size): returns the time in ms
+template <class Op>
+double run(ADPCMDecoder &decoder, Op op) {
+  decoder.reset();
+  auto start = std::chrono::steady_clock::now();
+  for (int j = 0; j < packet_count; j++)
+    op(decoder, &packets[j * packet_size], packet_size);
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+// the times of the repeated runs: the paths which are compared are run
+// alternately, so that they see the same load of the host. The ratio of two
+// paths is the median of the ratios of each run, which ignores the runs in
+// which the speed of the host changed.
+struct Timing {
+  double ms = 0;
+  double times[repeats];
+  int count = 0;
+  void add(double time) {
+    if (ms == 0 || time < ms) ms = time;
+    times[count++] = time;
+  }
+  double ratio(const Timing &reference) const {
+    double ratios[repeats];
+    for (int r = 0; r < count; r++) ratios[r] = times[r] / reference.times[r];
+    std::sort(ratios, ratios + count);
+    return ratios[count / 2];
+  }
+};
+
+ADPCMDecoder *createDecoder(AVCodecID id, AVSampleFormat fmt) {
+  ADPCMDecoder *decoder = ADPCMDecoderFactory::create(id);
+  decoder->setBlockSize(1024);
+  decoder->setOutputFormat(fmt);
+  decoder->begin(sample_rate, channels);
+  return decoder;
+}
+
+void release(ADPCMDecoder *decoder) {
+  decoder->end();
+  delete decoder;
+}
+
+void report(const char *name, const Timing &time, const Timing &reference,
+            size_t buffers, bool check) {
+  double ratio = time.ratio(reference);
+  bool ok = !check || ratio <= 1.0;
+  if (!ok) failed++;
+  printf("  %-28s %8.1f ms %6.2fx %7zu bytes %s\n", name, time.ms, ratio,
+         buffers, check ? (ok ? "ok" : "FAILED") : "");
+}
+
+void decodeOnly(ADPCMDecoder &decoder, uint8_t *data, int size) {
+  decoder.decode(data, size);
+}
+
+// float output against the 16 bit decoding and a separate conversion
+void checkFloat(AVCodecID id) {
+  ADPCMDecoder *s16 = createDecoder(id, AV_SAMPLE_FMT_S16);
+  ADPCMDecoder *flt = createDecoder(id, AV_SAMPLE_FMT_FLT);
+  output.resize(s16->frameSize() * channels);
+  Timing s16_time, convert_time, float_time;
+  for (int r = 0; r < repeats; r++) {
+    s16_time.add(run(*s16, decodeOnly));
+    convert_time.add(
+        run(*s16, [](ADPCMDecoder &decoder, uint8_t *data, int size) {
+          AVFrame &frame = decoder.decode(data, size);
+          const int16_t *in = (const int16_t *)frame.data[0];
+          for (int i = 0; i < frame.nb_samples * channels; i++)
+            output[i] = in[i] / 32768.0f;
+        }));
+    float_time.add(run(*flt, decodeOnly));
+  }
+  // the float and int32 output of each frame match the converted 16 bit
+  // frame
+  ADPCMDecoder *s32 = createDecoder(id, AV_SAMPLE_FMT_S32);
+  bool same = true;
+  s16->reset();
+  flt->reset();
+  for (int j = 0; same && j < packet_count; j++) {
+    uint8_t *data = &packets[j * packet_size];
+    AVFrame &frame = s16->decode(data, packet_size);
+    const int16_t *in = (const int16_t *)frame.data[0];
+    AVFrame &result = flt->decode(data, packet_size);
+    AVFrame &result32 = s32->decode(data, packet_size);
+    for (int i = 0; i < result.nb_samples * channels; i++)
+      same = same && ((float *)result.data[0])[i] == in[i] / 32768.0f &&
+             ((int32_t *)result32.data[0])[i] == in[i] * 65536;
+  }
+  if (!same) {
+    printf("  the float output does not match the converted frames\n");
+    failed++;
+  }
+  release(s32);
+  report("decode() to 16 bit", s16_time, s16_time,
+         s16->memoryUsage().buffers, false);
+  report("decode() + conversion", convert_time, s16_time,
+         s16->memoryUsage().buffers + output.size() * sizeof(float), false);
+  report("decode() to float", float_time, convert_time,
+         flt->memoryUsage().buffers, true);
+  release(s16);
+  release(flt);
+}
+
+// summarize() against the 16 bit decoding followed by a separate envelope
+// of the frame
+void checkSummarize(AVCodecID id) {
+  ADPCMDecoder *s16 = createDecoder(id, AV_SAMPLE_FMT_S16);
+  uint64_t total = (uint64_t)packet_count * s16->frameSize();
+  ADPCMEnvelope separate, summarized;
+  separate.begin(1000, channels, total);
+  summarized.begin(1000, channels, total);
+  Timing s16_time, separate_time, summarize_time;
+  for (int r = 0; r < repeats; r++) {
+    s16_time.add(run(*s16, decodeOnly));
+    separate.clear();
+    separate.setPosition(0);
+    separate_time.add(
+        run(*s16, [&](ADPCMDecoder &decoder, uint8_t *data, int size) {
+          AVFrame &frame = decoder.decode(data, size);
+          const int16_t *in = (const int16_t *)frame.data[0];
+          for (int i = 0; i < frame.nb_samples * channels; i++)
+            separate.add(in[i]);
+        }));
+    summarized.clear();
+    summarized.setPosition(0);
+    summarize_time.add(
+        run(*s16, [&](ADPCMDecoder &decoder, uint8_t *data, int size) {
+          AVPacket packet;
+          packet.data = data;
+          packet.size = size;
+          decoder.summarize(packet, summarized);
+        }));
+  }
+  bool same = separate.count() == summarized.count();
+  for (int j = 0; same && j < separate.count(); j++) {
+    for (int ch = 0; ch < channels; ch++) {
+      const ADPCMEnvelopeBucket &a = separate.bucket(j, ch);
+      const ADPCMEnvelopeBucket &b = summarized.bucket(j, ch);
+      same = same && a.min == b.min && a.max == b.max &&
+             a.sum_squares == b.sum_squares && a.count == b.count;
+    }
+  }
+  if (!same) {
+    printf("  summarize() does not match the decoded envelope\n");
+    failed++;
+  }
+  report("decode() + envelope", separate_time, s16_time,
+         s16->memoryUsage().buffers, false);
+  report("summarize()", summarize_time, separate_time,
+         s16->memoryUsage().buffers, true);
+  printf("  %-28s %8.1f ms %6.2fx\n", "summarize() vs decode()",
+         summarize_time.ms, summarize_time.ratio(s16_time));
+  release(s16);
+}
+
+// decodeMix() against the 16 bit decoding followed by a separate mix of the
+// frame into the bus
+void checkMix(AVCodecID id) {
+  ADPCMDecoder *s16 = createDecoder(id, AV_SAMPLE_FMT_S16);
+  ADPCMVector<float> separate, mixed;
+  separate.resize(s16->frameSize() * channels);
+  mixed.resize(s16->frameSize() * channels);
+  for (int j = 0; j < separate.size(); j++) separate[j] = mixed[j] = 0;
+  Timing s16_time, separate_time, mix_time;
+  for (int r = 0; r < repeats; r++) {
+    s16_time.add(run(*s16, decodeOnly));
+    separate_time.add(
+        run(*s16, [&](ADPCMDecoder &decoder, uint8_t *data, int size) {
+          AVFrame &frame = decoder.decode(data, size);
+          const int16_t *in = (const int16_t *)frame.data[0];
+          for (int i = 0; i < frame.nb_samples * channels; i++)
+            separate[i] += in[i] * (0.5f / 32768.0f);
+        }));
+    mix_time.add(
+        run(*s16, [&](ADPCMDecoder &decoder, uint8_t *data, int size) {
+          AVPacket packet;
+          packet.data = data;
+          packet.size = size;
+          decoder.decodeMix(packet, &mixed[0], 0.5f);
+        }));
+  }
+  bool same = true;
+  for (int j = 0; j < separate.size(); j++)
+    same = same && separate[j] == mixed[j];
+  if (!same) {
+    printf("  decodeMix() does not match the decoded frames\n");
+    failed++;
+  }
+  report("decode() + mix", separate_time, s16_time,
+         s16->memoryUsage().buffers, false);
+  report("decodeMix()", mix_time, separate_time,
+         s16->memoryUsage().buffers, true);
+  release(s16);
+}
+
+// the mono downmix and the selection of the right channel against the 16 bit
+// decoding followed by a separate downmix
+void checkDownmix(AVCodecID id) {
+  ADPCMDecoder *s16 = createDecoder(id, AV_SAMPLE_FMT_S16);
+  ADPCMDecoder *downmix = ADPCMDecoderFactory::create(id);
+  downmix->setBlockSize(1024);
+  downmix->setDownmix(true);
+  downmix->begin(sample_rate, channels);
+  ADPCMDecoder *right = ADPCMDecoderFactory::create(id);
+  right->setBlockSize(1024);
+  right->setDecodeChannel(1);
+  right->begin(sample_rate, channels);
+  ADPCMVector<int16_t> mono;
+  mono.resize(s16->frameSize());
+  Timing s16_time, separate_time, downmix_time, right_time;
+  for (int r = 0; r < repeats; r++) {
+    s16_time.add(run(*s16, decodeOnly));
+    separate_time.add(
+        run(*s16, [&](ADPCMDecoder &decoder, uint8_t *data, int size) {
+          AVFrame &frame = decoder.decode(data, size);
+          const int16_t *in = (const int16_t *)frame.data[0];
+          for (int i = 0; i < frame.nb_samples; i++)
+            mono[i] = (in[2 * i] + in[2 * i + 1]) / 2;
+        }));
+    downmix_time.add(run(*downmix, decodeOnly));
+    right_time.add(run(*right, decodeOnly));
+  }
+  // the downmix of each frame matches the average of the decoded channels
+  bool same = true;
+  s16->reset();
+  downmix->reset();
+  for (int j = 0; same && j < packet_count; j++) {
+    uint8_t *data = &packets[j * packet_size];
+    AVFrame &frame = s16->decode(data, packet_size);
+    const int16_t *in = (const int16_t *)frame.data[0];
+    AVFrame &result = downmix->decode(data, packet_size);
+    for (int i = 0; i < result.nb_samples; i++)
+      same = same && ((int16_t *)result.data[0])[i] ==
+                         (in[2 * i] + in[2 * i + 1]) / 2;
+  }
+  if (!same) {
+    printf("  setDownmix() does not match the separate downmix\n");
+    failed++;
+  }
+  report("decode() + downmix", separate_time, s16_time,
+         s16->memoryUsage().buffers + mono.size() * sizeof(int16_t), false);
+  report("setDownmix()", downmix_time, separate_time,
+         downmix->memoryUsage().buffers, true);
+  report("setDecodeChannel()", right_time, s16_time,
+         right->memoryUsage().buffers, true);
+  printf("  %-28s %8.1f ms %6.2fx\n", "setDownmix() vs decode()",
+         downmix_time.ms, downmix_time.ratio(s16_time));
+  release(s16);
+  release(downmix);
+  release(right);
+}
+
+int main() {
+  for (AVCodecID id : codecs) {
+    const char *name = ADPCMDescriptors::find(id)->name;
+    if (!encode(id)) {
+      printf("%s could not be encoded: FAILED\n", name);
+      failed++;
+      continue;
+    }
+    printf("%s: %d packets of %d bytes\n", name, packet_count, packet_size);
+    checkFloat(id);
+    checkSummarize(id);
+    checkMix(id);
+    checkDownmix(id);
+  }
+  printf("%s\n", failed == 0 ? "OK" : "FAILED");
+  return failed == 0 ? 0 : 1;
+}
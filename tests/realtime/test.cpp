@@ -0,0 +1,310 @@
+/**
+ * Real time safety test: after begin() the encode() and decode() calls must
+ * not allocate memory, take a lock or write any output. The test is linked
+ * with --wrap for malloc, free, the stdio output functions and
+ * pthread_mutex_lock and counts the calls while the codecs are processing
+ * audio, corrupt packets and truncated packets. The default logger is used:
+ * it queues the messages, which are drained after each case. Any call fails
+ * the test. The encoders are also
+ * fed with float and packed 24 bit input: without dither the packets must
+ * match the 16 bit encoding. Except for the planar mono codecs this also
+ * holds without setInputFormat().
+ */
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ADPCM.h"
+#include "../benchmark/SignalGenerator.h"
+// routes operator new to the wrapped malloc
+#include "../benchmark/AllocationCounter.h"
+
+using namespace adpcm_ffmpeg;
+
+const int block_sizes[] = {256, 1024};
+const int trellis_levels[] = {0, 4};
+const int calls = 100;
+
+// counts the calls while the codecs are processing
+static bool guard_active = false;
+static long allocations = 0;
+static long outputs = 0;
+static long locks = 0;
+
+extern "C" {
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+int __real_vprintf(const char *fmt, va_list args);
+int __real_vfprintf(FILE *file, const char *fmt, va_list args);
+int __real_puts(const char *str);
+int __real_fputs(const char *str, FILE *file);
+size_t __real_fwrite(const void *ptr, size_t size, size_t n, FILE *file);
+int __real_putchar(int c);
+int __real_pthread_mutex_lock(pthread_mutex_t *mutex);
+
+void *__wrap_malloc(size_t size) {
+  if (guard_active) allocations++;
+  return __real_malloc(size);
+}
+void *__wrap_calloc(size_t n, size_t size) {
+  if (guard_active) allocations++;
+  return __real_calloc(n, size);
+}
+void *__wrap_realloc(void *ptr, size_t size) {
+  if (guard_active) allocations++;
+  return __real_realloc(ptr, size);
+}
+void __wrap_free(void *ptr) {
+  if (guard_active) allocations++;
+  __real_free(ptr);
+}
+int __wrap_printf(const char *fmt, ...) {
+  if (guard_active) outputs++;
+  va_list args;
+  va_start(args, fmt);
+  int result = __real_vprintf(fmt, args);
+  va_end(args);
+  return result;
+}
+int __wrap_vprintf(const char *fmt, va_list args) {
+  if (guard_active) outputs++;
+  return __real_vprintf(fmt, args);
+}
+int __wrap_fprintf(FILE *file, const char *fmt, ...) {
+  if (guard_active) outputs++;
+  va_list args;
+  va_start(args, fmt);
+  int result = __real_vfprintf(file, fmt, args);
+  va_end(args);
+  return result;
+}
+int __wrap_vfprintf(FILE *file, const char *fmt, va_list args) {
+  if (guard_active) outputs++;
+  return __real_vfprintf(file, fmt, args);
+}
+int __wrap_puts(const char *str) {
+  if (guard_active) outputs++;
+  return __real_puts(str);
+}
+int __wrap_fputs(const char *str, FILE *file) {
+  if (guard_active) outputs++;
+  return __real_fputs(str, file);
+}
+size_t __wrap_fwrite(const void *ptr, size_t size, size_t n, FILE *file) {
+  if (guard_active) outputs++;
+  return __real_fwrite(ptr, size, n, file);
+}
+int __wrap_putchar(int c) {
+  if (guard_active) outputs++;
+  return __real_putchar(c);
+}
+int __wrap_pthread_mutex_lock(pthread_mutex_t *mutex) {
+  if (guard_active) locks++;
+  return __real_pthread_mutex_lock(mutex);
+}
+}
+
+ADPCMVector<int16_t> pcm;
+// the same signal as float and as packed 24 bit samples
+ADPCMVector<float> pcm_float;
+ADPCMVector<uint8_t> pcm_24;
+ADPCMVector<uint8_t> packets;
+ADPCMVector<int> packet_sizes;
+uint32_t seed = 12345;
+long messages = 0;
+int failed = 0;
+
+uint8_t randomByte() {
+  seed = seed * 1664525u + 1013904223u;
+  return seed >> 24;
+}
+
+void startGuard() {
+  allocations = outputs = locks = 0;
+  guard_active = true;
+}
+
+void stopGuard() { guard_active = false; }
+
+bool encode(ADPCMEncoder &encoder, int channels) {
+  int frame = encoder.frameSize() * channels;
+  int frames = pcm.size() / frame;
+  for (int j = 0; j < calls; j++) {
+    AVPacket &packet = encoder.encode(&pcm[(j % frames) * frame], frame);
+    if (packet.size <= 0) return false;
+    // the packets are copied outside of the guarded section
+    stopGuard();
+    int pos = packets.size();
+    packets.resize(pos + packet.size);
+    memcpy(&packets[pos], packet.data, packet.size);
+    packet_sizes.push_back(packet.size);
+    guard_active = true;
+  }
+  return true;
+}
+
+// encodes the float or 24 bit input: without dither the packets must match
+// the 16 bit encoding
+bool encodeConverted(ADPCMEncoder &encoder, int channels, bool use24,
+                     bool dither) {
+  int frame = encoder.frameSize() * channels;
+  int frames = pcm.size() / frame;
+  int pos = 0;
+  bool ok = true;
+  encoder.setDither(dither);
+  for (int j = 0; j < calls; j++) {
+    int start = (j % frames) * frame;
+    AVPacket &packet = use24 ? encoder.encode24(&pcm_24[start * 3], frame)
+                             : encoder.encode(&pcm_float[start], frame);
+    if (!dither)
+      ok = ok && packet.size == packet_sizes[j] &&
+           memcmp(packet.data, &packets[pos], packet.size) == 0;
+    pos += packet_sizes[j];
+  }
+  return ok;
+}
+
+void decode(ADPCMDecoder &decoder) {
+  int pos = 0;
+  for (int j = 0; j < packet_sizes.size(); j++) {
+    decoder.decode(&packets[pos], packet_sizes[j]);
+    pos += packet_sizes[j];
+  }
+}
+
+// random and truncated packets
+void decodeCorrupt(ADPCMDecoder &decoder, int block) {
+  for (int j = 0; j < calls; j++) {
+    for (int i = 0; i < block; i++) packets[i] = randomByte();
+    decoder.decode(&packets[0], j % 2 == 0 ? block : block / 2);
+  }
+}
+
+void report(const char *name, int channels, int blockSize, int level,
+            const char *op) {
+  stopGuard();
+  // the log messages are drained outside of the guarded section
+  char msg[ADPCM_LOG_BUFFER_SIZE];
+  while (ADPCMLogger::instance().read(msg, sizeof(msg))) messages++;
+  bool ok = allocations == 0 && outputs == 0 && locks == 0;
+  if (!ok) failed++;
+  printf("%-12s %2d %5d %2d %-7s | %6ld %6ld %6ld | %s\n", name, channels,
+         blockSize, level, op, allocations, outputs, locks,
+         ok ? "ok" : "FAILED");
+}
+
+// without setInputFormat() the interleaved codecs convert in the encode loop:
+// no buffer is needed
+bool encodeUndefinedFormat(const ADPCMDescriptor &desc, int channels,
+                           int blockSize, int sampleRate) {
+  ADPCMEncoder *encoder = ADPCMEncoderFactory::create(desc.id);
+  encoder->setBlockSize(blockSize);
+  bool ok = encoder->begin(sampleRate, channels);
+  if (ok && !(encoder->isPlanar() && channels == 1)) {
+    startGuard();
+    ok = encodeConverted(*encoder, channels, false, false);
+    report(desc.name, channels, blockSize, 0, ok ? "no fmt" : "no fmt !=");
+    if (!ok) failed++;
+  }
+  encoder->end();
+  delete encoder;
+  return ok;
+}
+
+void run(const ADPCMDescriptor &desc, int channels, int blockSize,
+         int level) {
+  int sample_rate = desc.id == AV_CODEC_ID_ADPCM_IMA_AMV ? 22050 : 44100;
+  packets.resize(0);
+  packet_sizes.resize(0);
+
+  if (desc.has_encoder) {
+    ADPCMEncoder *encoder = ADPCMEncoderFactory::create(desc.id);
+    encoder->setBlockSize(blockSize);
+    encoder->setInputFormat(AV_SAMPLE_FMT_FLT);
+    bool ok = encoder->setTrellis(level) &&
+              encoder->begin(sample_rate, channels);
+    if (ok) {
+      startGuard();
+      ok = encode(*encoder, channels);
+      report(desc.name, channels, blockSize, level, "enc");
+    }
+    if (ok) {
+      // the converted input continues with a new stream
+      encoder->reset();
+      startGuard();
+      ok = encodeConverted(*encoder, channels, false, false);
+      report(desc.name, channels, blockSize, level, ok ? "flt" : "flt !=");
+      encoder->reset();
+      startGuard();
+      ok = ok && encodeConverted(*encoder, channels, true, false);
+      report(desc.name, channels, blockSize, level, ok ? "24" : "24 !=");
+      startGuard();
+      encodeConverted(*encoder, channels, false, true);
+      report(desc.name, channels, blockSize, level, "dither");
+      if (!ok) failed++;
+    }
+    encoder->end();
+    delete encoder;
+    if (!ok) return;
+    if (level == 0 &&
+        !encodeUndefinedFormat(desc, channels, blockSize, sample_rate))
+      return;
+  }
+  if (!desc.has_decoder || level > 0) return;
+
+  ADPCMDecoder *decoder = ADPCMDecoderFactory::create(desc.id);
+  decoder->setBlockSize(blockSize);
+  if (decoder->begin(sample_rate, channels)) {
+    int block = decoder->ctx().block_align;
+    if (packet_sizes.size() == 0) {
+      packets.resize(block * calls);
+      memset(&packets[0], 0, packets.size());
+      for (int j = 0; j < calls; j++) packet_sizes.push_back(block);
+    }
+    startGuard();
+    decode(*decoder);
+    report(desc.name, channels, blockSize, level, "dec");
+
+    startGuard();
+    decodeCorrupt(*decoder, block);
+    report(desc.name, channels, blockSize, level, "corrupt");
+  }
+  decoder->end();
+  delete decoder;
+}
+
+int main() {
+  printf("%-12s %2s %5s %2s %-7s | %6s %6s %6s |\n", "codec", "ch", "block",
+         "tr", "op", "allocs", "output", "locks");
+  for (int j = 0; j < ADPCMDescriptors::count(); j++) {
+    const ADPCMDescriptor &desc = ADPCMDescriptors::get(j);
+    // the frame size of the other codecs depends on the content
+    if (desc.frame_size == nullptr) continue;
+    for (int ch = 1; ch <= 2; ch++) {
+      if (ch < desc.min_channels || ch > desc.max_channels) continue;
+      SignalGenerator generator(Speech, 44100, ch);
+      pcm.resize(44100 * ch);
+      generator.fill(&pcm[0], 44100);
+      pcm_float.resize(pcm.size());
+      pcm_24.resize(pcm.size() * 3);
+      for (int i = 0; i < pcm.size(); i++) {
+        pcm_float[i] = pcm[i] / 32768.0f;
+        AV_WL24(&pcm_24[i * 3], (uint32_t)pcm[i] << 8);
+      }
+      for (int blockSize : block_sizes) {
+        for (int level : trellis_levels) {
+          if (level > 0 && !(desc.trellis && desc.has_encoder)) continue;
+          run(desc, ch, blockSize, level);
+        }
+      }
+    }
+  }
+  printf("\n%ld log messages were collected, %u dropped\n", messages,
+         (unsigned)ADPCMLogger::instance().suppressedCount());
+  printf("%s\n", failed == 0 ? "OK" : "FAILED");
+  return failed == 0 ? 0 : 1;
+}
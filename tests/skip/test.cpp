@@ -0,0 +1,161 @@
+/**
+ * State-only skip: for the decoders which implement skip_frame_impl() we
+ * decode one stream and skip a second stream with the same packets. After
+ * every packet both stream states must be identical, and skip() must report
+ * the samples of decode(). This is checked with random bytes, which cover
+ * the clipping of the predictor and of the step index, and with encoded
+ * speech. Then we report the time per packet of decode() and skip() for the
+ * speech packets: skip() must be at least min_speedup times faster (the
+ * median of paired runs). IMA_OKI and CT have no encoder: they get the
+ * IMA_SSI packets, which have the same byte layout.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include "ADPCM.h"
+#include "../benchmark/SignalGenerator.h"
+
+using namespace adpcm_ffmpeg;
+
+// The IMA codecs look up the step index and the predictor change per byte.
+// CT and YAMAHA adapt the step size with a multiplication: this chain limits
+// decode() and skip() alike, so skip() must only not be slower.
+const struct {
+  AVCodecID id;
+  double min_speedup;
+} codecs[] = {{AV_CODEC_ID_ADPCM_IMA_SSI, 1.5}, {AV_CODEC_ID_ADPCM_IMA_APM, 1.5},
+              {AV_CODEC_ID_ADPCM_IMA_ALP, 1.5}, {AV_CODEC_ID_ADPCM_IMA_OKI, 1.5},
+              {AV_CODEC_ID_ADPCM_CT, 0.9},      {AV_CODEC_ID_ADPCM_YAMAHA, 0.9}};
+const int block_size = 1024;
+const int packets = 64;
+const int timing_loops = 20;
+const int runs = 11;
+int failed = 0;
+
+ADPCMVector<uint8_t> random_data, speech_data;
+// packets of the current check
+ADPCMVector<uint8_t> *data = &random_data;
+
+uint64_t now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+bool equals(const ADPCMChannelStatus &a, const ADPCMChannelStatus &b) {
+  return a.predictor == b.predictor && a.step_index == b.step_index &&
+         a.step == b.step && a.prev_sample == b.prev_sample &&
+         a.sample1 == b.sample1 && a.sample2 == b.sample2 &&
+         a.coeff1 == b.coeff1 && a.coeff2 == b.coeff2 && a.idelta == b.idelta;
+}
+
+bool equals(const ADPCMStreamState &a, const ADPCMStreamState &b,
+            int channels) {
+  for (int ch = 0; ch < channels; ch++)
+    if (!equals(a.channel[ch].status, b.channel[ch].status)) return false;
+  return a.vqa_version == b.vqa_version && a.has_status == b.has_status;
+}
+
+// decodes and skips the packets with separate states of the same decoder
+bool checkState(ADPCMDecoder &decoder, int channels) {
+  ADPCMStreamState decoded, skipped;
+  if (!decoder.initState(decoded) || !decoder.initState(skipped)) return false;
+  for (int j = 0; j < packets; j++) {
+    AVPacket packet;
+    packet.data = &(*data)[j * block_size];
+    packet.size = block_size;
+    int samples = decoder.decode(decoded, packet).nb_samples;
+    if (samples == 0 || decoder.skip(skipped, packet) != samples ||
+        !equals(decoded, skipped, channels))
+      return false;
+  }
+  return true;
+}
+
+// time per packet in ns
+double measure(ADPCMDecoder &decoder, bool skip) {
+  uint64_t start = now();
+  for (int loop = 0; loop < timing_loops; loop++) {
+    for (int j = 0; j < packets; j++) {
+      if (skip)
+        decoder.skip(&(*data)[j * block_size], block_size);
+      else
+        decoder.decode(&(*data)[j * block_size], block_size);
+    }
+  }
+  return (double)(now() - start) / (timing_loops * packets);
+}
+
+// encodes speech into the packets: false if the codec has no encoder
+bool encodeSpeech(AVCodecID id, int channels) {
+  ADPCMEncoder *encoder = ADPCMEncoderFactory::create(id);
+  if (encoder == nullptr) return false;
+  encoder->setBlockSize(block_size);
+  bool ok = encoder->begin(44100, channels);
+  int frame = encoder->frameSize() * channels;
+  ADPCMVector<int16_t> pcm;
+  pcm.resize(packets * frame);
+  SignalGenerator generator(Speech, 44100, channels);
+  generator.fill(&pcm[0], packets * encoder->frameSize());
+  for (int j = 0; ok && j < packets; j++) {
+    AVPacket &packet = encoder->encode(&pcm[j * frame], frame);
+    ok = packet.size == block_size;
+    if (ok) memcpy(&speech_data[j * block_size], packet.data, block_size);
+  }
+  encoder->end();
+  delete encoder;
+  return ok;
+}
+
+int main() {
+  random_data.resize(packets * block_size + AV_INPUT_BUFFER_PADDING_SIZE);
+  speech_data.resize(random_data.size());
+  uint32_t seed = 12345;
+  for (size_t j = 0; j < random_data.size(); j++) {
+    seed = seed * 1664525u + 1013904223u;
+    random_data[j] = seed >> 24;
+  }
+  printf("%-10s %2s | %5s | %10s %10s %7s |\n", "codec", "ch", "state",
+         "decode ns", "skip ns", "speedup");
+  for (const auto &codec : codecs) {
+    AVCodecID id = codec.id;
+    for (int channels = 1; channels <= 2; channels++) {
+      ADPCMDecoder *decoder = ADPCMDecoderFactory::create(id);
+      decoder->setBlockSize(block_size);
+      bool ok = decoder->begin(44100, channels);
+      data = &random_data;
+      ok = ok && checkState(*decoder, channels);
+      bool encoded = ADPCMDescriptors::find(id)->has_encoder
+                         ? encodeSpeech(id, channels)
+                         : encodeSpeech(AV_CODEC_ID_ADPCM_IMA_SSI, channels);
+      data = &speech_data;
+      bool state_ok = ok && encoded && checkState(*decoder, channels);
+      // the best times and the median of the paired speedups
+      double decode_ns = 0, skip_ns = 0, speedup = 0;
+      double speedups[runs];
+      for (int run = 0; state_ok && run < runs; run++) {
+        double decode_run = measure(*decoder, false);
+        double skip_run = measure(*decoder, true);
+        speedups[run] = decode_run / skip_run;
+        if (run == 0 || decode_run < decode_ns) decode_ns = decode_run;
+        if (run == 0 || skip_run < skip_ns) skip_ns = skip_run;
+      }
+      if (state_ok) {
+        std::sort(speedups, speedups + runs);
+        speedup = speedups[runs / 2];
+      }
+      ok = state_ok && speedup >= codec.min_speedup;
+      if (!ok) failed++;
+      printf("%-10s %2d | %5s | %10.0f %10.0f %6.2fx | %s\n",
+             ADPCMDescriptors::find(id)->name, channels,
+             state_ok ? "ok" : "FAILED", decode_ns, skip_ns, speedup,
+             ok ? "ok" : "FAILED");
+      decoder->end();
+      delete decoder;
+    }
+  }
+  printf("%s\n", failed == 0 ? "OK" : "FAILED");
+  return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,99 @@
+/**
+ * Codec statistics (ADPCM_STATS): one encoder and one decoder serve two
+ * streams with their own ADPCMStreamState. The counters must be attributed
+ * to the stream which was processed: the streams get a different number of
+ * packets, one of them a corrupt packet, and the calls without state count
+ * in the codec.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "ADPCM.h"
+#include "../benchmark/SignalGenerator.h"
+
+using namespace adpcm_ffmpeg;
+
+const AVCodecID codec = AV_CODEC_ID_ADPCM_IMA_WAV;
+const int sample_rate = 44100;
+const int channels = 2;
+const int packets[] = {3, 5};
+int failures = 0;
+
+void check(const char *name, bool ok) {
+  printf("%-44s %s\n", name, ok ? "ok" : "FAILED");
+  if (!ok) failures++;
+}
+
+int main() {
+  ADPCMEncoder *encoder = ADPCMEncoderFactory::create(codec);
+  ADPCMDecoder *decoder = ADPCMDecoderFactory::create(codec);
+  encoder->setBlockSize(1024);
+  decoder->setBlockSize(1024);
+  if (!encoder->begin(sample_rate, channels) ||
+      !decoder->begin(sample_rate, channels)) {
+    printf("FAILED\n");
+    return 1;
+  }
+  int frame = encoder->frameSize() * channels;
+  ADPCMVector<int16_t> pcm;
+  pcm.resize(frame * 5);
+  SignalGenerator generator(Speech, sample_rate, channels);
+  generator.fill(&pcm[0], frame * 5 / channels);
+
+  ADPCMStreamStateIMA enc_state[2], dec_state[2];
+  for (int s = 0; s < 2; s++) {
+    encoder->initState(enc_state[s]);
+    decoder->initState(dec_state[s]);
+  }
+  int packet_size = 0;
+  for (int s = 0; s < 2; s++) {
+    for (int j = 0; j < packets[s]; j++) {
+      AVPacket &packet = encoder->encode(enc_state[s], &pcm[j * frame], frame);
+      packet_size = packet.size;
+      decoder->decode(dec_state[s], packet);
+    }
+  }
+  // a packet which is shorter than the block header is rejected
+  uint8_t corrupt[3] = {0};
+  decoder->decode(dec_state[1], corrupt, sizeof(corrupt));
+  // a call without state counts in the decoder
+  AVPacket &packet = encoder->encode(&pcm[0], frame);
+  decoder->decode(packet);
+
+  for (int s = 0; s < 2; s++) {
+    ADPCMStats enc = enc_state[s].stats();
+    ADPCMStats dec = dec_state[s].stats();
+    int samples = packets[s] * encoder->frameSize();
+    printf("stream %d: %u frames, %llu samples, %llu bytes, %u invalid, "
+           "%u step floor, %llu ns\n",
+           s, dec.frames, (unsigned long long)dec.samples,
+           (unsigned long long)dec.bytes, dec.invalid_packets, dec.step_floor,
+           (unsigned long long)dec.ns);
+    check("encoder frames and samples of the stream",
+          enc.frames == packets[s] && enc.samples == samples);
+    check("encoder bytes of the stream",
+          enc.bytes == (uint64_t)packets[s] * packet_size);
+    check("decoder frames, samples and bytes of the stream",
+          dec.frames == packets[s] && dec.samples == samples &&
+              dec.bytes == (uint64_t)packets[s] * packet_size);
+    check("decoder invalid packets of the stream",
+          dec.invalid_packets == (s == 1 ? 1 : 0));
+    check("processing time of the stream", dec.ns > 0 && enc.ns > 0);
+  }
+  check("encoder counts the call without state",
+        encoder->stats().frames == 1);
+  check("decoder counts the call without state",
+        decoder->stats().frames == 1 &&
+            decoder->stats().invalid_packets == 0);
+
+  // a new stream starts with empty counters
+  decoder->initState(dec_state[0]);
+  check("initState() resets the counters", dec_state[0].stats().frames == 0);
+
+  encoder->end();
+  decoder->end();
+  delete encoder;
+  delete decoder;
+  printf("%s\n", failures == 0 ? "OK" : "FAILED");
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,93 @@
+/**
+ * Checks that the table driven SWF decoder produces the same output as the
+ * bit-serial reference implementation and compares the decoding speed.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <iostream>
+#include "ADPCM.h"
+
+using namespace adpcm_ffmpeg;
+
+const int max_packet = 4096;
+const int max_samples = max_packet * 8;
+uint8_t packet[max_packet + AV_INPUT_BUFFER_PADDING_SIZE];
+int16_t result[max_samples];
+int16_t expected[max_samples];
+
+// decodes the packet with both implementations: returns false on differences
+bool compare(int channels, int size) {
+  DecoderADPCM_SWF fast, reference;
+  fast.begin(44100, channels);
+  reference.begin(44100, channels);
+  memset(result, 0, sizeof(result));
+  memset(expected, 0, sizeof(expected));
+  fast.adpcm_swf_decode(packet, size, result, max_samples);
+  reference.adpcm_swf_decode_reference(packet, size, expected);
+  return memcmp(result, expected, sizeof(result)) == 0;
+}
+
+double measure(DecoderADPCM_SWF &decoder, bool reference, int size,
+               int loops) {
+  auto start = std::chrono::steady_clock::now();
+  for (int j = 0; j < loops; j++) {
+    if (reference)
+      decoder.adpcm_swf_decode_reference(packet, size, expected);
+    else
+      decoder.adpcm_swf_decode(packet, size, result, max_samples);
+  }
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+int main() {
+  int errors = 0;
+  srand(1);
+
+  // random packets for all code sizes, mono and stereo
+  for (int channels = 1; channels <= 2; channels++) {
+    for (int j = 0; j < 4000; j++) {
+      int size = 1 + rand() % max_packet;
+      for (int i = 0; i < size; i++) packet[i] = rand();
+      if (!compare(channels, size)) {
+        printf("random packet: channels %d, size %d, bits %d: differs\n",
+               channels, size, (packet[0] & 3) + 2);
+        errors++;
+      }
+    }
+  }
+
+  // packets created by the encoder
+  for (int channels = 1; channels <= 2; channels++) {
+    EncoderADPCM_SWF encoder;
+    encoder.begin(44100, channels);
+    int frame_size = encoder.frameSize() * channels;
+    ADPCMVector<int16_t> samples(frame_size);
+    samples.resize(frame_size);
+    for (int i = 0; i < frame_size; i++) samples[i] = rand() % 20000 - 10000;
+    AVPacket &pkt = encoder.encode(&samples[0], frame_size);
+    memcpy(packet, pkt.data, pkt.size);
+    if (!compare(channels, pkt.size)) {
+      printf("encoded packet: channels %d: differs\n", channels);
+      errors++;
+    }
+    encoder.end();
+  }
+
+  // speed
+  for (int size = 1; size < max_packet; size++) packet[size] = rand();
+  for (int bits = 2; bits <= 5; bits++) {
+    packet[0] = (packet[0] & ~3) | (bits - 2);
+    DecoderADPCM_SWF decoder;
+    decoder.begin(44100, 1);
+    double ref_ms = measure(decoder, true, max_packet, 2000);
+    double fast_ms = measure(decoder, false, max_packet, 2000);
+    printf("%d bits: reference %.1f ms, table %.1f ms, speedup %.2f\n", bits,
+           ref_ms, fast_ms, ref_ms / fast_ms);
+  }
+
+  printf("%s\n", errors == 0 ? "OK" : "FAILED");
+  return errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,142 @@
+/**
+ * Trellis sweep: encodes a test signal with every codec which supports
+ * trellis quantization for the levels 0 to max-level, decodes it with the
+ * matching decoder and reports the SNR and the segmental SNR against the
+ * encoding time per second of audio. The trellis levels must not lower the
+ * SNR compared to level 0.
+ *
+ * Usage: trellis [max-level] [sine|noise|chirp|silence|speech]
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include "ADPCM.h"
+#include "../benchmark/SignalGenerator.h"
+
+using namespace adpcm_ffmpeg;
+
+const int seconds = 2;
+// tolerated SNR loss of a trellis level compared to level 0
+const double max_loss_db = 0.1;
+int failures = 0;
+const int segment_size = 256;
+// segments which are quieter are ignored by the segmental SNR
+const double silence_rms = 10.0;
+const double max_seg_snr = 60.0;
+
+ADPCMVector<int16_t> pcm;
+ADPCMVector<int16_t> decoded;
+
+struct Quality {
+  double snr = 0;
+  double seg_snr = 0;
+  double ms_per_sec = 0;
+};
+
+double snr(double signal, double noise) {
+  if (noise <= 0) return 99.0;
+  return 10.0 * log10(signal / noise);
+}
+
+Quality measure(int count) {
+  Quality result;
+  double signal = 0, noise = 0, seg_sum = 0;
+  int segments = 0;
+  for (int pos = 0; pos + segment_size <= count; pos += segment_size) {
+    double seg_signal = 0, seg_noise = 0;
+    for (int j = pos; j < pos + segment_size; j++) {
+      double d = (double)pcm[j] - decoded[j];
+      seg_signal += (double)pcm[j] * pcm[j];
+      seg_noise += d * d;
+    }
+    signal += seg_signal;
+    noise += seg_noise;
+    if (sqrt(seg_signal / segment_size) < silence_rms) continue;
+    // the segment SNR is clipped: the usual upper limit of 35 dB would hide
+    // the differences between the levels
+    double seg = snr(seg_signal, seg_noise);
+    seg_sum += seg < -10.0 ? -10.0 : seg > max_seg_snr ? max_seg_snr : seg;
+    segments++;
+  }
+  result.snr = snr(signal, noise);
+  result.seg_snr = segments > 0 ? seg_sum / segments : 0;
+  return result;
+}
+
+// encodes and decodes the signal with the indicated trellis level
+bool run(AVCodecID id, int sampleRate, int level, Quality &quality) {
+  ADPCMEncoder *encoder = ADPCMEncoderFactory::create(id);
+  ADPCMDecoder *decoder = ADPCMDecoderFactory::create(id);
+  bool ok = encoder->setTrellis(level) &&
+            encoder->begin(sampleRate, 1) && decoder->begin(sampleRate, 1);
+  int count = 0;
+  double time = 0;
+  if (ok) {
+    int frame = encoder->frameSize();
+    int frames = sampleRate * seconds / frame;
+    decoded.resize(frames * frame);
+    for (int j = 0; j < frames && ok; j++) {
+      auto start = std::chrono::steady_clock::now();
+      AVPacket &packet = encoder->encode(&pcm[j * frame], frame);
+      auto end = std::chrono::steady_clock::now();
+      time += std::chrono::duration<double>(end - start).count();
+      AVFrame &result = decoder->decode(packet);
+      ok = packet.size > 0 && result.nb_samples == frame;
+      if (ok) memcpy(&decoded[count], result.data[0], frame * sizeof(int16_t));
+      count += frame;
+    }
+  }
+  if (ok) {
+    quality = measure(count);
+    quality.ms_per_sec = 1000.0 * time * sampleRate / count;
+  }
+  encoder->end();
+  decoder->end();
+  delete encoder;
+  delete decoder;
+  return ok;
+}
+
+int main(int argc, char **argv) {
+  int max_level = argc > 1 ? atoi(argv[1]) : 8;
+  SignalType signal = Speech;
+  for (int j = 0; argc > 2 && j < signal_count; j++) {
+    if (strcmp(argv[2], signal_names[j]) == 0) signal = (SignalType)j;
+  }
+
+  printf("signal: %s, mono, %d seconds\n\n", signal_names[signal], seconds);
+  printf("%-10s %5s | %8s %8s | %10s %9s\n", "codec", "level", "SNR dB",
+         "segSNR", "enc ms/s", "realtime");
+  for (int j = 0; j < ADPCMDescriptors::count(); j++) {
+    const ADPCMDescriptor &desc = ADPCMDescriptors::get(j);
+    if (!desc.trellis || !desc.has_encoder || !desc.has_decoder) continue;
+    // AMV uses the sample rate of the video
+    int sample_rate = desc.id == AV_CODEC_ID_ADPCM_IMA_AMV ? 22050 : 44100;
+    SignalGenerator generator(signal, sample_rate, 1);
+    pcm.resize(sample_rate * seconds);
+    generator.fill(&pcm[0], sample_rate * seconds);
+
+    double snr0 = 0;
+    for (int level = 0; level <= max_level; level++) {
+      Quality q;
+      if (!run(desc.id, sample_rate, level, q)) {
+        printf("%-10s %5d | failed\n", desc.name, level);
+        failures++;
+        continue;
+      }
+      if (level == 0) snr0 = q.snr;
+      bool ok = level == 0 || q.snr >= snr0 - max_loss_db;
+      if (!ok) failures++;
+      // real time factor of the encoder
+      printf("%-10s %5d | %8.2f %8.2f | %10.3f %8.0fx %s\n", desc.name, level,
+             q.snr, q.seg_snr, q.ms_per_sec, 1000.0 / q.ms_per_sec,
+             ok ? "" : "lower than level 0");
+    }
+    printf("\n");
+  }
+  printf("%s\n", failures == 0 ? "OK" : "FAILED");
+  return failures == 0 ? 0 : 1;
+}
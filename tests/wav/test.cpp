@@ -0,0 +1,398 @@
+/**
+ * WAV container test: decodes the ffmpeg generated WAV files of test-data
+ * with the configuration from the header and compares the result with
+ * original.wav. Then the original is encoded with ADPCMWavWriter, read back
+ * and checked in the same way. We report the SNR and the number of blocks
+ * which had to be copied because the file does not provide the padding.
+ * Finally we seek to random positions and compare the result with the
+ * sequential decoding: for the codecs with dependent blocks this is repeated
+ * with a checkpoint index which is loaded from a sidecar file. Raw streams
+ * of codecs without container are read with ADPCMRawReader and checked in
+ * the same way. The float
+ * and int32 output formats, the mixing of two voices, a channel swap, the
+ * mono downmix, the decoding of a single channel and the waveform envelope
+ * are checked against the 16 bit result.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "ADPCM.h"
+#include "ADPCMRawReader.h"
+#include "ADPCMWav.h"
+
+using namespace adpcm_ffmpeg;
+
+// swf.wav is not included: ffmpeg writes the SWF bit stream MSB first, the
+// bit reader of this library is configured for LSB first
+const char *files[] = {"ima_wav.wav", "ms.wav", "yamaha.wav"};
+const AVCodecID codecs[] = {AV_CODEC_ID_ADPCM_IMA_WAV, AV_CODEC_ID_ADPCM_MS,
+                            AV_CODEC_ID_ADPCM_SWF, AV_CODEC_ID_ADPCM_YAMAHA};
+// raw streams without container
+const AVCodecID raw_codecs[] = {AV_CODEC_ID_ADPCM_IMA_SSI,
+                                AV_CODEC_ID_ADPCM_IMA_APM,
+                                AV_CODEC_ID_ADPCM_IMA_ALP,
+                                AV_CODEC_ID_ADPCM_IMA_WS};
+const AVSampleFormat formats[] = {AV_SAMPLE_FMT_FLT, AV_SAMPLE_FMT_S32};
+const double min_snr = 20.0;
+const char *tmp_file = "/tmp/adpcm-wav-test.wav";
+const char *index_file = "/tmp/adpcm-wav-test.idx";
+
+// interleaved 16 bit samples of original.wav
+const int16_t *original = nullptr;
+int original_samples = 0;
+int original_channels = 0;
+int failed = 0;
+// result of the sequential decoding
+ADPCMVector<int16_t> decoded_pcm;
+uint32_t seed = 12345;
+
+// the original is PCM: we just locate the data chunk
+bool loadOriginal(const char *path) {
+  FILE *file = fopen(path, "rb");
+  if (file == nullptr) return false;
+  static ADPCMVector<uint8_t> content;
+  fseek(file, 0, SEEK_END);
+  content.resize(ftell(file));
+  fseek(file, 0, SEEK_SET);
+  size_t size = fread(&content[0], 1, content.size(), file);
+  fclose(file);
+  for (size_t pos = 12; pos + 8 <= size;) {
+    uint32_t chunk_size = AV_RL32(&content[pos + 4]);
+    if (memcmp(&content[pos], "fmt ", 4) == 0)
+      original_channels = AV_RL16(&content[pos + 10]);
+    if (memcmp(&content[pos], "data", 4) == 0) {
+      original = (const int16_t *)&content[pos + 8];
+      original_samples = FFMIN(chunk_size, size - pos - 8) / 2;
+      return true;
+    }
+    pos += 8 + chunk_size + (chunk_size & 1);
+  }
+  return false;
+}
+
+// compares n samples in the output format of the decoder with the sequential
+// decoding: the int32 output is only tested with a gain of 1
+bool matches(ADPCMDecoder &decoder, const uint8_t *data, int pos, int n) {
+  for (int i = 0; i < n; i++) {
+    int16_t expected = decoded_pcm[pos + i];
+    bool ok;
+    switch (decoder.outputFormat()) {
+      case AV_SAMPLE_FMT_FLT:
+        ok = ((const float *)data)[i] == expected * decoder.gain() / 32768.0f;
+        break;
+      case AV_SAMPLE_FMT_S32:
+        ok = ((const int32_t *)data)[i] == expected * 65536;
+        break;
+      default:
+        ok = ((const int16_t *)data)[i] == expected;
+        break;
+    }
+    if (!ok) return false;
+  }
+  return true;
+}
+
+// seeks to random positions: the result must match the sequential decoding
+bool checkSeek(ADPCMWavReader &reader, ADPCMDecoder &decoder, int decoded) {
+  int channels = reader.info().channels;
+  for (int j = 0; j < 100; j++) {
+    seed = seed * 1664525u + 1013904223u;
+    int sample = seed % decoded;
+    AVFrame &frame = reader.seekToSample(decoder, sample);
+    int n = FFMIN(frame.nb_samples, decoded - sample) * channels;
+    if (n <= 0 || !matches(decoder, frame.data[0], sample * channels, n))
+      return false;
+    // the next block continues after the sample
+    int next = sample + frame.nb_samples;
+    AVFrame &next_frame = reader.decodeNext(decoder);
+    n = FFMIN(next_frame.nb_samples, decoded - next) * channels;
+    if (n > 0 && !matches(decoder, next_frame.data[0], next * channels, n))
+      return false;
+  }
+  return true;
+}
+
+// seeks with a checkpoint every 8 blocks
+bool checkIndex(ADPCMWavReader &reader, ADPCMDecoder &decoder, int decoded) {
+  ADPCMCheckpointIndex index, sidecar;
+  bool ok = reader.buildIndex(decoder, index, 8 * reader.info().block_align) &&
+            index.save(index_file) && sidecar.open(index_file) &&
+            sidecar.count() == index.count() && reader.setIndex(&sidecar) &&
+            checkSeek(reader, decoder, decoded);
+  reader.setIndex(nullptr);
+  remove(index_file);
+  return ok;
+}
+
+// decodes to float with a gain of 0.5 and to int32: the result must match
+// the 16 bit decoding
+bool checkFormats(ADPCMWavReader &reader, int decoded) {
+  const ADPCMWavInfo &info = reader.info();
+  bool ok = true;
+  for (AVSampleFormat fmt : formats) {
+    ADPCMDecoder *decoder = ADPCMDecoderFactory::create(info.codec_id);
+    decoder->setOutputFormat(fmt);
+    decoder->setGain(fmt == AV_SAMPLE_FMT_FLT ? 0.5f : 1.0f);
+    ok = ok && reader.setupDecoder(*decoder);
+    for (int j = 0, pos = 0; ok && j < reader.blockCount(); j++) {
+      AVFrame &frame = reader.decodeBlock(*decoder, j);
+      int n = frame.nb_samples * info.channels;
+      ok = matches(*decoder, frame.data[0], pos, n);
+      pos += n;
+    }
+    ok = ok && checkSeek(reader, *decoder, decoded);
+    decoder->end();
+    delete decoder;
+  }
+  return ok;
+}
+
+// mixes the file as two voices with the gains 0.25 and 0.75 into a float bus
+// and with a gain of 1 into an int32 bus: the voices share the decoder
+bool checkMix(ADPCMWavReader &reader, ADPCMDecoder &decoder) {
+  const ADPCMWavInfo &info = reader.info();
+  ADPCMStreamState voices[2];
+  ADPCMVector<float> bus;
+  ADPCMVector<int32_t> bus32;
+  bus.resize(decoder.frameSize() * info.channels);
+  bus32.resize(decoder.frameSize() * info.channels);
+  bool ok = decoder.initState(voices[0]) && decoder.initState(voices[1]);
+  for (int j = 0, pos = 0; ok && j < reader.blockCount(); j++) {
+    AVPacket packet;
+    reader.readBlock(j, packet);
+    memset(&bus[0], 0, bus.size() * sizeof(float));
+    memset(&bus32[0], 0, bus32.size() * sizeof(int32_t));
+    // the int32 bus uses copies of the voices
+    ADPCMStreamState copies[2] = {voices[0], voices[1]};
+    int n = decoder.decodeMix(voices[0], packet, &bus[0], 0.25f);
+    decoder.decodeMix(voices[1], packet, &bus[0], 0.75f);
+    decoder.decodeMix(copies[0], packet, &bus32[0], 1.0f);
+    decoder.decodeMix(copies[1], packet, &bus32[0], 1.0f);
+    // the last block is trimmed to the sample count of the fact chunk
+    n = FFMIN(n, (int)(decoded_pcm.size() / info.channels) - pos / info.channels);
+    for (int i = 0; i < n * info.channels; i++, pos++) {
+      ok = ok && bus[i] == decoded_pcm[pos] / 32768.0f &&
+           bus32[i] == 2 * decoded_pcm[pos];
+    }
+  }
+  decoder.reset();
+  return ok;
+}
+
+// decodes with swapped channels, as mono downmix and only the right channel
+// to 16 bit and float
+bool checkChannels(ADPCMWavReader &reader) {
+  const ADPCMWavInfo &info = reader.info();
+  if (info.channels != 2) return true;
+  const int swap[] = {1, 0};
+  bool ok = true;
+  for (int j = 0; j < 6; j++) {
+    bool downmix = j / 2 == 1, single = j / 2 == 2;
+    AVSampleFormat fmt = j % 2 == 0 ? AV_SAMPLE_FMT_S16 : AV_SAMPLE_FMT_FLT;
+    ADPCMDecoder *decoder = ADPCMDecoderFactory::create(info.codec_id);
+    decoder->setOutputFormat(fmt);
+    if (downmix)
+      decoder->setDownmix(true);
+    else if (single)
+      decoder->setDecodeChannel(1);
+    else
+      decoder->setChannelMap(swap, 2);
+    ok = ok && reader.setupDecoder(*decoder);
+    for (int b = 0, pos = 0; ok && b < reader.blockCount(); b++) {
+      AVFrame &frame = reader.decodeBlock(*decoder, b);
+      for (int i = 0; i < frame.nb_samples; i++, pos += 2) {
+        int left = decoded_pcm[pos], right = decoded_pcm[pos + 1];
+        int expected[2] = {right, left};
+        if (downmix) expected[0] = (left + right) / 2;
+        for (int ch = 0; ch < decoder->outputChannels(); ch++) {
+          int k = i * decoder->outputChannels() + ch;
+          ok = ok && (fmt == AV_SAMPLE_FMT_S16
+                          ? ((int16_t *)frame.data[0])[k] == expected[ch]
+                          : ((float *)frame.data[0])[k] ==
+                                expected[ch] / 32768.0f);
+        }
+      }
+    }
+    decoder->end();
+    delete decoder;
+  }
+  return ok;
+}
+
+// summarizes the file in buckets of 1000 samples: in one pass and in two
+// halves which are merged. The halves use separate decoders if the blocks are
+// independent.
+bool checkEnvelope(ADPCMWavReader &reader, ADPCMDecoder &decoder,
+                   int decoded) {
+  const ADPCMWavInfo &info = reader.info();
+  ADPCMEnvelope envelope, first, second;
+  ADPCMDecoder *other =
+      decoder.hasIndependentBlocks() ? reader.createDecoder() : nullptr;
+  ADPCMDecoder &second_decoder = other != nullptr ? *other : decoder;
+  int half = reader.blockCount() / 2;
+  bool ok = envelope.begin(1000, info.channels, decoded) &&
+            first.begin(1000, info.channels) &&
+            second.begin(1000, info.channels) &&
+            reader.summarize(decoder, envelope) &&
+            reader.summarize(decoder, first, 0, half) &&
+            reader.summarize(second_decoder, second, half) &&
+            first.merge(second) &&
+            envelope.count() == (decoded + 999) / 1000 &&
+            first.count() == envelope.count();
+  for (int j = 0; ok && j < envelope.count(); j++) {
+    for (int ch = 0; ch < info.channels; ch++) {
+      ADPCMEnvelopeBucket expected;
+      for (int i = j * 1000; i < FFMIN(decoded, (j + 1) * 1000); i++)
+        expected.add(decoded_pcm[i * info.channels + ch]);
+      const ADPCMEnvelopeBucket &bucket = envelope.bucket(j, ch);
+      const ADPCMEnvelopeBucket &merged = first.bucket(j, ch);
+      ok = bucket.min == expected.min && bucket.max == expected.max &&
+           bucket.count == expected.count &&
+           bucket.sum_squares == expected.sum_squares &&
+           merged.min == expected.min && merged.max == expected.max &&
+           merged.sum_squares == expected.sum_squares;
+    }
+  }
+  if (other != nullptr) other->end();
+  delete other;
+  return ok;
+}
+
+// decodes all blocks and compares them with the original
+void check(const char *name, ADPCMWavReader &reader) {
+  const ADPCMWavInfo &info = reader.info();
+  ADPCMDecoder *decoder = reader.createDecoder();
+  if (decoder == nullptr || info.channels != original_channels) {
+    printf("%-20s could not be decoded | FAILED\n", name);
+    failed++;
+    delete decoder;
+    return;
+  }
+  double signal = 0, noise = 0;
+  int pos = 0, copied = 0, decoded = 0;
+  decoded_pcm.resize(0);
+  for (int j = 0; j < reader.blockCount(); j++) {
+    AVPacket packet;
+    reader.readBlock(j, packet);
+    const uint8_t *data = info.data + (size_t)j * info.block_align;
+    if (packet.data != data) copied++;
+    AVFrame &frame = reader.decodeBlock(*decoder, j);
+    int16_t *samples = (int16_t *)frame.data[0];
+    int n = frame.nb_samples * info.channels;
+    decoded += frame.nb_samples;
+    decoded_pcm.resize(decoded * info.channels);
+    memcpy(&decoded_pcm[decoded_pcm.size() - n], samples, n * sizeof(int16_t));
+    for (int i = 0; i < n && pos < original_samples; i++, pos++) {
+      double diff = samples[i] - original[pos];
+      signal += (double)original[pos] * original[pos];
+      noise += diff * diff;
+    }
+  }
+  double snr = 10 * log10(signal / FFMAX(noise, 1.0));
+  bool ok = snr >= min_snr && decoded > 0 &&
+            (info.total_samples == 0 || decoded == info.total_samples) &&
+            checkSeek(reader, *decoder, decoded) &&
+            (decoder->hasIndependentBlocks() ||
+             checkIndex(reader, *decoder, decoded)) &&
+            checkFormats(reader, decoded) && checkMix(reader, *decoder) &&
+            checkChannels(reader) && checkEnvelope(reader, *decoder, decoded);
+  if (!ok) failed++;
+  printf("%-20s %5d %4d %7d %7d %4d | %6.1f | %s\n", name, info.block_align,
+         info.extradata_size, decoded, reader.blockCount(), copied, snr,
+         ok ? "ok" : "FAILED");
+  decoder->end();
+  delete decoder;
+}
+
+// encodes the original with the writer in chunks of odd size
+bool write(AVCodecID id) {
+  ADPCMEncoder *encoder = ADPCMEncoderFactory::create(id);
+  encoder->setBlockSize(1024);
+  FILE *file = fopen(tmp_file, "wb");
+  ADPCMWavWriter writer;
+  bool ok = file != nullptr && encoder->begin(44100, original_channels) &&
+            writer.begin(*encoder, file);
+  for (int pos = 0; ok && pos < original_samples; pos += 1000) {
+    int n = FFMIN(1000, original_samples - pos);
+    ok = writer.write(original + pos, n) == (size_t)n;
+  }
+  ok = ok && writer.end();
+  if (file != nullptr) fclose(file);
+  encoder->end();
+  delete encoder;
+  return ok;
+}
+
+// encodes the full frames of the original as raw stream of fixed packets
+bool writeRaw(AVCodecID id, ADPCMVector<uint8_t> &raw, int &packetSize) {
+  ADPCMEncoder *encoder = ADPCMEncoderFactory::create(id);
+  encoder->setBlockSize(1024);
+  bool ok = encoder->begin(44100, original_channels);
+  int frame = encoder->frameSize() * original_channels;
+  raw.resize(0);
+  packetSize = 0;
+  for (int pos = 0; ok && pos + frame <= original_samples; pos += frame) {
+    AVPacket &packet = encoder->encode((int16_t *)original + pos, frame);
+    ok = packet.size > 0 && (packetSize == 0 || packet.size == packetSize);
+    packetSize = packet.size;
+    size_t size = raw.size();
+    raw.resize(size + packet.size);
+    memcpy(&raw[size], packet.data, packet.size);
+  }
+  encoder->end();
+  delete encoder;
+  return ok && raw.size() > 0;
+}
+
+int main() {
+  ADPCMWavReader reader;
+  if (!loadOriginal(TEST_DATA "/original.wav")) {
+    printf("original.wav not found\n");
+    return 1;
+  }
+  printf("%-20s %5s %4s %7s %7s %4s | %6s |\n", "file", "align", "extra",
+         "samples", "blocks", "copy", "snr");
+  char path[256];
+  for (const char *file : files) {
+    snprintf(path, sizeof(path), "%s/%s", TEST_DATA, file);
+    if (!reader.open(path)) {
+      printf("%-20s could not be opened | FAILED\n", file);
+      failed++;
+      continue;
+    }
+    check(file, reader);
+  }
+
+  for (AVCodecID id : codecs) {
+    char name[40];
+    snprintf(name, sizeof(name), "writer %s", ADPCMDescriptors::find(id)->name);
+    if (!write(id) || !reader.open(tmp_file)) {
+      printf("%-20s could not be written | FAILED\n", name);
+      failed++;
+      continue;
+    }
+    check(name, reader);
+  }
+  reader.end();
+  remove(tmp_file);
+
+  ADPCMRawReader raw_reader;
+  ADPCMVector<uint8_t> raw;
+  for (AVCodecID id : raw_codecs) {
+    char name[40];
+    int packet_size;
+    snprintf(name, sizeof(name), "raw %s", ADPCMDescriptors::find(id)->name);
+    if (!writeRaw(id, raw, packet_size) ||
+        !raw_reader.begin(&raw[0], raw.size(), id, 44100, original_channels,
+                          packet_size)) {
+      printf("%-20s could not be written | FAILED\n", name);
+      failed++;
+      continue;
+    }
+    check(name, raw_reader);
+  }
+  raw_reader.end();
+  printf("%s\n", failed == 0 ? "OK" : "FAILED");
+  return failed == 0 ? 0 : 1;
+}